@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+// Counts heap allocations when the library is built with COUNT_HEAP_ALLOCATIONS.
+// malloc, calloc, realloc and free are wrapped at link time, and operator
+// new/delete go through them, so C and C++ allocations anywhere in the image
+// are counted alike. A realloc counts as an allocation, plus a deallocation
+// when it is given a block. Take a snapshot before and after a steady state
+// request to check that it did not touch the heap. Without the flag the
+// counters always read 0.
+namespace alloc_counter {
+    size_t allocations();
+    size_t deallocations();
+    size_t bytes_allocated();
+    void reset();
+}
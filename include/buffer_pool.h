@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Payload bytes per block
+#ifndef HTTP_BUFFER_BLOCK_SIZE
+#define HTTP_BUFFER_BLOCK_SIZE 1024
+#endif
+
+// With HTTP_STATIC_SIZE all blocks come from a static array of this many and the heap is never used
+#ifndef HTTP_BUFFER_POOL_BLOCKS
+#define HTTP_BUFFER_POOL_BLOCKS 48
+#endif
+
+// Each settle() lowers the high-water mark by 1 / 2^shift of itself, and by at least one block
+#ifndef HTTP_BUFFER_POOL_DECAY_SHIFT
+#define HTTP_BUFFER_POOL_DECAY_SHIFT 3
+#endif
+
+struct buffer_block {
+    buffer_block *next;
+    uint32_t used;
+    uint8_t data[HTTP_BUFFER_BLOCK_SIZE];
+};
+
+// Fixed size blocks that buffered response bodies are chained from. Released
+// blocks go on a free list rather than back to the heap, and settle(), called
+// between responses, only frees the idle ones above a high-water mark: the
+// most blocks in use at once recently. A client polling the same resource keeps
+// reusing the same blocks, while the memory a one-off large body needed is
+// given back gradually over the following responses. Since every block has the
+// same size, hours of polling leave the heap no more fragmented than the first
+// request did.
+class buffer_pool {
+public:
+    buffer_pool();
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool &operator=(const buffer_pool&) = delete;
+    ~buffer_pool();
+
+    // The pool every http_response takes its blocks from
+    static buffer_pool &shared();
+
+    // A block with next and used cleared, nullptr when out of memory
+    buffer_block *acquire();
+    // Takes back chain and every block linked after it
+    void release(buffer_block *chain);
+    void settle();
+
+    size_t in_use() const {
+        return m_in_use;
+    }
+    size_t idle() const {
+        return m_idle;
+    }
+    size_t high_water() const {
+        return m_high_water;
+    }
+
+private:
+    buffer_block *m_free = nullptr;
+    uint16_t m_in_use = 0, m_idle = 0, m_peak = 0, m_high_water = 0;
+#ifdef HTTP_STATIC_SIZE
+    buffer_block m_blocks[HTTP_BUFFER_POOL_BLOCKS];
+#endif
+};
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include "websocket.h"
+#include "timer_wheel.h"
 
 class eio_client {
 public:
@@ -19,6 +20,7 @@ public:
     eio_client(tcp_base *socket);
     ~eio_client() { 
         trace1("~eio_client\n");
+        m_ping_timer.cancel();
         delete m_socket;
     }
 
@@ -27,24 +29,27 @@ public:
     bool send_message(std::span<uint8_t> data);
     uint32_t packet_size() const;
 
-    void on_open(std::function<void()> callback);
-    void on_receive(std::function<void()> callback);
-    void on_closed(std::function<void()> callback);
-    void on_error(std::function<void(err_t)> callback);
+    void on_open(inplace_function<void()> callback);
+    void on_receive(inplace_function<void()> callback);
+    void on_closed(inplace_function<void()> callback);
+    void on_error(inplace_function<void(err_t)> callback);
 
     void read_initial_packet();
     void set_refresh_watchdog();
 
 private:
     ws::websocket *m_socket;
-    std::function<void()> m_user_receive_callback, m_user_open_callback, m_user_close_callback;
-    std::function<void(err_t)> m_user_error_callback;
+    inplace_function<void()> m_user_receive_callback, m_user_open_callback, m_user_close_callback;
+    inplace_function<void(err_t)> m_user_error_callback;
     std::string m_sid;
-    int m_ping_interval, m_ping_timeout, m_ping_milliseconds;
+    int m_ping_interval, m_ping_timeout;
+    // Runs out when the server misses a ping
+    wheel_timer m_ping_timer;
     bool m_open, m_refresh_watchdog;
 
     void ws_recv_callback();
     void ws_poll_callback();
+    void ping_timeout_callback();
     void ws_close_callback();
     void ws_error_callback(err_t reason);
 };
\ No newline at end of file
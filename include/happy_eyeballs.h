@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include <pico/time.h>
+
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+
+#include "inplace_function.h"
+#include "timer_wheel.h"
+
+// Delays recommended by RFC 8305
+#ifndef HE_RESOLUTION_DELAY_MS
+#define HE_RESOLUTION_DELAY_MS 50
+#endif
+
+#ifndef HE_CONNECTION_ATTEMPT_DELAY_MS
+#define HE_CONNECTION_ATTEMPT_DELAY_MS 250
+#endif
+
+// lwIP's resolver answers each query with a single record, so there is at most one AAAA and one A candidate
+#define HE_MAX_ATTEMPTS 2
+
+class happy_eyeballs {
+public:
+    happy_eyeballs();
+    ~happy_eyeballs();
+
+    // Starts the AAAA and A lookups for host. Candidates are handed to the attempt callback as they
+    // resolve, IPv6 first, with the next attempt staggered by HE_CONNECTION_ATTEMPT_DELAY_MS.
+    // Returns ERR_OK if an attempt was started synchronously, ERR_INPROGRESS if lookups are pending
+    err_t resolve(std::string host);
+
+    // Reports that the attempt in the given slot failed, starting the next candidate immediately.
+    // Calls the failed callback once no candidates or lookups remain
+    void attempt_failed(uint8_t slot, err_t reason);
+
+    // Stops any pending attempts and ignores lookups that complete afterwards
+    void reset();
+
+    bool racing() const {
+        return !m_done;
+    }
+
+    const ip_addr_t &candidate(uint8_t slot) const {
+        return m_candidates[slot];
+    }
+
+    // Called with the slot and address to connect to. Returns whether the attempt was started
+    void on_attempt(inplace_function<bool(uint8_t, const ip_addr_t&)> callback) {
+        m_attempt_callback = callback;
+    }
+
+    void on_failed(inplace_function<void(err_t)> callback) {
+        m_failed_callback = callback;
+    }
+
+private:
+    ip_addr_t m_candidates[HE_MAX_ATTEMPTS];
+    uint8_t m_count, m_started, m_failed;
+    bool m_v6_pending, m_v4_pending, m_done, m_resolving;
+    err_t m_last_error;
+    wheel_timer m_delay_timer;
+    absolute_time_t m_last_attempt;
+    inplace_function<bool(uint8_t, const ip_addr_t&)> m_attempt_callback;
+    inplace_function<void(err_t)> m_failed_callback;
+
+    void add_candidate(const ip_addr_t &addr);
+    void lookup_failed();
+    void schedule(uint32_t delay_ms);
+    void start_next();
+    void check_exhausted();
+
+    static void dns_callback_v4(const char* name, const ip_addr_t *addr, void* arg);
+    static void dns_callback_v6(const char* name, const ip_addr_t *addr, void* arg);
+};
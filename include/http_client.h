@@ -1,23 +1,77 @@
 #pragma once
-#include <functional>
 #include <span>
 #include <string>
 
 #include <pico/time.h>
 
 #include "http_request.h"
+#include "inplace_function.h"
 #include "http_response.h"
+#include "prepared_request.h"
+#include "response_cache.h"
 #include "LUrlParser.h"
+#include "timer_wheel.h"
 #include "lwip/err.h"
 
 class tcp_base;
+class tcp_client;
+class tcp_tls_client;
 
-class http_client {
+// Most requests that may be outstanding at once with pipelining enabled
+#ifndef HTTP_PIPELINE_DEPTH
+#define HTTP_PIPELINE_DEPTH 4
+#endif
+
+// An idle connection is not reused this close to the end of the server's
+// Keep-Alive timeout, as the server may be closing it already
+#ifndef HTTP_KEEPALIVE_MARGIN_MS
+#define HTTP_KEEPALIVE_MARGIN_MS 1000
+#endif
+
+// Longest a connection is reused after sitting idle when the server gave no
+// Keep-Alive timeout. 0 reuses it however long it was idle
+#ifndef HTTP_KEEPALIVE_IDLE_MS
+#define HTTP_KEEPALIVE_IDLE_MS 0
+#endif
+
+// Most redirects follow_redirects() should allow, http_scheduler follows this many
+#ifndef HTTP_MAX_REDIRECTS
+#define HTTP_MAX_REDIRECTS 5
+#endif
+
+// Largest piece of a streamed request body asked of the provider at once. It lives on the stack
+#ifndef HTTP_UPLOAD_CHUNK
+#define HTTP_UPLOAD_CHUNK 1460
+#endif
+
+// Deadlines of a request in milliseconds, 0 leaves that one out. They run on the
+// shared timer_wheel, and a request that misses one is closed with ERR_TIMEOUT
+struct http_timeouts {
+    // Until the connection is up
+    uint32_t connect = 0;
+    // From the request going out until the first byte of the response
+    uint32_t first_byte = 0;
+    // Longest the response, or a streamed request body, may stall once under way
+    uint32_t idle = 0;
+    // The whole request, connecting and any redirects included. With pipelining
+    // it starts over when the response before is complete
+    uint32_t total = 0;
+};
+
+// Transport is the tcp_base implementation requests go over. With tcp_base itself
+// (the http_client alias) the transport is picked at runtime from the url's scheme.
+// A concrete transport such as tcp_tls_client makes every I/O call direct and keeps
+// the other transport's code out of the binary. Instantiated in http_client.cpp for
+// tcp_base, tcp_client and tcp_tls_client.
+template <class Transport = tcp_base>
+class basic_http_client {
 public:
-    http_client(std::string url, std::span<uint8_t> cert = {});
-    http_client(http_client&&) = default;
-    http_client& operator=(http_client&&) = default;
-    ~http_client();
+    basic_http_client(std::string url, std::span<uint8_t> cert = {});
+    // Takes ownership of transport. With tcp_base it is replaced if its secure() does not match the url's scheme
+    basic_http_client(std::string url, Transport *transport, std::span<uint8_t> cert = {});
+    basic_http_client(basic_http_client&&) = default;
+    basic_http_client& operator=(basic_http_client&&) = default;
+    ~basic_http_client();
 
     void url(std::string new_url);
 
@@ -33,10 +87,27 @@ public:
 
     void send_request(std::string method, std::string target, std::string body = "");
 
+    // Sends a request whose body is pulled from provider as the connection can
+    // take it, so bodies of any size need no more than HTTP_UPLOAD_CHUNK bytes of
+    // RAM. provider fills the span it is given and returns how many bytes it
+    // wrote, 0 once the body is complete. With length known it goes out with a
+    // Content-Length, otherwise chunked. Not available while pipelining
+    void upload(std::string method, std::string target, inplace_function<size_t(std::span<uint8_t>)> provider, int64_t length = -1);
+
     void resend_request() {
-        send_request();
+        if(m_prepared) {
+            dispatch();
+        } else {
+            send_request();
+        }
     }
 
+    // A prepared_request with this client's Host, User-Agent and any headers
+    // added through header() so far frozen into it
+    prepared_request prepare(std::string_view method, std::string_view target);
+    // request must stay alive until the response arrives
+    void send(prepared_request &request);
+
     bool has_response() const {
         return m_response_ready;
     }
@@ -54,48 +125,172 @@ public:
         return m_current_response;
     }
 
-    void on_response(std::function<void()> callback) {
+    void on_response(inplace_function<void()> callback) {
         m_user_response_callback = callback;
     }
-    void on_close(std::function<void()> callback) {
+    void on_close(inplace_function<void()> callback) {
         m_user_closed_callback = callback;
     }
-    void on_error(std::function<void(err_t)> callback) {
+    void on_error(inplace_function<void(err_t)> callback) {
         m_user_error_callback = callback;
     }
+    // Receive response bodies in pieces as they arrive rather than through
+    // response().get_body(). on_response still fires once the body is complete.
+    // Applies from the next request on; pass nullptr to go back to buffering
+    void on_body_chunk(inplace_function<void(std::span<const uint8_t>)> callback) {
+        m_user_body_callback = callback;
+    }
 
+    // Ask for gzip or deflate compressed responses. Bodies are decompressed as they
+    // arrive, so get_body() and on_body_chunk see the original bytes. The first
+    // compressed response allocates a 1 << INFLATE_WINDOW_BITS byte window
+    void accept_encoding(bool enabled) {
+        m_accept_encoding = enabled;
+    }
+
+    // Revalidate GET responses against cache instead of downloading them again. A
+    // 304 Not Modified shows up as the cached response, see http_response::from_cache.
+    // Prepared and pipelined requests bypass the cache. nullptr turns it off
+    void cache(response_cache *cache) {
+        m_cache = cache;
+    }
+
+    // Follow 301, 302, 303, 307 and 308 responses with a Location, up to max_hops
+    // of them per request; 0, the default, hands every redirect to on_response.
+    // 303 turns the request into a GET (a HEAD stays a HEAD), 301 and 302 turn a
+    // POST into a GET, and 307 and 308 repeat the request as it was. A redirect
+    // to the same scheme, host and port goes out on the connection already
+    // open. Prepared and pipelined requests are not redirected, nor is a
+    // streamed body that would have to be sent again
+    void follow_redirects(uint8_t max_hops) {
+        m_max_redirects = max_hops;
+    }
+    // Redirects followed so far for the current request
+    uint8_t redirects() const {
+        return m_redirects;
+    }
+    // Called before following a redirect to another origin, with the absolute url
+    // and the method it would be requested with. Return true to take the request
+    // over, e.g. to send it on a connection already open to that origin; the 3xx
+    // is then dropped without on_response. Otherwise the client reconnects to the
+    // new origin itself and stays pointed at it
+    void on_redirect(inplace_function<bool(const std::string &url, std::string_view method)> callback) {
+        m_user_redirect_callback = callback;
+    }
+
+    // Only the first_byte deadline, see set_timeouts
     void set_timeout(int timeout_ms) {
-        m_timeout_ms = timeout_ms;
+        m_timeouts.first_byte = timeout_ms;
+    }
+    void set_timeouts(const http_timeouts &timeouts) {
+        m_timeouts = timeouts;
     }
 
-    tcp_base *release_tcp_client();
+    // Send requests without waiting for earlier responses. Up to
+    // HTTP_PIPELINE_DEPTH requests share the connection and on_response fires
+    // once per response, in order; read response() from inside the callback.
+    // A request that is not idempotent waits for everything ahead of it and
+    // holds back everything behind it. If the server closes the connection
+    // with requests outstanding, the client reconnects, resends them one at a
+    // time and stops pipelining on this client.
+    void pipelining(bool enabled) {
+        m_pipelining = enabled;
+    }
+    size_t in_flight() const {
+        return m_pipeline_count;
+    }
+
+    Transport *release_tcp_client();
 
     LUrlParser::ParseURL get_parsed_url() const {
         return m_url_parser;
     }
 
 private:
-    tcp_base *m_tcp;
+    // What the phase deadline is currently timing
+    enum class phase : uint8_t {
+        none,
+        connect,
+        send,
+        first_byte,
+        receive
+    };
+
+    Transport *m_tcp;
     bool m_response_ready = false, m_request_sent = false, m_has_error = false;
     http_request m_current_request;
+    prepared_request *m_prepared = nullptr;
+    response_cache *m_cache = nullptr;
+    // Key of the request in flight if its response goes through m_cache, otherwise empty
+    std::string m_cache_key;
+    // The request in flight carries validators revalidate() took from m_cache
+    bool m_revalidating = false;
+    struct pipeline_entry {
+        std::string request;
+        bool head, idempotent, written;
+    };
+    pipeline_entry m_pipeline[HTTP_PIPELINE_DEPTH];
+    uint8_t m_pipeline_first = 0, m_pipeline_count = 0, m_pipeline_depth = HTTP_PIPELINE_DEPTH;
+    bool m_pipelining = false, m_connecting = false, m_accept_encoding = false;
+    // Reconnects since the last response, so a server that never answers is not retried forever
+    uint8_t m_pipeline_retries = 0;
     http_response m_current_response;
     std::string m_host, m_url;
     std::span<uint8_t> m_cert;
     int m_port;
     LUrlParser::ParseURL m_url_parser;
-    std::function<void()> m_user_response_callback, m_user_closed_callback;
-    std::function<void(err_t)> m_user_error_callback;
-    uint32_t m_timeout_ms;
-    alarm_id_t m_timeout_alarm;
+    inplace_function<void()> m_user_response_callback, m_user_closed_callback;
+    inplace_function<void(err_t)> m_user_error_callback;
+    inplace_function<void(std::span<const uint8_t>)> m_user_body_callback;
+    inplace_function<bool(const std::string&, std::string_view)> m_user_redirect_callback;
+    inplace_function<size_t(std::span<uint8_t>)> m_body_provider;
+    // Bytes the provider still owes with a Content-Length, -1 for a chunked body
+    int64_t m_body_remaining = -1;
+    // The request in flight has a streamed body, which cannot be sent again
+    bool m_upload = false;
+    http_timeouts m_timeouts;
+    // connect, send, first_byte and receive come one after the other, so they share a timer
+    wheel_timer m_phase_timer, m_total_timer;
+    phase m_phase = phase::none;
+    alarm_id_t m_retry_alarm = 0, m_redirect_alarm = 0;
+    uint8_t m_max_redirects = 0, m_redirects = 0;
+    // Absolute url of the redirect waiting for m_redirect_alarm
+    std::string m_redirect_url;
+    // Whether the server lets the connection be reused, for how long, and since when it is idle
+    bool m_keep_alive = true;
+    uint32_t m_keep_alive_ms = 0, m_idle_since_ms = 0;
+    // The request went out on a connection that had been idle, so it may have been closed under it
+    bool m_reused_connection = false;
 
     bool init();
     void send_request();
+    void dispatch();
+    void enqueue();
+    void pump();
+    void next_response();
+    void recover_pipeline();
+    void deadline(phase next);
+    void arm_total();
+    void timed_out(bool total);
+    void revalidate();
+    void apply_cache();
+    bool refetch_evicted();
+    void write_body();
+    void track_keep_alive();
+    bool connection_reusable() const;
+    bool retry_on_fresh_connection();
+    bool redirect_pending() const;
+    bool follow_redirect();
     bool parse_url();
+    Transport *create_transport(bool secure);
 
     void tcp_connected_callback();
     void tcp_recv_callback();
     void tcp_closed_callback();
     void tcp_error_callback(err_t);
 
-    static int64_t timeout_callback(alarm_id_t, void*);
-};
\ No newline at end of file
+    static int64_t retry_callback(alarm_id_t, void*);
+    static int64_t redirect_callback(alarm_id_t, void*);
+};
+
+using http_client = basic_http_client<tcp_base>;
\ No newline at end of file
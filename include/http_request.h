@@ -1,19 +1,44 @@
 #include <map>
+#include <span>
 #include <string>
+#include <string_view>
+
+#include "inplace_function.h"
 
 class http_request {
-    friend class http_client;
+    template <class Transport> friend class basic_http_client;
 public:
     http_request();
     http_request(std::string method, std::string target, std::string body = "");
     void add_header(std::string key, std::string value);
+    // Host and User-Agent, written ahead of the other headers. They are kept
+    // out of the header map so that setting them for every request does not
+    // allocate. user_agent must outlive the request
+    void identify(std::string_view host, std::string_view user_agent);
     std::string serialize();
+    // Exact size of the request line, headers and blank line, including a
+    // Content-Length header derived from the body unless one was added
+    size_t head_size() const;
+    // Writes the head into out without allocating. Returns the number of bytes
+    // written, or 0 if out is smaller than head_size()
+    size_t serialize_head(std::span<uint8_t> out) const;
+    // Writes the head through staging, handing it to write each time it fills
+    // and once more at the end, so a head of any size needs no more memory
+    // than staging. Returns the size of the head
+    size_t write_head(std::span<uint8_t> staging, inplace_function<void(std::span<const uint8_t>)> write) const;
+    std::span<const uint8_t> body() const {
+        return {(const uint8_t*)body_.data(), body_.size()};
+    }
     std::string method() const;
     std::string target() const;
     void clear();
 
 private:
-    std::string method_, target_, body_;
+    bool needs_content_length() const;
+    bool identified_by(std::string_view key) const;
+
+    std::string method_, target_, body_, host_;
+    std::string_view user_agent_;
     std::map<std::string, std::string> headers;
     bool ready_ = false;
 };
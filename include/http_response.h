@@ -1,29 +1,85 @@
-#include <map>
 #include <string>
 #include <span>
 
+#include "inplace_function.h"
+#include "inflater.h"
+#include "buffer_pool.h"
+
+// Room for the status line and headers, grown if a head is larger. Bodies are
+// kept in buffer_pool blocks. With HTTP_STATIC_SIZE it is a fixed array, and
+// get_body() lays out a body spanning several blocks in it after the head, so
+// there it bounds the head and such a body together, as it bounded the whole
+// response before bodies moved to the pool
+#ifndef HTTP_DEFAULT_CAPACITY
 #ifndef HTTP_STATIC_SIZE
 #define HTTP_DEFAULT_CAPACITY 2560
 #else
 #define HTTP_DEFAULT_CAPACITY 49152
 #endif
+#endif
+
+// Responses with a larger status line and headers fail to parse. Header
+// positions are kept in 16 bits, so it cannot be more than 65535
+#ifndef HTTP_MAX_HEAD_SIZE
+#define HTTP_MAX_HEAD_SIZE 16384
+#endif
+static_assert(HTTP_MAX_HEAD_SIZE <= 65535, "header offsets are 16 bit");
+
+// Headers beyond this many are dropped with a warning
+#ifndef HTTP_MAX_HEADERS
+#define HTTP_MAX_HEADERS 24
+#endif
+
+// Case-insensitive FNV-1a of a header name
+constexpr uint32_t header_hash(std::string_view name) {
+    uint32_t hash = 2166136261u;
+    for(char c : name) {
+        hash ^= (uint8_t)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
 class http_request;
 
 class http_response {
-    friend class http_client;
+    template <class Transport> friend class basic_http_client;
     enum class parse_state {
         status_line,
         headers,
         body,
-        done
+        done,
+        failed
+    };
+    // Position inside a Transfer-Encoding: chunked body
+    enum class chunk_state {
+        size,
+        extension,
+        data,
+        data_end,
+        trailer
     };
     enum class content_type {
         text,
         json,
         binary
     };
+    enum class content_encoding : uint8_t {
+        identity,
+        gzip,
+        deflate
+    };
 public:
+    // Headers the parser looks at itself, available without a name lookup
+    enum class known_header : uint8_t {
+        content_length,
+        content_type,
+        transfer_encoding,
+        connection,
+        content_encoding,
+        count
+    };
+
     http_response(const http_request *request = nullptr);
     http_response(http_response&) = delete;
     http_response(http_response&&) = delete;
@@ -31,30 +87,118 @@ public:
 
     http_response &operator=(http_response&) = delete;
     http_response &operator=(http_response&&);
-    void parse(std::span<uint8_t> data);
+    // Returns how many bytes of data belong to this response. Anything after
+    // that is the start of the next response on the connection
+    size_t parse(std::span<uint8_t> data);
     void parse_line(std::string_view line);
-    const std::map<std::string, std::string_view> &get_headers() const;
+    // Value of the last header called name, compared case-insensitively. Empty if absent
+    std::string_view header(std::string_view name) const;
+    std::string_view header(known_header which) const;
+    size_t header_count() const {
+        return header_entries;
+    }
+    std::string_view header_name(size_t i) const;
+    std::string_view header_value(size_t i) const;
     uint16_t status() const;
-    const std::string_view &get_status_text() const;
-    const std::string_view &get_protocol() const;
-    const std::string_view &get_body() const;
-    // Copies data from parameter into the response
-    void add_data(std::span<uint8_t> data);
+    std::string_view get_status_text() const;
+    std::string_view get_protocol() const;
+    // Empty when the body is streamed to on_body_chunk. A body that spans more
+    // than one buffer_pool block is copied into one piece on the first call, on
+    // the heap or, with HTTP_STATIC_SIZE, after the head; empty if it does not fit
+    std::string_view get_body() const;
+    // Bytes of buffered body, without making it contiguous
+    size_t body_size() const {
+        return buffered;
+    }
+    // Passes the buffered body to visitor one block at a time, in order
+    void visit_body(inplace_function<void(std::span<const uint8_t>)> visitor) const;
+    // Streams the body to callback as it arrives instead of buffering it. Only the
+    // status line and headers stay resident, so bodies may be larger than free RAM
+    void on_body_chunk(inplace_function<void(std::span<const uint8_t>)> callback) {
+        body_callback = callback;
+    }
+    bool streaming() const {
+        return (bool)body_callback;
+    }
+    // True if the body was sent compressed. It is decompressed before reaching
+    // get_body() or the on_body_chunk sink either way
+    bool compressed() const {
+        return encoding != content_encoding::identity;
+    }
+    // True if the server answered 304 Not Modified and the body and status come
+    // from a response_cache. The headers are the ones sent with the 304
+    bool from_cache() const {
+        return cached;
+    }
+    // Copies data from parameter into the head buffer
+    void add_data(std::span<const uint8_t> data);
     void clear();
+    // A body with neither Content-Length nor chunked encoding ends when the
+    // connection does. Returns true if that completed the response
+    bool complete_at_close();
 
 private:
+    // Position of a piece of the head within data, so it survives reallocation
+    struct field {
+        uint32_t offset = 0, length = 0;
+    };
+
     uint16_t status_code;
     int content_length = -1, body_start = 0;
-    std::string_view protocol, status_text, body;
+    // Head parsing resumes from here: the start of the current line and how far it has been searched
+    uint32_t line_start = 0, scan_index = 0;
+    field protocol, status_text;
+    // Offsets into data, which only ever holds the head
+    struct header_entry {
+        uint32_t hash;
+        uint16_t name_offset, name_length, value_offset, value_length;
+    };
+    header_entry header_table[HTTP_MAX_HEADERS];
+    uint8_t header_entries = 0;
+    field known_headers[(size_t)known_header::count];
+    uint32_t body_received = 0;
+    // Bytes at the end of the last chunk that were past the end of the response
+    uint32_t excess = 0;
+    bool chunked = false;
+    chunk_state chunk = chunk_state::size;
+    uint32_t chunk_remaining = 0;
+    uint16_t trailer_length = 0;
+    uint8_t chunk_digits = 0;
 #ifndef HTTP_STATIC_SIZE
     uint8_t* data;
 #else
     uint8_t data[HTTP_DEFAULT_CAPACITY];
 #endif
     uint32_t index, capacity;
-    std::map<std::string, std::string_view> headers;
+    // Buffered body, chained from buffer_pool::shared() blocks
+    buffer_block *body_head = nullptr, *body_tail = nullptr;
+    uint32_t buffered = 0;
+    // Contiguous copy of a body spanning several blocks, made by get_body(). With
+    // HTTP_STATIC_SIZE it points into data rather than at its own allocation
+    mutable uint8_t *flat = nullptr;
     parse_state state;
     content_type type;
+    content_encoding encoding = content_encoding::identity;
+    // Created the first time a compressed body arrives and kept for later responses
+    inflater *decoder = nullptr;
     const http_request *request = nullptr;
+    bool head_request = false, cached = false;
+    inplace_function<void(std::span<const uint8_t>)> body_callback;
     bool only_parse_headers();
+    void parse_head();
+    void discard_head();
+    std::string_view view(field f) const;
+    field to_field(std::string_view text) const;
+    void add_header(std::string_view name, std::string_view value);
+    void parse_body();
+    size_t deliver_body(std::span<const uint8_t> chunk);
+    size_t decode_chunked(std::span<const uint8_t> raw);
+    void end_chunk_size_line();
+    void emit_chunk_data(std::span<const uint8_t> payload);
+    void emit_content(std::span<const uint8_t> content);
+    void emit_decoded(std::span<const uint8_t> decoded);
+    void append_body(std::span<const uint8_t> bytes);
+    void release_body();
+    bool start_decoder();
+    void serve_cached(uint16_t status, std::span<const uint8_t> body);
 };
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include <pico/time.h>
+
+#include "http_client.h"
+#include "inplace_function.h"
+
+// Connections open at once, across all hosts
+#ifndef HTTP_SCHEDULER_MAX_CONNECTIONS
+#define HTTP_SCHEDULER_MAX_CONNECTIONS 4
+#endif
+
+// Connections to the same scheme, host and port
+#ifndef HTTP_SCHEDULER_MAX_PER_HOST
+#define HTTP_SCHEDULER_MAX_PER_HOST 2
+#endif
+
+// Requests waiting or in flight
+#ifndef HTTP_SCHEDULER_QUEUE_SIZE
+#define HTTP_SCHEDULER_QUEUE_SIZE 16
+#endif
+
+// Runs requests for any number of callers over a bounded pool of http_clients.
+// Requests are dispatched highest priority first, in submission order within a
+// priority, as soon as a connection is free within the per-host and total limits.
+// Idle connections stay open for reuse by the next request to the same host and
+// are repointed at another host when the pool is full. A redirect to another
+// host goes back in the queue ahead of later requests and takes a connection
+// from the pool, so one already open to that host saves the setup.
+//
+// With single_flight() on, a GET for a url that is already waiting or in
+// flight joins that request instead of being sent again, and every caller gets
+// the same response.
+class http_scheduler {
+public:
+    http_scheduler(std::span<uint8_t> cert = {});
+    // Connection index goes over what transports returns for it, and the
+    // scheduler takes ownership of it, see http_client
+    http_scheduler(inplace_function<tcp_base*(uint8_t index)> transports, std::span<uint8_t> cert = {});
+    ~http_scheduler();
+
+    // url is absolute, e.g. "https://example.com/api/v1/status?verbose=1". Exactly one of
+    // response_callback or error_callback is called for each accepted request, and the
+    // response is only valid inside the callback. Returns false if the queue is full or
+    // the url is invalid
+    bool submit(
+        std::string url,
+        inplace_function<void(const http_response&)> response_callback,
+        inplace_function<void(err_t)> error_callback = {},
+        std::string method = "GET",
+        std::string body = "",
+        uint8_t priority = 0
+    );
+
+    // Applied to every connection, 0 disables the timeout
+    void set_timeout(uint32_t timeout_ms);
+
+    // Lets a GET without a body join an identical one submitted earlier that is
+    // not complete yet, rather than take a connection of its own. It keeps its
+    // own callbacks and still takes a queue slot. The request it joins is
+    // moved up to its priority. Off by default
+    void single_flight(bool enabled) {
+        m_single_flight = enabled;
+    }
+
+    size_t queued() const;
+    size_t in_flight() const;
+
+private:
+    struct pending {
+        std::string origin, target, method, body;
+        inplace_function<void(const http_response&)> response_callback;
+        inplace_function<void(err_t)> error_callback;
+        uint32_t sequence;
+        uint8_t priority;
+        // Redirects followed so far, counted against HTTP_MAX_REDIRECTS
+        uint8_t redirects;
+        // Index into m_queue of the request this one joined, -1 if it goes out itself
+        int8_t leader;
+        // Later identical requests may join this one
+        bool joinable;
+        bool used, dispatched;
+    };
+
+    struct connection {
+        http_client *client;
+        std::string origin;
+        // Index into m_queue of the request in flight, -1 when idle
+        int8_t request;
+    };
+
+    pending m_queue[HTTP_SCHEDULER_QUEUE_SIZE];
+    connection m_connections[HTTP_SCHEDULER_MAX_CONNECTIONS];
+    std::span<uint8_t> m_cert;
+    inplace_function<tcp_base*(uint8_t)> m_transports;
+    uint32_t m_sequence, m_timeout_ms;
+    alarm_id_t m_schedule_alarm;
+    bool m_single_flight = false;
+
+    void schedule();
+    void schedule_soon();
+    int8_t next_request() const;
+    int8_t connection_for(const std::string &origin) const;
+    uint8_t connections_to(const std::string &origin) const;
+    void dispatch(uint8_t index, int8_t request);
+    void finish(uint8_t index);
+    void release(int8_t request);
+    uint8_t take_followers(int8_t request, int8_t *followers);
+
+    void response_callback(uint8_t index);
+    void error_callback(uint8_t index, err_t err);
+    void closed_callback(uint8_t index);
+    bool redirect_callback(uint8_t index, const std::string &url, std::string_view method);
+
+    static int64_t schedule_alarm_callback(alarm_id_t, void*);
+};
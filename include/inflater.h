@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "inplace_function.h"
+
+// Back-references reach at most this far. 15 (32 KiB) decodes any stream;
+// smaller windows save RAM but only work with servers compressing with a
+// window no larger than this. zlib streams announcing a larger window are
+// rejected up front, gzip and raw deflate fail when a reference is too far
+#ifndef INFLATE_WINDOW_BITS
+#define INFLATE_WINDOW_BITS 15
+#endif
+
+#define INFLATE_WINDOW_SIZE (1u << INFLATE_WINDOW_BITS)
+
+// Streaming DEFLATE (RFC 1951) decoder with optional zlib (RFC 1950) or gzip
+// (RFC 1952) framing. Input can be split at any byte, and decoded output is
+// passed to the sink in pieces as the window fills. The only memory used is
+// the window, allocated by reset(), and about 1 KiB of tables in the object.
+class inflater {
+public:
+    enum class format : uint8_t {
+        raw,
+        // zlib framing, falling back to raw deflate if the stream has no zlib header
+        zlib,
+        gzip
+    };
+    enum class status : uint8_t {
+        more,
+        done,
+        error
+    };
+
+    inflater();
+    ~inflater();
+    inflater(const inflater&) = delete;
+    inflater &operator=(const inflater&) = delete;
+
+    // Prepares for a new stream. Returns false if the window could not be allocated
+    bool reset(format stream_format);
+    // Decodes as much of in as possible. Input after the end of the stream is ignored
+    status feed(std::span<const uint8_t> in, const inplace_function<void(std::span<const uint8_t>)> &sink);
+
+    uint32_t total_out() const {
+        return m_total_out;
+    }
+
+private:
+    enum class stage : uint8_t {
+        gzip_header,
+        gzip_fixed,
+        gzip_extra_length,
+        gzip_extra,
+        gzip_name,
+        gzip_comment,
+        gzip_header_crc,
+        zlib_header,
+        block_header,
+        stored_length,
+        stored_copy,
+        table_sizes,
+        code_length_codes,
+        code_lengths,
+        codes,
+        trailer,
+        finished,
+        failed
+    };
+
+    // Canonical Huffman code: number of codes of each length and the symbols in code order
+    struct huffman {
+        uint16_t *count;
+        uint16_t *symbol;
+    };
+
+    uint8_t *m_window;
+    uint32_t m_window_pos, m_flushed, m_total_out, m_check;
+    uint64_t m_bitbuf;
+    const uint8_t *m_in, *m_in_end;
+    const inplace_function<void(std::span<const uint8_t>)> *m_sink;
+    uint8_t m_bitcnt;
+    format m_format;
+    stage m_stage;
+    bool m_last;
+    uint8_t m_flags;
+    uint16_t m_index, m_remaining, m_nlen, m_ndist, m_ncode;
+
+    uint16_t m_len_count[16], m_len_symbol[288];
+    uint16_t m_dist_count[16], m_dist_symbol[30];
+    uint8_t m_lengths[320];
+
+    bool step();
+    void fill();
+    bool need(uint8_t count);
+    uint32_t bits(uint8_t count);
+    void put(uint8_t byte);
+    void flush();
+    bool fail(const char *reason);
+    int decode(const huffman &code, uint8_t skip, uint8_t &used) const;
+    bool build_fixed();
+    bool build_dynamic();
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Enough for std::bind of a member function and this, or a lambda capturing a few pointers
+#ifndef INPLACE_FUNCTION_CAPACITY
+#define INPLACE_FUNCTION_CAPACITY (4 * sizeof(void*))
+#endif
+
+template <class Signature, size_t Capacity = INPLACE_FUNCTION_CAPACITY>
+class inplace_function;
+
+// Drop-in replacement for std::function that stores the callable in a fixed
+// buffer inside the object and never allocates. Callables larger than Capacity
+// are rejected at compile time. Calling an empty inplace_function does nothing
+// and returns a value-initialized R.
+template <class R, class... Args, size_t Capacity>
+class inplace_function<R(Args...), Capacity> {
+public:
+    inplace_function() noexcept
+        : m_invoke(&invoke_empty)
+        , m_manage(nullptr)
+    {}
+
+    inplace_function(std::nullptr_t) noexcept
+        : inplace_function()
+    {}
+
+    template <class F, class D = std::decay_t<F>,
+              class = std::enable_if_t<!std::is_same_v<D, inplace_function> && std::is_invocable_r_v<R, D&, Args...>>>
+    inplace_function(F&& callable) {
+        static_assert(sizeof(D) <= Capacity, "callable is too large for this inplace_function, capture less or raise its capacity");
+        static_assert(alignof(D) <= alignof(std::max_align_t), "callable is over-aligned for inplace_function");
+        ::new ((void*)m_storage) D(std::forward<F>(callable));
+        m_invoke = &invoke<D>;
+        m_manage = &manage<D>;
+    }
+
+    inplace_function(const inplace_function &other)
+        : m_invoke(other.m_invoke)
+        , m_manage(other.m_manage)
+    {
+        if(m_manage) {
+            m_manage(operation::copy, m_storage, const_cast<unsigned char*>(other.m_storage));
+        }
+    }
+
+    inplace_function(inplace_function &&other) noexcept
+        : m_invoke(other.m_invoke)
+        , m_manage(other.m_manage)
+    {
+        if(m_manage) {
+            m_manage(operation::move, m_storage, other.m_storage);
+        }
+    }
+
+    ~inplace_function() {
+        reset();
+    }
+
+    inplace_function &operator=(const inplace_function &other) {
+        if(this != &other) {
+            reset();
+            m_invoke = other.m_invoke;
+            m_manage = other.m_manage;
+            if(m_manage) {
+                m_manage(operation::copy, m_storage, const_cast<unsigned char*>(other.m_storage));
+            }
+        }
+        return *this;
+    }
+
+    inplace_function &operator=(inplace_function &&other) noexcept {
+        if(this != &other) {
+            reset();
+            m_invoke = other.m_invoke;
+            m_manage = other.m_manage;
+            if(m_manage) {
+                m_manage(operation::move, m_storage, other.m_storage);
+            }
+        }
+        return *this;
+    }
+
+    inplace_function &operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    template <class F, class D = std::decay_t<F>,
+              class = std::enable_if_t<!std::is_same_v<D, inplace_function> && std::is_invocable_r_v<R, D&, Args...>>>
+    inplace_function &operator=(F&& callable) {
+        return *this = inplace_function(std::forward<F>(callable));
+    }
+
+    R operator()(Args... args) const {
+        return m_invoke(const_cast<unsigned char*>(m_storage), std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const noexcept {
+        return m_manage != nullptr;
+    }
+
+private:
+    enum class operation {
+        copy,
+        move,
+        destroy
+    };
+
+    alignas(std::max_align_t) unsigned char m_storage[Capacity];
+    R (*m_invoke)(void*, Args&&...);
+    void (*m_manage)(operation, void*, void*);
+
+    void reset() {
+        if(m_manage) {
+            m_manage(operation::destroy, m_storage, nullptr);
+        }
+        m_invoke = &invoke_empty;
+        m_manage = nullptr;
+    }
+
+    static R invoke_empty(void*, Args&&...) {
+        if constexpr(!std::is_void_v<R>) {
+            return R();
+        }
+    }
+
+    template <class D>
+    static R invoke(void* storage, Args&&... args) {
+        return std::invoke(*static_cast<D*>(storage), std::forward<Args>(args)...);
+    }
+
+    template <class D>
+    static void manage(operation op, void* dest, void* src) {
+        switch(op) {
+        case operation::copy:
+            ::new (dest) D(*static_cast<const D*>(src));
+            break;
+        case operation::move:
+            ::new (dest) D(std::move(*static_cast<D*>(src)));
+            break;
+        case operation::destroy:
+            static_cast<D*>(dest)->~D();
+            break;
+        }
+    }
+};
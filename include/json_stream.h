@@ -0,0 +1,128 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <nlohmann/json.hpp>
+
+#include "inplace_function.h"
+
+// Deepest nesting of objects and arrays accepted
+#ifndef JSON_STREAM_MAX_DEPTH
+#define JSON_STREAM_MAX_DEPTH 32
+#endif
+
+// Paths that can be watched at once, at most 32
+#ifndef JSON_STREAM_MAX_WATCHES
+#define JSON_STREAM_MAX_WATCHES 8
+#endif
+
+// Push parser for a JSON document that arrives in pieces, such as a response
+// body through http_client::on_body_chunk. Only the values at the watched JSON
+// pointer paths are turned into nlohmann::json, each as soon as its last byte
+// arrives; everything else is checked for structure and skipped. Memory is the
+// current path (bounded by JSON_STREAM_MAX_DEPTH) plus the text of the watched
+// value being read, however large the document is.
+//
+// nlohmann::json::sax_parse pulls its input, so it cannot be handed a body
+// chunk by chunk; this does the tokenizing itself and leaves the watched values
+// to nlohmann::json::parse. A path inside a value that is already being
+// captured is not reported separately.
+class json_stream {
+public:
+    json_stream();
+
+    // pointer is an RFC 6901 JSON pointer such as "/data/0/name". A "*" segment
+    // matches every key or array index at that level, so "/items/*/id" reports
+    // the id of each element in turn. Returns false if the pointer is malformed
+    // or JSON_STREAM_MAX_WATCHES are already registered
+    bool watch(std::string_view pointer, inplace_function<void(const nlohmann::json&)> callback);
+
+    // Returns false once the document turned out to be malformed
+    bool feed(std::span<const uint8_t> data);
+    // Call after the last piece. Returns false unless a complete document was read
+    bool finish();
+    // Starts on a new document, keeping the watches
+    void reset();
+
+    // Can be passed straight to http_client::on_body_chunk
+    inplace_function<void(std::span<const uint8_t>)> sink() {
+        return [this](std::span<const uint8_t> data){ feed(data); };
+    }
+
+    bool done() const {
+        return m_state == state::done;
+    }
+    bool failed() const {
+        return m_state == state::failed;
+    }
+
+private:
+    enum class state : uint8_t {
+        value,
+        // Just after '[', a value or ']'
+        value_or_end,
+        // Just after '{', a key or '}'
+        key_or_end,
+        key,
+        colon,
+        after_value,
+        string,
+        escape,
+        unicode,
+        number,
+        literal,
+        done,
+        failed
+    };
+    struct segment {
+        std::string key;
+        // -1 if key is not an array index
+        int32_t index;
+        bool wildcard;
+    };
+    struct watcher {
+        std::vector<segment> path;
+        inplace_function<void(const nlohmann::json&)> callback;
+    };
+    struct frame {
+        std::string key;
+        uint32_t index;
+        bool object;
+    };
+
+    watcher m_watches[JSON_STREAM_MAX_WATCHES];
+    uint8_t m_watch_count = 0;
+    frame m_stack[JSON_STREAM_MAX_DEPTH];
+    uint8_t m_depth = 0;
+    // Bit w of m_matches[d] is set if the first d segments of watch w match the current path
+    uint32_t m_matches[JSON_STREAM_MAX_DEPTH + 1];
+    state m_state = state::value;
+    bool m_key = false;
+    // Progress through "true", "false" or "null"
+    const char *m_literal = nullptr;
+    uint8_t m_literal_pos = 0;
+    // \uXXXX escape being read, and a high surrogate waiting for its pair
+    uint16_t m_unicode = 0, m_high_surrogate = 0;
+    uint8_t m_unicode_digits = 0;
+    // Text of the watched value being read and the watches it is for
+    std::string m_capture;
+    uint32_t m_capture_watches = 0;
+    uint8_t m_capture_depth = 0;
+    bool m_capturing = false;
+    // The piece being fed and where the captured text starts in it
+    std::span<const uint8_t> m_chunk;
+    size_t m_capture_start = 0;
+    uint32_t m_offset = 0;
+
+    bool step(uint8_t c, size_t pos);
+    void begin_value(size_t pos);
+    void end_value(size_t end);
+    bool push(bool object);
+    void pop(size_t end);
+    void enter(uint8_t depth);
+    void append_key(uint32_t code_point);
+    void fail(const char *reason);
+};
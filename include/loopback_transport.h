@@ -0,0 +1,103 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "tcp_base.h"
+#include "circular_buffer.h"
+
+#define LOOPBACK_SEGMENT_SIZE 1460
+
+// Bytes a writer may have in flight to its peer, like lwIP's TCP_SND_BUF
+#ifndef LOOPBACK_SEND_BUFFER
+#define LOOPBACK_SEND_BUFFER 8192
+#endif
+
+// In-memory tcp_base that talks to a paired peer instead of lwIP.
+// Time is simulated: nothing is delivered until advance() is called, so a host
+// harness can drive both ends deterministically. Writes are split into segments
+// of segment_size bytes, each delivered after latency_ms plus up to jitter_ms.
+// Ordering is preserved like a real TCP stream, and delivery stalls while the
+// receive buffer is full.
+class loopback_transport : public tcp_base {
+public:
+    loopback_transport(size_t segment_size = LOOPBACK_SEGMENT_SIZE, uint32_t latency_ms = 0, uint32_t jitter_ms = 0, bool secure = false);
+    ~loopback_transport();
+
+    static void pair(loopback_transport &a, loopback_transport &b);
+
+    bool init() override;
+    int available() const override;
+    size_t read(std::span<uint8_t> out) override;
+    bool write(std::span<const uint8_t> data) override;
+    size_t writable() const override;
+    void flush() override;
+    bool connect(std::string host, uint16_t port) override;
+    err_t close(err_t reason) override;
+
+    bool connected() const override;
+    bool initialized() const override;
+    bool secure() const override {
+        return secure_;
+    }
+
+    // Advances this end's clock, delivering due segments and firing poll callbacks
+    void advance(uint32_t ms = 1);
+    // Bytes written by the peer that have not reached the receive buffer yet
+    size_t in_flight() const;
+
+    void seed(uint32_t value) {
+        rng_state = value ? value : 1;
+    }
+
+    void on_receive(inplace_function<void()> callback) override {
+        user_receive_callback = callback;
+    }
+
+    void on_connected(inplace_function<void()> callback) override {
+        user_connected_callback = callback;
+    }
+
+    void on_poll(uint8_t interval_seconds, inplace_function<void()> callback) override {
+        poll_interval_ms = interval_seconds * 1000;
+        next_poll_ms = now_ms + poll_interval_ms;
+        user_poll_callback = callback;
+    }
+
+    void on_closed(inplace_function<void()> callback) override {
+        user_closed_callback = callback;
+    }
+
+    void on_error(inplace_function<void(err_t)> callback) override {
+        user_error_callback = callback;
+    }
+
+    void on_sent(inplace_function<void()> callback) override {
+        user_sent_callback = callback;
+    }
+
+private:
+    struct segment {
+        std::vector<uint8_t> data;
+        size_t offset;
+        uint32_t deliver_at;
+        // ERR_OK for data, otherwise the peer closed the connection with this reason
+        err_t close_reason;
+    };
+
+    loopback_transport *peer;
+    std::deque<segment> inbound;
+    circular_buffer<uint8_t, BUF_SIZE> buffer;
+    size_t segment_size;
+    uint32_t latency_ms, jitter_ms, rng_state;
+    uint32_t now_ms, last_delivery_ms, poll_interval_ms, next_poll_ms;
+    bool connected_, initialized_, secure_, connect_pending;
+    // The peer closed and connected again before the close got here, so the
+    // segments queued behind the close belong to the new connection
+    bool reconnect_pending;
+    inplace_function<void()> user_receive_callback, user_connected_callback, user_poll_callback, user_closed_callback, user_sent_callback;
+    inplace_function<void(err_t)> user_error_callback;
+
+    void enqueue(std::span<const uint8_t> data, err_t close_reason = ERR_OK);
+    uint32_t next_jitter();
+};
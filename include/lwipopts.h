@@ -38,6 +38,13 @@
 #define LWIP_CHKSUM_ALGORITHM           3
 #define LWIP_DHCP                       1
 #define LWIP_IPV4                       1
+#ifndef LWIP_IPV6
+#define LWIP_IPV6                       1
+#endif
+#if LWIP_IPV6
+#define LWIP_IPV6_AUTOCONFIG            1
+#define DNS_MAX_SERVERS                 2
+#endif
 #define LWIP_TCP                        1
 #define LWIP_UDP                        1
 #define LWIP_DNS                        1
@@ -1,11 +1,12 @@
 #pragma once
 
 #include <string>
-#include <functional>
 #include <span>
 
 #include <pico/stdlib.h>
 
+#include "timer_wheel.h"
+
 #define NTP_DEFAULT_RETRY_TIME (10 * 1000)
 #define NTP_DELTA 2208988800 // Seconds between 1/1/1900 and 1/1/1970
 
@@ -35,11 +36,11 @@ private:
     udp_client* udp;
     ntp_state m_state;
     std::string ntp_server;
-    alarm_id_t ntp_resend_alarm;
+    // Sends again while no answer comes, and turns the RTC alarm back on after it fired
+    wheel_timer ntp_resend_timer, rtc_rearm_timer;
     uint32_t ntp_retry_time, last_sync, sent_ms, recv_ms;
 
     void send_packet();
     static void* rtc_cb_data;
     static void rtc_callback();
-    static int64_t alarm_callback(alarm_id_t, void*);
 };
\ No newline at end of file
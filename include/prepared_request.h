@@ -0,0 +1,45 @@
+#pragma once
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A request whose request line and fixed headers are serialized once, for
+// requests that are sent over and over such as periodic polls. Variable
+// headers and the body are appended behind the frozen part for each send and
+// the whole request goes to the transport in one write. The buffer keeps its
+// capacity between sends, so once it has grown to fit no further allocations
+// are made.
+//
+// Per send: header() for each variable header, then body(), then hand it to
+// http_client::send(). A header() or body() call after body() or a send starts
+// over from the frozen part.
+class prepared_request {
+public:
+    prepared_request(std::string_view method, std::string_view target);
+
+    // Adds a header to the frozen part. Only valid before the first send
+    void freeze_header(std::string_view key, std::string_view value);
+
+    // Adds a header for the next send only
+    void header(std::string_view key, std::string_view value);
+    void body(std::span<const uint8_t> data);
+    void body(std::string_view data) {
+        body({(const uint8_t*)data.data(), data.size()});
+    }
+
+    // The complete serialized request. Ends the head if body() was not called
+    std::span<const uint8_t> finish();
+
+    std::string_view method() const {
+        return {(const char*)m_buffer.data(), m_method_size};
+    }
+
+private:
+    std::vector<uint8_t> m_buffer;
+    size_t m_frozen_size, m_method_size;
+    bool m_finished, m_sent;
+
+    void append(std::string_view text);
+    void restart();
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <cstdint>
+
+#include <pico/time.h>
+
+#include "http_client.h"
+#include "timer_wheel.h"
+#include "inplace_function.h"
+
+// Connection failures in a row, without any new data arriving, before a download gives up
+#ifndef HTTP_DOWNLOAD_RETRIES
+#define HTTP_DOWNLOAD_RETRIES 5
+#endif
+
+// Wait before the first retry, doubled for each one after that
+#ifndef HTTP_DOWNLOAD_RETRY_DELAY_MS
+#define HTTP_DOWNLOAD_RETRY_DELAY_MS 500
+#endif
+
+// Downloads a resource in as many Range requests as it takes. After a dropped
+// connection, a timeout or a stall the download picks up from the last byte
+// delivered instead of from the start. Every response is checked against the
+// first one: a Content-Range that does not line up or a different ETag or
+// Last-Modified stops the download with ERR_VAL and changed() set, so pieces of
+// two versions are never stitched together. A server that ignores Range is
+// handled too, the part already delivered is just downloaded again and skipped.
+class range_download {
+public:
+    range_download(std::string url, std::span<uint8_t> cert = {});
+    // Takes ownership of transport, see http_client
+    range_download(std::string url, tcp_base *transport, std::span<uint8_t> cert = {});
+    range_download(range_download&) = delete;
+    range_download(range_download&&) = delete;
+    ~range_download();
+
+    // offset and the validators can come from an earlier run, e.g. stored along
+    // with the data, to carry on after a reset
+    void start(uint32_t offset = 0, std::string etag = "", std::string last_modified = "");
+    void cancel();
+
+    // Body bytes in order, data starts offset bytes into the resource. Each byte is passed exactly once
+    void on_data(inplace_function<void(uint32_t offset, std::span<const uint8_t> data)> callback) {
+        m_user_data_callback = callback;
+    }
+    void on_complete(inplace_function<void()> callback) {
+        m_user_complete_callback = callback;
+    }
+    // The resource changed (ERR_VAL, changed() is true), the server refused it
+    // (ERR_VAL) or the last error once the retries ran out
+    void on_error(inplace_function<void(err_t)> callback) {
+        m_user_error_callback = callback;
+    }
+
+    // Time allowed without any data arriving before the connection is dropped
+    // and the request retried. 0 disables it
+    void set_timeout(uint32_t timeout_ms);
+
+    bool active() const {
+        return m_active;
+    }
+    bool changed() const {
+        return m_changed;
+    }
+    // Bytes delivered to on_data so far
+    uint32_t committed() const {
+        return m_committed;
+    }
+    // Size of the resource, -1 until a response says
+    int64_t total() const {
+        return m_total;
+    }
+    const std::string &etag() const {
+        return m_etag;
+    }
+    const std::string &last_modified() const {
+        return m_last_modified;
+    }
+
+private:
+    http_client m_client;
+    std::string m_url, m_target, m_etag, m_last_modified;
+    uint32_t m_committed = 0, m_skip = 0, m_watched = 0, m_timeout_ms = 0;
+    int64_t m_total = -1;
+    uint8_t m_retries = 0;
+    bool m_active = false, m_validated = false, m_changed = false, m_interrupted = false, m_retry = false;
+    err_t m_error = ERR_OK;
+    // m_timer runs whatever was scheduled next, m_watchdog checks for a stall every m_timeout_ms
+    wheel_timer m_timer, m_watchdog;
+    inplace_function<void(uint32_t, std::span<const uint8_t>)> m_user_data_callback;
+    inplace_function<void()> m_user_complete_callback;
+    inplace_function<void(err_t)> m_user_error_callback;
+
+    void init();
+    void request();
+    bool validate();
+    void interrupt(err_t err, bool retry);
+    void retry(err_t err);
+    void finish(err_t err);
+    void schedule(uint32_t delay_ms);
+
+    void body_callback(std::span<const uint8_t> data);
+    void response_callback();
+    void closed_callback();
+    void error_callback(err_t err);
+
+    void timer_callback();
+    void watchdog_callback();
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "tcp_base.h"
+#include "circular_buffer.h"
+
+// Binary trace layout: "PWCT", a version byte, then one record per event:
+//   type (1 byte), microseconds since the previous record (LEB128),
+//   then for received/written a LEB128 length and the payload,
+//   or for error the err_t as one byte
+#define TRANSPORT_TRACE_MAGIC "PWCT"
+#define TRANSPORT_TRACE_VERSION 1
+
+namespace capture {
+    enum class record_type : uint8_t {
+        connected = 1,
+        received,
+        written,
+        closed,
+        error
+    };
+
+    size_t put_varint(uint8_t *out, uint64_t value);
+    // Returns the number of bytes consumed, 0 if the input is truncated
+    size_t get_varint(std::span<const uint8_t> in, uint64_t &value);
+}
+
+// tcp_base decorator that forwards to another transport and writes every
+// event to a trace sink. Each received chunk is kept as one record, so the
+// segment boundaries the protocol layers saw can be replayed exactly. A chunk
+// that does not fit in the buffer is finished by the next read().
+// Takes ownership of the wrapped transport.
+class recording_transport : public tcp_base {
+public:
+    recording_transport(tcp_base *inner, inplace_function<void(std::span<const uint8_t>)> sink);
+    ~recording_transport();
+
+    bool init() override;
+    int available() const override;
+    size_t read(std::span<uint8_t> out) override;
+    bool write(std::span<const uint8_t> data) override;
+    size_t writable() const override;
+    void flush() override;
+    bool connect(std::string host, uint16_t port) override;
+    err_t close(err_t reason) override;
+
+    bool connected() const override;
+    bool initialized() const override;
+    bool secure() const override;
+
+    void on_receive(inplace_function<void()> callback) override {
+        user_receive_callback = callback;
+    }
+
+    void on_connected(inplace_function<void()> callback) override {
+        user_connected_callback = callback;
+    }
+
+    void on_poll(uint8_t interval_seconds, inplace_function<void()> callback) override {
+        inner->on_poll(interval_seconds, callback);
+    }
+
+    void on_closed(inplace_function<void()> callback) override {
+        user_closed_callback = callback;
+    }
+
+    void on_error(inplace_function<void(err_t)> callback) override {
+        user_error_callback = callback;
+    }
+
+    void on_sent(inplace_function<void()> callback) override {
+        inner->on_sent(callback);
+    }
+
+private:
+    tcp_base *inner;
+    circular_buffer<uint8_t, BUF_SIZE> buffer;
+    uint64_t last_record_us;
+    inplace_function<void(std::span<const uint8_t>)> sink;
+    inplace_function<void()> user_receive_callback, user_connected_callback, user_closed_callback;
+    inplace_function<void(err_t)> user_error_callback;
+
+    void record(capture::record_type type, std::span<const uint8_t> payload = {}, err_t reason = ERR_OK);
+    void pull();
+    void inner_recv_callback();
+    void inner_connected_callback();
+    void inner_closed_callback();
+    void inner_error_callback(err_t reason);
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "recording_transport.h"
+
+// tcp_base that plays back a trace written by recording_transport.
+// Received chunks are delivered with their original boundaries. A recorded
+// write holds back everything after it until the application has written as
+// many times, so responses never arrive before their requests.
+// Like loopback_transport, time is simulated and driven by advance(). With
+// paced set, records are released at their recorded offsets, otherwise as
+// fast as the application consumes them. The trace must outlive the transport.
+class replay_transport : public tcp_base {
+public:
+    replay_transport(std::span<const uint8_t> trace, bool paced = false, bool secure = false);
+
+    bool init() override;
+    int available() const override;
+    size_t read(std::span<uint8_t> out) override;
+    bool write(std::span<const uint8_t> data) override;
+    size_t writable() const override;
+    void flush() override;
+    bool connect(std::string host, uint16_t port) override;
+    err_t close(err_t reason) override;
+
+    bool connected() const override;
+    bool initialized() const override;
+    bool secure() const override {
+        return secure_;
+    }
+
+    // Advances the replay clock and releases every record that is due
+    void advance(uint32_t ms = 0);
+    // True once every record has been played back
+    bool finished() const;
+    // False if the trace header was missing, or a record was truncated or of an unknown type
+    bool valid() const {
+        return valid_;
+    }
+
+    void on_receive(inplace_function<void()> callback) override {
+        user_receive_callback = callback;
+    }
+
+    void on_connected(inplace_function<void()> callback) override {
+        user_connected_callback = callback;
+    }
+
+    void on_poll(uint8_t interval_seconds, inplace_function<void()> callback) override {
+        poll_interval_us = interval_seconds * 1000000ull;
+        next_poll_us = now_us + poll_interval_us;
+        user_poll_callback = callback;
+    }
+
+    void on_closed(inplace_function<void()> callback) override {
+        user_closed_callback = callback;
+    }
+
+    void on_error(inplace_function<void(err_t)> callback) override {
+        user_error_callback = callback;
+    }
+
+    // Writes are never held back, so there is nothing to report
+    void on_sent(inplace_function<void()>) override {}
+
+private:
+    struct record {
+        capture::record_type type;
+        uint64_t at_us;
+        std::span<const uint8_t> payload;
+        err_t reason;
+    };
+
+    std::span<const uint8_t> trace_data;
+    size_t position;
+    record pending;
+    bool has_pending, paced, valid_, secure_;
+    bool connect_requested, connected_, initialized_;
+    uint64_t now_us, offset_us, recorded_us, poll_interval_us, next_poll_us;
+    uint32_t writes_seen, writes_replayed;
+    circular_buffer<uint8_t, BUF_SIZE> buffer;
+    inplace_function<void()> user_receive_callback, user_connected_callback, user_poll_callback, user_closed_callback;
+    inplace_function<void(err_t)> user_error_callback;
+
+    bool decode_next();
+};
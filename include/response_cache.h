@@ -0,0 +1,95 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+class http_response;
+
+// Responses kept at once
+#ifndef HTTP_CACHE_ENTRIES
+#define HTTP_CACHE_ENTRIES 4
+#endif
+
+// Bodies larger than this are not cached
+#ifndef HTTP_CACHE_MAX_BODY
+#define HTTP_CACHE_MAX_BODY 4096
+#endif
+
+// Define HTTP_CACHE_FLASH_OFFSET to the offset of a flash region reserved for the
+// cache, HTTP_CACHE_ENTRIES * HTTP_CACHE_FLASH_SLOT_SIZE bytes long. Bodies then
+// live in flash rather than RAM and survive a reset once flush() has written
+// them. Writing flash stalls both cores, so core 1 must not run from flash
+// while flush() runs.
+#ifdef HTTP_CACHE_FLASH_OFFSET
+#include <hardware/flash.h>
+// Room for the body plus key and validators, in whole sectors
+#ifndef HTTP_CACHE_FLASH_SLOT_SIZE
+#define HTTP_CACHE_FLASH_SLOT_SIZE ((HTTP_CACHE_MAX_BODY + 512 + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1))
+#endif
+#endif
+
+// Remembers the validators and body of GET responses by url. http_client sends the
+// validators as If-None-Match / If-Modified-Since and turns a 304 Not Modified back
+// into the stored response, so polling an unchanged resource only moves headers.
+// Only 200 responses with an ETag or Last-Modified and no Cache-Control: no-store are
+// kept; the least recently used entry makes room for a new one. One cache may be
+// shared by several clients.
+class response_cache {
+public:
+    struct entry {
+        std::string key, etag, last_modified;
+        uint16_t status = 0;
+        std::span<const uint8_t> body() const;
+
+    private:
+        friend class response_cache;
+        uint32_t last_used = 0;
+#ifdef HTTP_CACHE_FLASH_OFFSET
+        // What flush() still has to do to the entry's flash slot
+        enum class flash_work : uint8_t {
+            none,
+            write,
+            erase
+        };
+        // Points into memory mapped flash once written, until then the body is in pending
+        const uint8_t *body_data = nullptr;
+        uint32_t body_length = 0;
+        std::string pending;
+        flash_work work = flash_work::none;
+#else
+        std::string body_data;
+#endif
+    };
+
+    // Picks up entries left in flash by an earlier run when there is a flash tier
+    response_cache();
+
+    // nullptr if nothing is stored for key
+    const entry *find(std::string_view key);
+    // Stores response if it is cacheable, otherwise drops anything stored for key.
+    // A response identical to the one stored only refreshes the entry
+    void store(std::string_view key, const http_response &response);
+    void remove(std::string_view key);
+    void clear();
+    size_t size() const;
+    // With a flash tier, writes the entries stored since the last call to flash
+    // and wipes the removed ones. store() runs inside lwIP's receive callback,
+    // too late to stall both cores for an erase, so until then bodies wait in
+    // RAM. Call it from the main loop rather than from a callback. Does nothing
+    // without a flash tier
+    void flush();
+
+private:
+    entry m_entries[HTTP_CACHE_ENTRIES];
+    uint32_t m_clock = 0;
+
+    entry *lookup(std::string_view key);
+    void release(entry &slot);
+#ifdef HTTP_CACHE_FLASH_OFFSET
+    void load();
+    bool persist(size_t slot);
+    void wipe(size_t slot);
+#endif
+};
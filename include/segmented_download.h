@@ -0,0 +1,135 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <pico/time.h>
+
+#include "http_client.h"
+#include "timer_wheel.h"
+#include "inplace_function.h"
+
+// Connections fetching segments at once
+#ifndef HTTP_SEGMENT_CONNECTIONS
+#define HTTP_SEGMENT_CONNECTIONS 3
+#endif
+
+// Bytes requested per Range request
+#ifndef HTTP_SEGMENT_SIZE
+#define HTTP_SEGMENT_SIZE 16384
+#endif
+
+// Failed requests, without any new data arriving, before the download gives up
+#ifndef HTTP_SEGMENT_RETRIES
+#define HTTP_SEGMENT_RETRIES 5
+#endif
+
+#ifndef HTTP_SEGMENT_RETRY_DELAY_MS
+#define HTTP_SEGMENT_RETRY_DELAY_MS 500
+#endif
+
+// Downloads one resource over several connections at once, each fetching the
+// next HTTP_SEGMENT_SIZE byte range, so the transfer is not capped by a single
+// TCP window per round trip. on_data still sees the bytes in order: the segment
+// at the front is passed straight through and the others are held until it is
+// done. Each connection holds at most one segment and the front one needs no
+// buffer, so HTTP_SEGMENT_CONNECTIONS - 1 buffers of HTTP_SEGMENT_SIZE bytes,
+// allocated the first time they are needed, hold everything waiting. A
+// connection that finished early waits for the front to catch up.
+//
+// The first segment doubles as a probe for the size. A server that ignores
+// Range gets the whole body on one connection; one that changes the resource
+// midway (ETag or size) stops the download with ERR_VAL.
+class segmented_download {
+public:
+    segmented_download(std::string url, std::span<uint8_t> cert = {});
+    // Connection index goes over what transports returns for it, and the
+    // download takes ownership of it, see http_client
+    segmented_download(std::string url, inplace_function<tcp_base*(uint8_t index)> transports, std::span<uint8_t> cert = {});
+    segmented_download(segmented_download&) = delete;
+    segmented_download(segmented_download&&) = delete;
+    ~segmented_download();
+
+    void start();
+    void cancel();
+
+    // Body bytes in order, data starts offset bytes into the resource
+    void on_data(inplace_function<void(uint32_t offset, std::span<const uint8_t> data)> callback) {
+        m_user_data_callback = callback;
+    }
+    void on_complete(inplace_function<void()> callback) {
+        m_user_complete_callback = callback;
+    }
+    void on_error(inplace_function<void(err_t)> callback) {
+        m_user_error_callback = callback;
+    }
+
+    // Applied to every connection, 0 disables the timeout
+    void set_timeout(uint32_t timeout_ms);
+
+    bool active() const {
+        return m_active;
+    }
+    // Bytes passed to on_data so far
+    uint32_t delivered() const {
+        return m_delivered;
+    }
+    // Size of the resource, -1 until the first response
+    int64_t total() const {
+        return m_total;
+    }
+    // Bytes received but held back until the segments before them are done
+    size_t buffered() const;
+    // Bytes passed to on_data per second since start(), across all connections
+    uint32_t throughput() const;
+
+private:
+    struct lane {
+        http_client *client = nullptr;
+        // One of m_buffers while received bytes of the segment cannot be passed on yet
+        std::vector<uint8_t> *buffer = nullptr;
+        // Inclusive byte range of the segment and how much of it has arrived
+        uint32_t first = 0, last = 0, received = 0;
+        // Time a failed request may be sent again
+        uint32_t retry_at_ms = 0;
+        bool busy = false, requested = false, validated = false, complete = false;
+    };
+
+    lane m_lanes[HTTP_SEGMENT_CONNECTIONS];
+    std::vector<uint8_t> m_buffers[HTTP_SEGMENT_CONNECTIONS > 1 ? HTTP_SEGMENT_CONNECTIONS - 1 : 1];
+    std::string m_url, m_target, m_etag;
+    std::span<uint8_t> m_cert;
+    uint32_t m_delivered = 0, m_next = 0, m_timeout_ms = 0, m_started_ms = 0;
+    int64_t m_total = -1;
+    uint8_t m_retries = 0;
+    bool m_active = false, m_single = false, m_failed = false;
+    err_t m_error = ERR_OK;
+    // Runs advance() when a retry is due. Work handed on from the connections'
+    // callbacks goes through m_alarm instead, so it does not wait for a tick
+    wheel_timer m_timer;
+    alarm_id_t m_alarm = 0;
+    inplace_function<tcp_base*(uint8_t)> m_transports;
+    inplace_function<void(uint32_t, std::span<const uint8_t>)> m_user_data_callback;
+    inplace_function<void()> m_user_complete_callback;
+    inplace_function<void(err_t)> m_user_error_callback;
+
+    void advance();
+    void assign(uint8_t index);
+    void request(uint8_t index);
+    bool validate(uint8_t index);
+    void deliver(std::span<const uint8_t> data);
+    bool hold(uint8_t index, std::span<const uint8_t> data);
+    void release(lane &l);
+    void retry(uint8_t index, err_t err);
+    void fail(err_t err);
+    void schedule(uint32_t delay_ms);
+
+    void body_callback(uint8_t index, std::span<const uint8_t> data);
+    void response_callback(uint8_t index);
+    void closed_callback(uint8_t index);
+    void error_callback(uint8_t index, err_t err);
+
+    static int64_t alarm_callback(alarm_id_t, void*);
+};
@@ -3,6 +3,8 @@
 #include "sio_socket.h"
 #include "eio_client.h"
 #include "http_client.h"
+#include "inplace_function.h"
+#include "timer_wheel.h"
 
 #include "nlohmann/json.hpp"
 
@@ -10,11 +12,6 @@
 #include <hardware/watchdog.h>
 
 #include <map>
-#include <functional>
-
-extern volatile int alarms_fired;
-
-int64_t alarm_callback(alarm_id_t id, void* user_data);
 
 class sio_client {
 public:
@@ -39,7 +36,7 @@ public:
     ~sio_client();
 
     void open();
-    void on_open(std::function<void()> callback);
+    void on_open(inplace_function<void()> callback);
 
     void connect(std::string ns = "/");
     void disconnect(std::string ns = "/");
@@ -58,13 +55,17 @@ private:
     eio_client *m_engine;
     http_client *m_http;
     std::map<std::string, sio_socket*> m_namespace_connections;
-    std::function<void()> m_user_open_callback;
+    inplace_function<void()> m_user_open_callback, m_saved_open_callback;
     std::string m_raw_url, m_query_string;
-    bool m_open = false;
+    bool m_open = false, m_reconnecting = false;
     client_state m_state = client_state::disconnected;
     absolute_time_t m_reconnect_time;
-    alarm_id_t m_watchdog_extender = 0;
+    // Keeps the watchdog fed for a few periods while connecting
+    wheel_timer m_watchdog_extender;
+    uint8_t m_extensions = 0;
 
+    void extend_watchdog();
+    void watchdog_extender_callback();
     void http_response_callback();
     void http_error_callback(err_t reason);
     void engine_recv_callback();
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <pico/time.h>
+
+#include "http_client.h"
+#include "timer_wheel.h"
+#include "inplace_function.h"
+
+// Wait before reconnecting until the server sets its own with retry:
+#ifndef SSE_RETRY_MS
+#define SSE_RETRY_MS 3000
+#endif
+
+// The wait doubles with every failure in a row, up to this or the server's retry: if that is longer
+#ifndef SSE_MAX_RETRY_MS
+#define SSE_MAX_RETRY_MS 60000
+#endif
+
+// Largest line and largest event data accepted. An event with more is dropped
+#ifndef SSE_MAX_EVENT_SIZE
+#define SSE_MAX_EVENT_SIZE 4096
+#endif
+
+// Receives Server-Sent Events (text/event-stream) over one long streamed GET,
+// a much lighter way to get server push than sio_client. Events are parsed as
+// the body arrives, so only the event being read is held in memory. When the
+// stream ends or drops, the client reconnects after the server's retry: time,
+// backing off while it keeps failing, and sends the last id: it saw as
+// Last-Event-ID so the server can carry on from there.
+//
+// 204 No Content stops the client for good, as does any status other than 200
+// below 500 or a Content-Type other than text/event-stream.
+class sse_client {
+public:
+    sse_client(std::string url, std::span<uint8_t> cert = {});
+    // Takes ownership of transport, see http_client
+    sse_client(std::string url, tcp_base *transport, std::span<uint8_t> cert = {});
+    sse_client(sse_client&) = delete;
+    sse_client(sse_client&&) = delete;
+    ~sse_client();
+
+    // last_event_id can come from an earlier run to pick up where it stopped
+    void start(std::string last_event_id = "");
+    // Safe to call from inside the callbacks
+    void stop();
+
+    // Sent with every request, e.g. Authorization
+    void header(std::string key, std::string value);
+
+    // type is "message" unless the event named one, data is its data lines
+    // joined with '\n'. Both are only valid inside the callback
+    void on_event(inplace_function<void(std::string_view type, std::string_view data, std::string_view id)> callback) {
+        m_user_event_callback = callback;
+    }
+    // The server accepted the stream, again after every reconnect. Fires with the first bytes it sends
+    void on_open(inplace_function<void()> callback) {
+        m_user_open_callback = callback;
+    }
+    // The stream could not be opened or dropped. The client reconnects by itself while active()
+    void on_error(inplace_function<void(err_t)> callback) {
+        m_user_error_callback = callback;
+    }
+
+    // Drops and reopens a stream that sent nothing, not even a comment, for this long. 0 disables it
+    void set_idle_timeout(uint32_t timeout_ms);
+
+    bool active() const {
+        return m_active;
+    }
+    bool open() const {
+        return m_open;
+    }
+    const std::string &last_event_id() const {
+        return m_last_event_id;
+    }
+    uint32_t retry_ms() const {
+        return m_retry_ms;
+    }
+
+private:
+    http_client m_client;
+    std::string m_url, m_target;
+    std::vector<std::pair<std::string, std::string>> m_headers;
+    // Event being assembled, the line being read and the id the next event dispatches with
+    std::string m_type, m_data, m_line, m_id_buffer, m_last_event_id;
+    uint32_t m_retry_ms = SSE_RETRY_MS, m_idle_timeout_ms = 0, m_received = 0, m_watched = 0;
+    uint8_t m_failures = 0;
+    bool m_active = false, m_open = false, m_validated = false, m_interrupted = false, m_reconnect = false;
+    // A CR ended the last piece, so an LF starting the next one belongs to it
+    bool m_last_cr = false;
+    bool m_first_line = true, m_discard = false;
+    err_t m_error = ERR_OK;
+    // m_timer runs whatever was scheduled next, m_watchdog checks for a stall every m_idle_timeout_ms
+    wheel_timer m_timer, m_watchdog;
+    inplace_function<void(std::string_view, std::string_view, std::string_view)> m_user_event_callback;
+    inplace_function<void()> m_user_open_callback;
+    inplace_function<void(err_t)> m_user_error_callback;
+
+    void init();
+    void connect();
+    bool validate();
+    void parse(std::string_view text);
+    void end_line();
+    void process_line(std::string_view line);
+    void dispatch_event();
+    void interrupt(err_t err, bool reconnect);
+    void reconnect(err_t err);
+    void finish(err_t err);
+    void schedule(uint32_t delay_ms);
+    void watch();
+
+    void body_callback(std::span<const uint8_t> data);
+    void response_callback();
+    void closed_callback();
+    void error_callback(err_t err);
+
+    void timer_callback();
+    void watchdog_callback();
+};
@@ -1,13 +1,14 @@
 #pragma once
 
 #include <string>
-#include <functional>
 #include <span>
 #include <cstdint>
 
 #include "lwip/err.h"
 #include "lwip/pbuf.h"
 
+#include "inplace_function.h"
+
 #define BUF_SIZE 2048
 #define POLL_TIME_S 2
 
@@ -15,10 +16,14 @@ std::string tcp_perror(err_t);
 
 class tcp_base {
 public:
+    virtual ~tcp_base() = default;
+
     virtual bool init() = 0;
     virtual int available() const = 0;
     virtual size_t read(std::span<uint8_t> out) = 0;
     virtual bool write(std::span<const uint8_t> data) = 0;
+    // Bytes write() can take right now. It grows again as on_sent fires
+    virtual size_t writable() const = 0;
     virtual void flush() = 0;
     virtual bool connect(std::string host, uint16_t port) = 0;
     virtual err_t close(err_t reason) = 0;
@@ -27,9 +32,11 @@ public:
     virtual bool initialized() const = 0;
     virtual bool secure() const = 0;
 
-    virtual void on_receive(std::function<void()> callback) = 0;
-    virtual void on_connected(std::function<void()> callback) = 0;
-    virtual void on_poll(uint8_t interval_seconds, std::function<void()> callback) = 0;
-    virtual void on_closed(std::function<void()> callback) = 0;
-    virtual void on_error(std::function<void(err_t)> callback) = 0;
+    virtual void on_receive(inplace_function<void()> callback) = 0;
+    virtual void on_connected(inplace_function<void()> callback) = 0;
+    virtual void on_poll(uint8_t interval_seconds, inplace_function<void()> callback) = 0;
+    virtual void on_closed(inplace_function<void()> callback) = 0;
+    virtual void on_error(inplace_function<void(err_t)> callback) = 0;
+    // Called when the peer acknowledged data, freeing send buffer space
+    virtual void on_sent(inplace_function<void()> callback) = 0;
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "tcp_base.h"
 #include "circular_buffer.h"
+#include "happy_eyeballs.h"
 #include "logger.h"
 
 #include "lwip/altcp_tcp.h"
@@ -9,7 +10,7 @@
 
 static struct altcp_tls_config *tls_config = nullptr;
 
-class tcp_tls_client : public tcp_base {
+class tcp_tls_client final : public tcp_base {
 public:
     tcp_tls_client(std::span<uint8_t> cert = {});
     ~tcp_tls_client();
@@ -17,6 +18,7 @@ public:
     int available() const override;
     size_t read(std::span<uint8_t> out) override;
     bool write(std::span<const uint8_t> data) override;
+    size_t writable() const override;
     void flush() override;
     bool connect(std::string host, uint16_t port) override;
     err_t close(err_t reason) override;
@@ -27,48 +29,57 @@ public:
         return true;
     }
 
-    void on_receive(std::function<void()> callback) override {
+    void on_receive(inplace_function<void()> callback) override {
         user_receive_callback = callback;
     }
 
-    void on_connected(std::function<void()> callback) override {
+    void on_connected(inplace_function<void()> callback) override {
         user_connected_callback = callback;
     }
 
-    void on_poll(uint8_t interval_seconds, std::function<void()> callback) {
+    void on_poll(uint8_t interval_seconds, inplace_function<void()> callback) {
         altcp_poll(tcp_controlblock, poll_callback, interval_seconds * 2);
         user_poll_callback = callback;
     }
 
-    void on_closed(std::function<void()> callback) override {
+    void on_closed(inplace_function<void()> callback) override {
         user_closed_callback = callback;
     }
 
-    void on_error(std::function<void(err_t)> callback) override {
+    void on_error(inplace_function<void(err_t)> callback) override {
         user_error_callback = callback;
     }
 
+    void on_sent(inplace_function<void()> callback) override {
+        user_sent_callback = callback;
+    }
+
     void clear_pcb() {
         tcp_controlblock = nullptr;
     }
 
 private:
-    altcp_pcb *tcp_controlblock;
+    altcp_pcb *tcp_controlblock, *race_controlblock;
     ip_addr_t remote_addr;
     circular_buffer<uint8_t, BUF_SIZE> buffer;
     int buffer_len;
     int sent_len;
     bool connected_, initialized_;
     uint16_t port_;
-    std::function<void()> user_receive_callback, user_connected_callback, user_poll_callback, user_closed_callback;
-    std::function<void(err_t)> user_error_callback;
+    inplace_function<void()> user_receive_callback, user_connected_callback, user_poll_callback, user_closed_callback, user_sent_callback;
+    inplace_function<void(err_t)> user_error_callback;
+    happy_eyeballs eyeballs;
+    std::string hostname_;
 
     bool connect();
-    static void dns_callback(const char* name, const ip_addr_t *addr, void* arg);
+    bool start_attempt(uint8_t slot, const ip_addr_t &addr);
+    void attempt_won(altcp_pcb *pcb);
     static err_t connected_callback(void* arg, altcp_pcb* pcb, err_t err);
     static err_t recv_callback(void* arg, altcp_pcb* pcb, pbuf* p, err_t err);
     static err_t poll_callback(void* arg, altcp_pcb* pcb);
     static err_t sent_callback(void* arg, altcp_pcb* pcb, uint16_t len);
     //static void tcp_perror(err_t err);
     static void err_callback(void* arg, err_t err);
+    static void race_err_callback(void* arg, err_t err);
+    static err_t race_connected_callback(void* arg, altcp_pcb* pcb, err_t err);
 };
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <pico/time.h>
+
+#include "inplace_function.h"
+
+// Resolution of every timer on the wheel. A timer fires up to one tick late, never early
+#ifndef TIMER_WHEEL_TICK_MS
+#define TIMER_WHEEL_TICK_MS 10
+#endif
+
+class timer_wheel;
+
+// A deadline on the shared timer_wheel. Starting and cancelling it are O(1)
+// and need no hardware alarm of its own, so an object can keep one armed for
+// as long as it lives. The callback runs from the wheel's alarm, the same
+// context an add_alarm_in_ms callback runs in. Destroying an armed timer
+// cancels it.
+class wheel_timer {
+public:
+    wheel_timer();
+    wheel_timer(inplace_function<void()> callback);
+    // The moved to timer takes the callback but is not armed
+    wheel_timer(wheel_timer &&other);
+    wheel_timer &operator=(wheel_timer &&other);
+    wheel_timer(const wheel_timer&) = delete;
+    wheel_timer &operator=(const wheel_timer&) = delete;
+    ~wheel_timer();
+
+    void on_expire(inplace_function<void()> callback) {
+        m_callback = callback;
+    }
+
+    // Fires the callback once, delay_ms from now. Starting an armed timer moves its deadline
+    void start(uint32_t delay_ms);
+    void cancel();
+
+    bool armed() const {
+        return m_pprev != nullptr;
+    }
+
+private:
+    friend class timer_wheel;
+
+    // Neighbours in the slot the timer sits in; m_pprev is nullptr while not armed
+    wheel_timer *m_next = nullptr, **m_pprev = nullptr;
+    uint32_t m_expires = 0;
+    uint16_t m_slot = 0;
+    inplace_function<void()> m_callback;
+};
+
+// Hierarchical timing wheel the library's timeouts run on, keyed on the
+// monotonic time since boot. Each of its levels has 64 slots, the first one
+// tick wide, the next 64 ticks and so on. A timer goes in the slot its
+// deadline falls in on the lowest level that reaches that far, and the timers
+// of a higher slot are spread over the level below when the wheel gets to it,
+// so neither starting nor cancelling a timer searches anything. One hardware
+// alarm drives the whole wheel. It is set for the next tick that has work
+// rather than every tick, and released while no timer is armed.
+class timer_wheel {
+public:
+    timer_wheel();
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel &operator=(const timer_wheel&) = delete;
+    ~timer_wheel();
+
+    // The wheel every wheel_timer is on
+    static timer_wheel &shared();
+
+    // Timers armed
+    size_t pending() const {
+        return m_pending;
+    }
+
+private:
+    friend class wheel_timer;
+
+    static constexpr uint8_t slot_bits = 6, levels = 4;
+    static constexpr uint16_t slots = 1 << slot_bits;
+    // m_slot of a timer that is in no slot, such as one about to fire
+    static constexpr uint16_t detached = levels * slots;
+
+    wheel_timer *m_slots[levels * slots] = {};
+    // Bit s of m_occupied[l] is set while slot s of level l holds a timer
+    uint64_t m_occupied[levels] = {};
+    // Last tick the wheel got to, and the one its alarm is set for
+    uint32_t m_tick, m_alarm_tick = 0;
+    size_t m_pending = 0;
+    alarm_id_t m_alarm = 0;
+    // Expired timers are running, the alarm is set again once they are done
+    bool m_running = false;
+
+    void start(wheel_timer &timer, uint32_t delay_ms);
+    void cancel(wheel_timer &timer);
+    void place(wheel_timer &timer);
+    void unlink(wheel_timer &timer);
+    void cascade(uint8_t level);
+    void run(uint32_t tick);
+    bool next_event(uint32_t &tick) const;
+    void arm();
+
+    static uint32_t current_tick();
+    static int64_t delay_us(uint32_t tick);
+    static int64_t alarm_callback(alarm_id_t, void*);
+};
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <string>
-#include <functional>
 #include <span>
 #include <cstdint>
 
@@ -9,6 +8,7 @@
 #include "lwip/ip_addr.h"
 
 #include "circular_buffer.h"
+#include "inplace_function.h"
 
 #define BUF_SIZE 2048
 #define POLL_TIME_S 2
@@ -28,8 +28,8 @@ public:
     bool connected() const;
     ip_addr_t remote_address() const;
 
-    void on_receive(std::function<void(const ip_addr_t *, uint16_t)> callback);
-    void on_connect(std::function<void()> callback);
+    void on_receive(inplace_function<void(const ip_addr_t *, uint16_t)> callback);
+    void on_connect(inplace_function<void()> callback);
 private:
     struct udp_pcb *udp_controlblock;
     ip_addr_t remote_addr;
@@ -37,8 +37,8 @@ private:
     circular_buffer<uint8_t, BUF_SIZE> buffer;
     int buffer_len, sent_len;
     bool initialized_, connected_;
-    std::function<void(const ip_addr_t*, uint16_t)> user_receive_callback;
-    std::function<void()> user_connected_callback;
+    inplace_function<void(const ip_addr_t*, uint16_t)> user_receive_callback;
+    inplace_function<void()> user_connected_callback;
 
     bool connect();
     static void dns_callback(const char* name, const ip_addr_t *addr, void* arg);
@@ -4,9 +4,9 @@
 #include <cstdint>
 #include <vector>
 #include <cstring>
-#include <functional>
 
 #include "circular_buffer.h"
+#include "inplace_function.h"
 #include "tcp_base.h"
 #include "logger.h"
 class eio_client;
@@ -30,11 +30,15 @@ namespace ws {
         pong
     };
 
-    class websocket {
+    // Transport works like basic_http_client's: tcp_base (the websocket alias)
+    // dispatches at runtime, a concrete transport makes the frame I/O direct.
+    // Instantiated in websocket.cpp for tcp_base, tcp_client and tcp_tls_client.
+    template <class Transport = tcp_base>
+    class basic_websocket {
     public:
         friend class ::eio_client;
-        websocket(tcp_base *socket);
-        ~websocket();
+        basic_websocket(Transport *socket);
+        ~basic_websocket();
 
         // Needs up to 14 add'l bytes to encode packet
         bool write_text(std::span<uint8_t> data);
@@ -47,15 +51,15 @@ namespace ws {
 
         bool connected();
 
-        void on_receive(std::function<void()> callback);
-        void on_poll(uint8_t interval_seconds, std::function<void()> callback);
-        void on_closed(std::function<void()> callback);
-        void on_error(std::function<void(err_t)> callback);
+        void on_receive(inplace_function<void()> callback);
+        void on_poll(uint8_t interval_seconds, inplace_function<void()> callback);
+        void on_closed(inplace_function<void()> callback);
+        void on_error(inplace_function<void(err_t)> callback);
 
     private:
-        tcp_base *tcp;
-        std::function<void()> user_receive_callback, user_poll_callback, user_close_callback;
-        std::function<void(err_t)> user_error_callback;
+        Transport *tcp;
+        inplace_function<void()> user_receive_callback, user_poll_callback, user_close_callback;
+        inplace_function<void(err_t)> user_error_callback;
         uint32_t packet_size;
 
         void mask(std::span<uint8_t> data, uint32_t masking_key);
@@ -65,4 +69,6 @@ namespace ws {
         void tcp_error_callback(err_t reason);
         bool write_frame(std::span<uint8_t> data, opcodes opcode);
     };
+
+    using websocket = basic_websocket<tcp_base>;
 }
\ No newline at end of file
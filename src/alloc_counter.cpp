@@ -0,0 +1,126 @@
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+static volatile size_t allocation_count = 0, deallocation_count = 0, allocated_bytes = 0;
+
+size_t alloc_counter::allocations() {
+    return allocation_count;
+}
+
+size_t alloc_counter::deallocations() {
+    return deallocation_count;
+}
+
+size_t alloc_counter::bytes_allocated() {
+    return allocated_bytes;
+}
+
+void alloc_counter::reset() {
+    allocation_count = 0;
+    deallocation_count = 0;
+    allocated_bytes = 0;
+}
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+static void count_allocation(size_t size) {
+    allocation_count = allocation_count + 1;
+    allocated_bytes = allocated_bytes + size;
+}
+
+static void count_deallocation(void *ptr) {
+    if(ptr) {
+        deallocation_count = deallocation_count + 1;
+    }
+}
+
+extern "C" {
+#if PICO_ON_DEVICE
+// pico_malloc already wraps malloc and friends, so newlib is hooked one level
+// down, linked with --wrap=_malloc_r,--wrap=_calloc_r,--wrap=_realloc_r,--wrap=_free_r
+struct _reent;
+void *__real__malloc_r(struct _reent *reent, size_t size);
+void *__real__calloc_r(struct _reent *reent, size_t count, size_t size);
+void *__real__realloc_r(struct _reent *reent, void *ptr, size_t size);
+void __real__free_r(struct _reent *reent, void *ptr);
+
+void *__wrap__malloc_r(struct _reent *reent, size_t size) {
+    count_allocation(size);
+    return __real__malloc_r(reent, size);
+}
+
+void *__wrap__calloc_r(struct _reent *reent, size_t count, size_t size) {
+    count_allocation(count * size);
+    return __real__calloc_r(reent, count, size);
+}
+
+void *__wrap__realloc_r(struct _reent *reent, void *ptr, size_t size) {
+    count_deallocation(ptr);
+    count_allocation(size);
+    return __real__realloc_r(reent, ptr, size);
+}
+
+void __wrap__free_r(struct _reent *reent, void *ptr) {
+    count_deallocation(ptr);
+    __real__free_r(reent, ptr);
+}
+#else
+// Linked with --wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+    count_allocation(size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    count_allocation(count * size);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    count_deallocation(ptr);
+    count_allocation(size);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+    count_deallocation(ptr);
+    __real_free(ptr);
+}
+#endif
+}
+
+// Counted by the malloc and free they call
+void* operator new(size_t size) {
+    void* ptr = malloc(size ? size : 1);
+    if(ptr == nullptr) {
+        abort();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+#endif
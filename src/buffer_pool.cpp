@@ -0,0 +1,80 @@
+#include "buffer_pool.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+#include "logger.h"
+
+buffer_pool::buffer_pool() {
+#ifdef HTTP_STATIC_SIZE
+    for(buffer_block &block : m_blocks) {
+        block.next = m_free;
+        m_free = &block;
+    }
+    m_idle = HTTP_BUFFER_POOL_BLOCKS;
+#endif
+}
+
+buffer_pool::~buffer_pool() {
+#ifndef HTTP_STATIC_SIZE
+    while(m_free) {
+        buffer_block *next = m_free->next;
+        free(m_free);
+        m_free = next;
+    }
+#endif
+}
+
+buffer_pool &buffer_pool::shared() {
+    static buffer_pool pool;
+    return pool;
+}
+
+buffer_block *buffer_pool::acquire() {
+    buffer_block *block = m_free;
+    if(block) {
+        m_free = block->next;
+        m_idle--;
+    } else {
+#ifdef HTTP_STATIC_SIZE
+        error("buffer_pool: all %d blocks in use\n", HTTP_BUFFER_POOL_BLOCKS);
+        return nullptr;
+#else
+        block = (buffer_block*)malloc(sizeof(buffer_block));
+        if(block == nullptr) {
+            error("buffer_pool: could not allocate a block with %d in use\n", m_in_use);
+            return nullptr;
+        }
+#endif
+    }
+    block->next = nullptr;
+    block->used = 0;
+    m_in_use++;
+    m_peak = std::max(m_peak, m_in_use);
+    return block;
+}
+
+void buffer_pool::release(buffer_block *chain) {
+    while(chain) {
+        buffer_block *next = chain->next;
+        chain->next = m_free;
+        m_free = chain;
+        m_in_use--;
+        m_idle++;
+        chain = next;
+    }
+}
+
+void buffer_pool::settle() {
+    uint16_t decay = (m_high_water + (1 << HTTP_BUFFER_POOL_DECAY_SHIFT) - 1) >> HTTP_BUFFER_POOL_DECAY_SHIFT;
+    m_high_water = std::max(m_peak, (uint16_t)(m_high_water - decay));
+    m_peak = m_in_use;
+#ifndef HTTP_STATIC_SIZE
+    while(m_free && m_in_use + m_idle > m_high_water) {
+        buffer_block *next = m_free->next;
+        free(m_free);
+        m_free = next;
+        m_idle--;
+    }
+#endif
+}
@@ -63,7 +63,7 @@ private:
     size_t m_capacity, m_size;
 };
 
-eio_client::eio_client(ws::websocket *socket): m_socket(socket), m_ping_milliseconds(0), m_open(false), m_refresh_watchdog(false) {
+eio_client::eio_client(ws::websocket *socket): m_socket(socket), m_ping_timer(std::bind(&eio_client::ping_timeout_callback, this)), m_open(false), m_refresh_watchdog(false) {
     trace1("eio_client (ctor)\n");
     m_socket->on_receive(std::bind(&eio_client::ws_recv_callback, this));
     m_socket->on_poll(1, std::bind(&eio_client::ws_poll_callback, this));
@@ -71,7 +71,7 @@ eio_client::eio_client(ws::websocket *socket): m_socket(socket), m_ping_millisec
     m_socket->on_error(std::bind(&eio_client::ws_error_callback, this, std::placeholders::_1));
 }
 
-eio_client::eio_client(tcp_base *socket): m_ping_milliseconds(0), m_open(false), m_refresh_watchdog(false) {
+eio_client::eio_client(tcp_base *socket): m_ping_timer(std::bind(&eio_client::ping_timeout_callback, this)), m_open(false), m_refresh_watchdog(false) {
     trace1("eio_client (ctor)\n");
     m_socket = new ws::websocket(socket);
     m_socket->on_receive(std::bind(&eio_client::ws_recv_callback, this));
@@ -100,19 +100,19 @@ uint32_t eio_client::packet_size() const {
     return m_socket->received_packet_size() - 1;
 }
 
-void eio_client::on_receive(std::function<void()> callback) {
+void eio_client::on_receive(inplace_function<void()> callback) {
     m_user_receive_callback = callback;
 }
 
-void eio_client::on_closed(std::function<void()> callback) {
+void eio_client::on_closed(inplace_function<void()> callback) {
     m_user_close_callback = callback;
 }
 
-void eio_client::on_error(std::function<void(err_t)> callback) {
+void eio_client::on_error(inplace_function<void(err_t)> callback) {
     m_user_error_callback = callback;
 }
 
-void eio_client::on_open(std::function<void()> callback) {
+void eio_client::on_open(inplace_function<void()> callback) {
     m_user_open_callback = callback;
 }
 
@@ -143,6 +143,7 @@ void eio_client::ws_recv_callback() {
         m_ping_timeout = body["pingTimeout"];
         info("EIO Open:\n    sid=%s\n    pingInterval=%d\n    pingTimeout=%d\n", m_sid.c_str(), m_ping_interval, m_ping_timeout);
         m_open = true;
+        m_ping_timer.start(m_ping_interval + m_ping_timeout);
         m_user_open_callback();
         free(packet);
         break;
@@ -151,12 +152,13 @@ void eio_client::ws_recv_callback() {
     case packet_type::close:
         debug1("EIO Close\n");
         m_open = false;
+        m_ping_timer.cancel();
         m_socket->close(ERR_CLSD);
         break;
 
     case packet_type::ping:{
         debug1("EIO Ping\n");
-        m_ping_milliseconds = 0;
+        m_ping_timer.start(m_ping_interval + m_ping_timeout);
         eio_packet response;
         response += (char)packet_type::pong;
         m_socket->write_text(response.span());
@@ -180,19 +182,20 @@ void eio_client::ws_poll_callback() {
         watchdog_update();
         trace1("refreshed watchdog\n");
     }
-    if(m_open) {
-        m_ping_milliseconds += 1000;
-        if(m_ping_milliseconds > m_ping_interval + m_ping_timeout) {
-            m_open = false;
-            m_socket->close(ERR_TIMEOUT);
-        }
-    }
+}
+
+void eio_client::ping_timeout_callback() {
+    warn("EIO no ping for %d ms\n", m_ping_interval + m_ping_timeout);
+    m_open = false;
+    m_socket->close(ERR_TIMEOUT);
 }
 
 void eio_client::ws_close_callback() {
+    m_ping_timer.cancel();
     m_user_close_callback();
 }
 
 void eio_client::ws_error_callback(err_t reason) {
+    m_ping_timer.cancel();
     m_user_error_callback(reason);
 }
\ No newline at end of file
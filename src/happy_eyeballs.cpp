@@ -0,0 +1,209 @@
+#include "happy_eyeballs.h"
+
+#include "lwip/dns.h"
+
+#include "logger.h"
+
+happy_eyeballs::happy_eyeballs()
+    : m_candidates{}
+    , m_count(0)
+    , m_started(0)
+    , m_failed(0)
+    , m_v6_pending(false)
+    , m_v4_pending(false)
+    , m_done(true)
+    , m_resolving(false)
+    , m_last_error(ERR_OK)
+    , m_delay_timer(std::bind(&happy_eyeballs::start_next, this))
+    , m_last_attempt(nil_time)
+    , m_attempt_callback([](uint8_t, const ip_addr_t&){ return false; })
+    , m_failed_callback([](err_t){})
+{}
+
+happy_eyeballs::~happy_eyeballs() {
+    reset();
+}
+
+err_t happy_eyeballs::resolve(std::string host) {
+    reset();
+    m_count = 0;
+    m_started = 0;
+    m_failed = 0;
+    m_last_error = ERR_OK;
+    m_done = false;
+    m_resolving = true;
+
+    ip_addr_t addr;
+    if(ipaddr_aton(host.c_str(), &addr)) {
+        debug("happy_eyeballs::resolve: %s is an address literal\n", host.c_str());
+        add_candidate(addr);
+    } else {
+        err_t err;
+#if LWIP_IPV6
+        m_v6_pending = true;
+        err = dns_gethostbyname_addrtype(host.c_str(), &addr, dns_callback_v6, this, LWIP_DNS_ADDRTYPE_IPV6);
+        if(err == ERR_OK) {
+            m_v6_pending = false;
+            add_candidate(addr);
+        } else if(err != ERR_INPROGRESS) {
+            debug("happy_eyeballs::resolve: AAAA lookup failed with %d\n", err);
+            m_v6_pending = false;
+            m_last_error = err;
+        }
+#endif
+        m_v4_pending = true;
+        err = dns_gethostbyname_addrtype(host.c_str(), &addr, dns_callback_v4, this, LWIP_DNS_ADDRTYPE_IPV4);
+        if(err == ERR_OK) {
+            m_v4_pending = false;
+            add_candidate(addr);
+        } else if(err != ERR_INPROGRESS) {
+            debug("happy_eyeballs::resolve: A lookup failed with %d\n", err);
+            m_v4_pending = false;
+            m_last_error = err;
+        }
+    }
+    check_exhausted();
+    m_resolving = false;
+
+    if(m_done) {
+        return m_last_error != ERR_OK ? m_last_error : (err_t)ERR_RTE;
+    }
+    return m_started > m_failed ? ERR_OK : ERR_INPROGRESS;
+}
+
+void happy_eyeballs::attempt_failed([[maybe_unused]] uint8_t slot, err_t reason) {
+    if(m_done) {
+        return;
+    }
+    debug("happy_eyeballs: attempt %d to %s failed\n", slot, ipaddr_ntoa(&m_candidates[slot]));
+    m_failed++;
+    m_last_error = reason;
+    if(m_started < m_count) {
+        // No reason to wait out the stagger once the previous attempt is gone
+        schedule(0);
+        return;
+    }
+    check_exhausted();
+}
+
+void happy_eyeballs::reset() {
+    m_delay_timer.cancel();
+    m_done = true;
+}
+
+void happy_eyeballs::add_candidate(const ip_addr_t &addr) {
+    if(m_done || m_count >= HE_MAX_ATTEMPTS) {
+        return;
+    }
+    uint8_t index = m_count++;
+    if(IP_IS_V6(&addr)) {
+        // IPv6 goes ahead of any IPv4 candidate that has not been attempted yet
+        for(; index > m_started; index--) {
+            m_candidates[index] = m_candidates[index - 1];
+        }
+    }
+    m_candidates[index] = addr;
+
+    if(m_delay_timer.armed()) {
+        if(m_started == 0 && IP_IS_V6(&addr)) {
+            // The resolution delay was waiting for exactly this
+            schedule(0);
+        }
+        return;
+    }
+
+    if(m_started == m_failed) {
+        if(m_started == 0 && !IP_IS_V6(&addr) && m_v6_pending) {
+            schedule(HE_RESOLUTION_DELAY_MS);
+        } else {
+            start_next();
+        }
+        return;
+    }
+
+    // An attempt is in flight, so stagger from when it was started
+    int64_t elapsed_ms = absolute_time_diff_us(m_last_attempt, get_absolute_time()) / 1000;
+    schedule(elapsed_ms >= HE_CONNECTION_ATTEMPT_DELAY_MS ? 0 : HE_CONNECTION_ATTEMPT_DELAY_MS - elapsed_ms);
+}
+
+void happy_eyeballs::lookup_failed() {
+    if(m_last_error == ERR_OK) {
+        m_last_error = ERR_RTE;
+    }
+    if(m_delay_timer.armed() && m_started == 0) {
+        schedule(0);
+        return;
+    }
+    check_exhausted();
+}
+
+void happy_eyeballs::schedule(uint32_t delay_ms) {
+    m_delay_timer.cancel();
+    if(delay_ms == 0) {
+        start_next();
+        return;
+    }
+    m_delay_timer.start(delay_ms);
+}
+
+void happy_eyeballs::start_next() {
+    while(m_started < m_count) {
+        uint8_t slot = m_started++;
+        m_last_attempt = get_absolute_time();
+        info("happy_eyeballs: attempt %d to %s\n", slot, ipaddr_ntoa(&m_candidates[slot]));
+        if(m_attempt_callback(slot, m_candidates[slot])) {
+            if(m_started < m_count) {
+                schedule(HE_CONNECTION_ATTEMPT_DELAY_MS);
+            }
+            return;
+        }
+        m_failed++;
+        if(m_last_error == ERR_OK) {
+            m_last_error = ERR_RTE;
+        }
+    }
+    check_exhausted();
+}
+
+void happy_eyeballs::check_exhausted() {
+    if(m_done || m_started > m_failed || m_started < m_count || m_v6_pending || m_v4_pending) {
+        return;
+    }
+    reset();
+    if(m_resolving) {
+        // resolve() reports the error to its caller directly
+        return;
+    }
+    error("happy_eyeballs: all connection attempts failed (%d candidates)\n", m_count);
+    m_failed_callback(m_last_error != ERR_OK ? m_last_error : (err_t)ERR_RTE);
+}
+
+void happy_eyeballs::dns_callback_v4([[maybe_unused]] const char* name, const ip_addr_t *addr, void* arg) {
+    happy_eyeballs *eyeballs = (happy_eyeballs*)arg;
+    eyeballs->m_v4_pending = false;
+    if(eyeballs->m_done) {
+        return;
+    }
+    if(addr == nullptr) {
+        debug("happy_eyeballs: no A record for %s\n", name);
+        eyeballs->lookup_failed();
+        return;
+    }
+    info("ip of %s found: %s\n", name, ipaddr_ntoa(addr));
+    eyeballs->add_candidate(*addr);
+}
+
+void happy_eyeballs::dns_callback_v6([[maybe_unused]] const char* name, const ip_addr_t *addr, void* arg) {
+    happy_eyeballs *eyeballs = (happy_eyeballs*)arg;
+    eyeballs->m_v6_pending = false;
+    if(eyeballs->m_done) {
+        return;
+    }
+    if(addr == nullptr) {
+        debug("happy_eyeballs: no AAAA record for %s\n", name);
+        eyeballs->lookup_failed();
+        return;
+    }
+    info("ip of %s found: %s\n", name, ipaddr_ntoa(addr));
+    eyeballs->add_candidate(*addr);
+}
@@ -1,10 +1,77 @@
 #include "http_client.h"
 
+#include <charconv>
+#include <string.h>
+#include <type_traits>
+
 #include "logger.h"
 #include "tcp_client.h"
 #include "tcp_tls_client.h"
+#include "iequals.h"
+
+// Requests that can safely be sent again if their response never arrived
+static bool idempotent_method(std::string_view method) {
+    return method == "GET" || method == "HEAD" || method == "OPTIONS" || method == "PUT" || method == "DELETE" || method == "TRACE";
+}
+
+// True if the comma separated header value list contains token
+static bool has_token(std::string_view list, std::string_view token) {
+    while(!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        while(!item.empty() && item.front() == ' ') {
+            item.remove_prefix(1);
+        }
+        while(!item.empty() && item.back() == ' ') {
+            item.remove_suffix(1);
+        }
+        if(iequals(item, token)) {
+            return true;
+        }
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+    }
+    return false;
+}
+
+static bool redirect_status(uint16_t status) {
+    return status == 301 || status == 302 || status == 303 || status == 307 || status == 308;
+}
+
+// scheme://host:port with the port spelled out, so a default and an explicit port compare equal
+static std::string origin_of(const LUrlParser::ParseURL &url) {
+    int port = -1;
+    if(url.port_.size() > 0) {
+        url.getPort(&port);
+    }
+    if(port == -1) {
+        port = url.scheme_ == "https" || url.scheme_ == "wss" ? 443 : 80;
+    }
+    return url.scheme_ + "://" + url.host_ + ":" + std::to_string(port);
+}
 
-http_client::http_client(std::string url, std::span<uint8_t> cert)
+// Location may be an absolute url, scheme relative, an absolute path or a path relative to target
+static std::string resolve_location(const LUrlParser::ParseURL &base, std::string_view target, std::string_view location) {
+    location = location.substr(0, location.find('#'));
+    size_t scheme_end = location.find("://");
+    if(scheme_end != std::string_view::npos && location.find('/') > scheme_end) {
+        return std::string(location);
+    }
+    if(location.starts_with("//")) {
+        return base.scheme_ + ":" + std::string(location);
+    }
+    std::string origin = base.scheme_ + "://" + base.host_;
+    if(base.port_.size() > 0) {
+        origin += ":" + base.port_;
+    }
+    if(location.starts_with("/")) {
+        return origin + std::string(location);
+    }
+    std::string_view path = target.substr(0, target.find('?'));
+    return origin + std::string(path.substr(0, path.rfind('/') + 1)) + std::string(location);
+}
+
+template <class Transport>
+basic_http_client<Transport>::basic_http_client(std::string url, std::span<uint8_t> cert)
     : m_host("")
     , m_url(url)
     , m_port(-1)
@@ -13,19 +80,40 @@ http_client::http_client(std::string url, std::span<uint8_t> cert)
     , m_user_response_callback([](){})
     , m_user_closed_callback([](){})
     , m_user_error_callback([](err_t){})
-    , m_timeout_alarm(0)
-    , m_timeout_ms(0)
+    , m_user_redirect_callback([](const std::string&, std::string_view){ return false; })
 {
     trace1("http_client ctor entered\n");
     init();
     trace1("http_client ctor exited\n");
 }
 
-http_client::~http_client() {
+template <class Transport>
+basic_http_client<Transport>::basic_http_client(std::string url, Transport *transport, std::span<uint8_t> cert)
+    : m_host("")
+    , m_url(url)
+    , m_port(-1)
+    , m_cert(cert)
+    , m_tcp(transport)
+    , m_user_response_callback([](){})
+    , m_user_closed_callback([](){})
+    , m_user_error_callback([](err_t){})
+    , m_user_redirect_callback([](const std::string&, std::string_view){ return false; })
+{
+    trace1("http_client ctor entered\n");
+    init();
+    trace1("http_client ctor exited\n");
+}
+
+template <class Transport>
+basic_http_client<Transport>::~basic_http_client() {
     trace1("http_client dtor entered\n");
-    if(m_timeout_alarm != 0) {
-        cancel_alarm(m_timeout_alarm);
-        m_timeout_alarm = 0;
+    if(m_retry_alarm != 0) {
+        cancel_alarm(m_retry_alarm);
+        m_retry_alarm = 0;
+    }
+    if(m_redirect_alarm != 0) {
+        cancel_alarm(m_redirect_alarm);
+        m_redirect_alarm = 0;
     }
     if(m_tcp) {
         delete m_tcp;
@@ -34,7 +122,8 @@ http_client::~http_client() {
     trace1("http_client dtor exited\n");
 }
 
-void http_client::url(std::string new_url) {
+template <class Transport>
+void basic_http_client<Transport>::url(std::string new_url) {
     trace("http_client::url entered with new_url of '%.*s'\n", new_url.size(), new_url.data());
     m_url = new_url;
     if(m_tcp) {
@@ -44,7 +133,8 @@ void http_client::url(std::string new_url) {
     trace1("http_client::url exited\n");
 }
 
-bool http_client::parse_url() {
+template <class Transport>
+bool basic_http_client<Transport>::parse_url() {
     debug("http_client::parse_url '%.*s'\n", m_url.size(), m_url.data());
     m_url_parser = LUrlParser::ParseURL::parseURL(m_url);
     if(!m_url_parser.isValid()) {
@@ -55,72 +145,90 @@ bool http_client::parse_url() {
 
     m_host = m_url_parser.host_;
     debug("http_client::parse_url got host %.*s", m_host.size(), m_host.data());
+    // Left over from the previous url otherwise
+    m_port = -1;
+    // The next origin's connection starts out with the HTTP/1.1 defaults
+    m_keep_alive = true;
+    m_keep_alive_ms = 0;
     if(m_url_parser.port_.size() > 0) {
         m_url_parser.getPort(&m_port);
         debug_cont(":%d", m_port);
     }
     debug_cont1("\n");
 
-    if((m_url_parser.scheme_ == "https" || m_url_parser.scheme_ == "wss")) {
-        if(m_tcp && !m_tcp->secure()) {
+    bool secure = m_url_parser.scheme_ == "https" || m_url_parser.scheme_ == "wss";
+    if constexpr(std::is_same_v<Transport, tcp_base>) {
+        if(m_tcp && m_tcp->secure() != secure) {
             delete m_tcp;
             m_tcp = nullptr;
         }
+    }
 
-        if(m_tcp == nullptr) {
-            debug1("http_client::parse_url creating new tcp_tls_client\n");
-            m_tcp = new tcp_tls_client(m_cert);
-        }
-        if(m_port == -1) {
-            m_port = 443;
-        }
-    } else {
-        if(m_tcp && m_tcp->secure()) {
-            delete m_tcp;
-            m_tcp = nullptr;
-        }
+    if(m_tcp == nullptr) {
+        debug("http_client::parse_url creating new %s\n", secure ? "tcp_tls_client" : "tcp_client");
+        m_tcp = create_transport(secure);
+    } else if(m_tcp->secure() != secure) {
+        warn("http_client::parse_url: scheme '%s' does not match the fixed transport\n", m_url_parser.scheme_.c_str());
+    }
 
-        if(m_tcp == nullptr) {
-            debug1("http_client::parse_url creating new tcp_client\n");
-            m_tcp = new tcp_client();
-        }
-        if(m_port == -1) {
-            m_port = 80;
-        }
+    if(m_port == -1) {
+        m_port = secure ? 443 : 80;
     }
     trace1("http_client::parse_url exited\n");
     return true;
 }
 
-void http_client::get(std::string target, std::string body) {
+template <class Transport>
+Transport *basic_http_client<Transport>::create_transport(bool secure) {
+    if constexpr(std::is_same_v<Transport, tcp_base>) {
+        if(secure) {
+            return new tcp_tls_client(m_cert);
+        }
+        return new tcp_client();
+    } else if constexpr(std::is_constructible_v<Transport, std::span<uint8_t>>) {
+        return new Transport(m_cert);
+    } else {
+        return new Transport();
+    }
+}
+
+template <class Transport>
+void basic_http_client<Transport>::get(std::string target, std::string body) {
     send_request("GET", target, body);
 }
 
-void http_client::post(std::string target, std::string body) {
+template <class Transport>
+void basic_http_client<Transport>::post(std::string target, std::string body) {
     send_request("POST", target, body);
 }
 
-void http_client::put(std::string target, std::string body) {
+template <class Transport>
+void basic_http_client<Transport>::put(std::string target, std::string body) {
     send_request("PUT", target, body);
 }
 
-void http_client::patch(std::string target, std::string body) {
+template <class Transport>
+void basic_http_client<Transport>::patch(std::string target, std::string body) {
     send_request("PATCH", target, body);
 }
 
-void http_client::del(std::string target, std::string body) {
+template <class Transport>
+void basic_http_client<Transport>::del(std::string target, std::string body) {
     send_request("DELETE", target, body);
 }
 
-void http_client::head(std::string target, std::string body) {
+template <class Transport>
+void basic_http_client<Transport>::head(std::string target, std::string body) {
     send_request("HEAD", target, body);
 }
 
-void http_client::options(std::string target, std::string body) {
+template <class Transport>
+void basic_http_client<Transport>::options(std::string target, std::string body) {
     send_request("OPTIONS", target, body);
 }
 
-void http_client::header(std::string key, std::string value) {
+template <class Transport>
+void basic_http_client<Transport>::header(std::string key, std::string value) {
     trace1("http_client::header entered\n");
     if(m_request_sent) {
         m_current_request.clear();
@@ -130,7 +238,8 @@ void http_client::header(std::string key, std::string value) {
     trace1("http_client::header exited\n");
 }
 
-void http_client::send_request(std::string method, std::string target, std::string body) {
+template <class Transport>
+void basic_http_client<Transport>::send_request(std::string method, std::string target, std::string body) {
     trace("http_client::send_request entered with:\n    method '%.*s'\n    target '%.*s'\n    body '%.*s'\n", method.size(), method.data(), target.size(), target.data(), body.size(), body.data());
     if(m_request_sent) {
         m_current_request.clear();
@@ -140,23 +249,94 @@ void http_client::send_request(std::string method, std::string target, std::stri
     m_current_request.target_ = target;
     m_current_request.body_ = body;
     m_current_request.ready_ = true;
+    m_prepared = nullptr;
+    m_body_provider = nullptr;
+    m_upload = false;
+    m_redirects = 0;
+    arm_total();
     send_request();
     trace1("http_client::send_request exited\n");
 }
 
-tcp_base *http_client::release_tcp_client() {
+template <class Transport>
+void basic_http_client<Transport>::upload(std::string method, std::string target, inplace_function<size_t(std::span<uint8_t>)> provider, int64_t length) {
+    trace("http_client::upload entered with:\n    method '%.*s'\n    target '%.*s'\n    length %lld\n", method.size(), method.data(), target.size(), target.data(), length);
+    if(m_pipelining) {
+        error1("http_client::upload: streamed bodies cannot be pipelined\n");
+        m_has_error = true;
+        return;
+    }
+    if(m_request_sent) {
+        m_current_request.clear();
+        m_request_sent = false;
+    }
+    m_current_request.method_ = method;
+    m_current_request.target_ = target;
+    m_current_request.ready_ = true;
+    if(length >= 0) {
+        m_current_request.add_header("Content-Length", std::to_string(length));
+    } else {
+        m_current_request.add_header("Transfer-Encoding", "chunked");
+    }
+    m_prepared = nullptr;
+    m_body_provider = provider;
+    m_body_remaining = length;
+    m_upload = true;
+    m_redirects = 0;
+    arm_total();
+    send_request();
+    trace1("http_client::upload exited\n");
+}
+
+template <class Transport>
+prepared_request basic_http_client<Transport>::prepare(std::string_view method, std::string_view target) {
+    prepared_request request(method, target);
+    request.freeze_header("Host", m_host);
+    request.freeze_header("User-Agent", "pico");
+    if(m_accept_encoding && !m_current_request.headers.contains("Accept-Encoding")) {
+        request.freeze_header("Accept-Encoding", "gzip, deflate");
+    }
+    for(auto iter = m_current_request.headers.cbegin(); iter != m_current_request.headers.cend(); iter++) {
+        if(iter->first != "Host" && iter->first != "User-Agent") {
+            request.freeze_header(iter->first, iter->second);
+        }
+    }
+    return request;
+}
+
+template <class Transport>
+void basic_http_client<Transport>::send(prepared_request &request) {
+    trace1("http_client::send entered\n");
+    if(m_request_sent) {
+        m_current_request.clear();
+        m_request_sent = false;
+    }
+    m_prepared = &request;
+    m_body_provider = nullptr;
+    m_upload = false;
+    m_redirects = 0;
+    m_cache_key.clear();
+    m_revalidating = false;
+    arm_total();
+    dispatch();
+    trace1("http_client::send exited\n");
+}
+
+template <class Transport>
+Transport *basic_http_client<Transport>::release_tcp_client() {
     trace1("http_client::release_tcp_client entered\n");
     m_tcp->on_connected([](){});
     m_tcp->on_receive([](){});
     m_tcp->on_closed([](){});
     m_tcp->on_error([](err_t){});
-    tcp_base *to_return = m_tcp;
+    Transport *to_return = m_tcp;
     m_tcp = nullptr;
     trace1("http_client::release_tcp_client exited\n");
     return std::move(to_return);
 }
 
-bool http_client::init() {
+template <class Transport>
+bool basic_http_client<Transport>::init() {
     trace1("http_client::init entered\n");
     bool to_return = parse_url();
     if(!m_tcp) {
@@ -170,74 +350,551 @@ bool http_client::init() {
     return to_return;
 }
 
-void http_client::send_request() {
+template <class Transport>
+void basic_http_client<Transport>::send_request() {
     trace1("http_client::send_request entered\n");
     debug("http_client::send_request (tcp = %p)\n", m_tcp);
-    m_response_ready = false;
     trace1("http_client::send_request Adding headers\n");
-    m_current_request.add_header("Host", m_host);
-    m_current_request.add_header("User-Agent", "pico");
-    if(m_current_request.body_.size() > 0) {
-        m_current_request.add_header("Content-Length", std::to_string(m_current_request.body_.size()));
+    m_current_request.identify(m_host, "pico");
+    if(m_accept_encoding && !m_current_request.headers.contains("Accept-Encoding")) {
+        m_current_request.add_header("Accept-Encoding", "gzip, deflate");
     }
-    m_current_response.clear();
-    if(m_current_response.request == nullptr) {
-        m_current_response = http_response(&m_current_request);
+    revalidate();
+    dispatch();
+    trace1("http_client::send_request exited\n");
+}
+
+template <class Transport>
+void basic_http_client<Transport>::dispatch() {
+    trace1("http_client::dispatch entered\n");
+    if(!m_pipelining) {
+        next_response();
     }
-    trace1("http_client::send_request Adding callbacks\n");
-    m_tcp->on_receive(std::bind(&http_client::tcp_recv_callback, this));
-    m_tcp->on_closed(std::bind(&http_client::tcp_closed_callback, this));
-    m_tcp->on_error(std::bind(&http_client::tcp_error_callback, this, std::placeholders::_1));
+    if(m_tcp->connected() && m_pipeline_count == 0 && !connection_reusable()) {
+        // Reconnect now rather than have the request meet a connection the server is closing
+        debug1("http_client::dispatch: connection is not reusable, reconnecting\n");
+        m_tcp->on_closed([](){});
+        m_tcp->on_error([](err_t){});
+        m_tcp->close(ERR_CLSD);
+    }
+    m_reused_connection = m_tcp->connected();
+    trace1("http_client::dispatch Adding callbacks\n");
+    m_tcp->on_receive(std::bind(&basic_http_client::tcp_recv_callback, this));
+    m_tcp->on_closed(std::bind(&basic_http_client::tcp_closed_callback, this));
+    m_tcp->on_error(std::bind(&basic_http_client::tcp_error_callback, this, std::placeholders::_1));
 
+    m_phase_timer.on_expire(std::bind(&basic_http_client::timed_out, this, false));
+    m_total_timer.on_expire(std::bind(&basic_http_client::timed_out, this, true));
     bool init = m_tcp->initialized() || m_tcp->init();
 
     if(!init) {
-        error1("http_client::send_request: Could not initialize tcp client\n");
-        trace1("http_client::send_request exited\n");
+        error1("http_client::dispatch: Could not initialize tcp client\n");
+        trace1("http_client::dispatch exited\n");
         m_has_error = true;
         return;
     }
 
+    if(m_pipelining) {
+        enqueue();
+        pump();
+        trace1("http_client::dispatch exited\n");
+        return;
+    }
+
     if(!m_tcp->connected()) {
-        trace1("http_client::send_request Connecting TCP\n");
-        m_tcp->on_connected(std::bind(&http_client::tcp_connected_callback, this));
+        trace1("http_client::dispatch Connecting TCP\n");
+        m_tcp->on_connected(std::bind(&basic_http_client::tcp_connected_callback, this));
+        deadline(phase::connect);
         m_tcp->connect(m_host, m_port);
     } else {
-        trace1("http_client::send_request Already connected\n");
+        trace1("http_client::dispatch Already connected\n");
         tcp_connected_callback();
     }
-    trace1("http_client::send_request exited\n");
+    trace1("http_client::dispatch exited\n");
+}
+
+template <class Transport>
+void basic_http_client<Transport>::enqueue() {
+    trace1("http_client::enqueue entered\n");
+    if(m_pipeline_count == HTTP_PIPELINE_DEPTH) {
+        error("http_client::enqueue: %d requests already in flight\n", m_pipeline_count);
+        m_has_error = true;
+        return;
+    }
+    pipeline_entry &entry = m_pipeline[(m_pipeline_first + m_pipeline_count) % HTTP_PIPELINE_DEPTH];
+    std::string_view method;
+    if(m_prepared) {
+        std::span<const uint8_t> serialized = m_prepared->finish();
+        entry.request.assign((const char*)serialized.data(), serialized.size());
+        method = m_prepared->method();
+    } else {
+        // Serialized into the entry's string, which keeps its capacity from earlier requests
+        std::span<const uint8_t> body = m_current_request.body();
+        size_t head_size = m_current_request.head_size();
+        entry.request.resize(head_size + body.size());
+        m_current_request.serialize_head({(uint8_t*)entry.request.data(), head_size});
+        memcpy(entry.request.data() + head_size, body.data(), body.size());
+        method = m_current_request.method_;
+    }
+    entry.head = method == "HEAD";
+    entry.idempotent = idempotent_method(method);
+    entry.written = false;
+    m_request_sent = true;
+    if(m_pipeline_count++ == 0) {
+        next_response();
+    }
+    debug("http_client::enqueue: %d requests in flight\n", m_pipeline_count);
+    trace1("http_client::enqueue exited\n");
 }
 
-int64_t http_client::timeout_callback(alarm_id_t alarm, void* user_data) {
-    http_client* client = (http_client*)user_data;
-    client->m_tcp->close(ERR_TIMEOUT);
+template <class Transport>
+void basic_http_client<Transport>::pump() {
+    trace1("http_client::pump entered\n");
+    if(m_pipeline_count == 0) {
+        trace1("http_client::pump exited\n");
+        return;
+    }
+    if(!m_tcp->connected()) {
+        if(!m_connecting) {
+            debug1("http_client::pump: connecting\n");
+            m_connecting = true;
+            m_tcp->on_connected(std::bind(&basic_http_client::tcp_connected_callback, this));
+            deadline(phase::connect);
+            m_tcp->connect(m_host, m_port);
+        }
+        trace1("http_client::pump exited\n");
+        return;
+    }
+    uint8_t outstanding = 0;
+    for(uint8_t i = 0; i < m_pipeline_count; i++) {
+        pipeline_entry &entry = m_pipeline[(m_pipeline_first + i) % HTTP_PIPELINE_DEPTH];
+        if(!entry.written) {
+            if(outstanding >= m_pipeline_depth || (!entry.idempotent && outstanding > 0)) {
+                break;
+            }
+            debug("http_client sending pipelined request:\n%.*s\n", entry.request.size(), entry.request.data());
+            m_tcp->write({(const uint8_t*)entry.request.data(), entry.request.size()});
+            entry.written = true;
+        }
+        outstanding++;
+        if(!entry.idempotent) {
+            break;
+        }
+    }
+    if(outstanding > 0 && (m_phase == phase::none || m_phase == phase::connect)) {
+        deadline(phase::first_byte);
+    }
+    trace1("http_client::pump exited\n");
+}
+
+template <class Transport>
+void basic_http_client<Transport>::next_response() {
+    m_response_ready = false;
+    m_current_response.clear();
+    if(m_user_body_callback) {
+        // The body of a redirect that is followed is not the caller's
+        m_current_response.on_body_chunk([this](std::span<const uint8_t> data){
+            if(!redirect_pending()) {
+                m_user_body_callback(data);
+            }
+        });
+    } else {
+        m_current_response.on_body_chunk(nullptr);
+    }
+    if(m_pipelining) {
+        m_current_response.head_request = m_pipeline_count > 0 && m_pipeline[m_pipeline_first].head;
+    } else {
+        std::string_view method = m_prepared ? m_prepared->method() : std::string_view(m_current_request.method_);
+        m_current_response.head_request = method == "HEAD";
+    }
+}
+
+template <class Transport>
+void basic_http_client<Transport>::recover_pipeline() {
+    trace1("http_client::recover_pipeline entered\n");
+    uint8_t written = 0;
+    for(uint8_t i = 0; i < m_pipeline_count; i++) {
+        written += m_pipeline[(m_pipeline_first + i) % HTTP_PIPELINE_DEPTH].written;
+    }
+    pipeline_entry &front = m_pipeline[m_pipeline_first];
+    if(front.written && !front.idempotent) {
+        // The server may or may not have acted on it, so it is not sent again
+        error1("http_client: connection closed before a non-idempotent request was answered\n");
+        m_pipeline_first = (m_pipeline_first + 1) % HTTP_PIPELINE_DEPTH;
+        m_pipeline_count--;
+        m_user_error_callback(ERR_ABRT);
+    }
+    if(m_pipeline_count == 0 || m_pipeline_retries++ > 0) {
+        if(m_pipeline_count > 0) {
+            error("http_client: giving up on %d requests after the connection closed again\n", m_pipeline_count);
+            m_pipeline_count = 0;
+            m_has_error = true;
+        }
+        m_user_closed_callback();
+        trace1("http_client::recover_pipeline exited\n");
+        return;
+    }
+    if(written > 1 && m_pipeline_depth > 1) {
+        warn1("http_client: pipelined connection closed early, sending one request at a time\n");
+        m_pipeline_depth = 1;
+    }
+    for(uint8_t i = 0; i < m_pipeline_count; i++) {
+        m_pipeline[(m_pipeline_first + i) % HTTP_PIPELINE_DEPTH].written = false;
+    }
+    arm_total();
+    next_response();
+    pump();
+    trace1("http_client::recover_pipeline exited\n");
+}
+
+template <class Transport>
+void basic_http_client<Transport>::revalidate() {
+    m_cache_key.clear();
+    m_revalidating = false;
+    if(!m_cache || m_pipelining || m_current_request.method_ != "GET") {
+        return;
+    }
+    // The scheme keeps http and https responses of the same host and port apart
+    m_cache_key = m_url_parser.scheme_ + "://" + m_host + ':' + std::to_string(m_port) + m_current_request.target_;
+    const response_cache::entry *cached = m_cache->find(m_cache_key);
+    if(!cached) {
+        return;
+    }
+    debug("http_client: revalidating cached %s\n", m_cache_key.c_str());
+    if(!cached->etag.empty() && !m_current_request.headers.contains("If-None-Match")) {
+        m_current_request.add_header("If-None-Match", cached->etag);
+        m_revalidating = true;
+    }
+    if(!cached->last_modified.empty() && !m_current_request.headers.contains("If-Modified-Since")) {
+        m_current_request.add_header("If-Modified-Since", cached->last_modified);
+        m_revalidating = true;
+    }
+}
+
+template <class Transport>
+bool basic_http_client<Transport>::refetch_evicted() {
+    if(m_cache_key.empty() || !m_revalidating || m_current_response.status() != 304 || m_cache->find(m_cache_key)) {
+        return false;
+    }
+    // The entry the validators came from was evicted while the request was out,
+    // so there is no body left to serve the 304 with
+    info("http_client: %s left the cache, requesting it again\n", m_cache_key.c_str());
+    m_current_request.headers.erase("If-None-Match");
+    m_current_request.headers.erase("If-Modified-Since");
+    m_revalidating = false;
+    m_redirect_url.clear();
+    if(m_redirect_alarm == 0) {
+        m_redirect_alarm = add_alarm_in_ms(1, redirect_callback, this, true);
+    }
+    return true;
+}
+
+template <class Transport>
+void basic_http_client<Transport>::apply_cache() {
+    if(m_cache_key.empty()) {
+        return;
+    }
+    if(m_current_response.status() == 304) {
+        const response_cache::entry *cached = m_cache->find(m_cache_key);
+        if(cached) {
+            m_current_response.serve_cached(cached->status, cached->body());
+        }
+    } else if(m_current_response.status() == 200) {
+        m_cache->store(m_cache_key, m_current_response);
+    }
+}
+
+template <class Transport>
+void basic_http_client<Transport>::track_keep_alive() {
+    const http_response &response = m_current_response;
+    std::string_view connection = response.header(http_response::known_header::connection);
+    // HTTP/1.1 connections persist unless closed explicitly, HTTP/1.0 ones only on request
+    m_keep_alive = response.get_protocol() == "HTTP/1.0" ? has_token(connection, "keep-alive") : !has_token(connection, "close");
+    // Without a timeout in this response the earlier one no longer applies
+    m_keep_alive_ms = 0;
+    std::string_view keep_alive = response.header("Keep-Alive");
+    size_t timeout = keep_alive.find("timeout=");
+    if(timeout != std::string_view::npos) {
+        uint32_t seconds = 0;
+        std::from_chars(keep_alive.data() + timeout + 8, keep_alive.data() + keep_alive.size(), seconds);
+        m_keep_alive_ms = seconds * 1000;
+    }
+    m_idle_since_ms = to_ms_since_boot(get_absolute_time());
+    debug("http_client: connection %s, keep-alive timeout %u ms\n", m_keep_alive ? "persists" : "closes", m_keep_alive_ms);
+}
+
+template <class Transport>
+bool basic_http_client<Transport>::connection_reusable() const {
+    if(!m_keep_alive) {
+        return false;
+    }
+    uint32_t idle = to_ms_since_boot(get_absolute_time()) - m_idle_since_ms;
+    if(m_keep_alive_ms != 0) {
+        return idle + HTTP_KEEPALIVE_MARGIN_MS < m_keep_alive_ms;
+    }
+#if HTTP_KEEPALIVE_IDLE_MS == 0
+    return true;
+#else
+    return idle < HTTP_KEEPALIVE_IDLE_MS;
+#endif
+}
+
+template <class Transport>
+bool basic_http_client<Transport>::retry_on_fresh_connection() {
+    // Only a request that met a connection the server had already given up on:
+    // sent on a reused connection, not a byte of response back, and safe to repeat
+    std::string_view method = m_prepared ? m_prepared->method() : std::string_view(m_current_request.method_);
+    if(m_pipelining || !m_reused_connection || !m_request_sent || m_response_ready || m_upload
+            || m_current_response.state != http_response::parse_state::status_line || m_current_response.index != 0
+            || !idempotent_method(method)) {
+        return false;
+    }
+    info1("http_client: reused connection was stale, retrying on a new one\n");
+    m_reused_connection = false;
+    deadline(phase::none);
+    // Reconnecting from inside the transport's own close is not safe, so it happens from an alarm
+    if(m_retry_alarm == 0) {
+        m_retry_alarm = add_alarm_in_ms(1, retry_callback, this, true);
+    }
+    return true;
+}
+
+template <class Transport>
+int64_t basic_http_client<Transport>::retry_callback(alarm_id_t, void* user_data) {
+    basic_http_client *client = (basic_http_client*)user_data;
+    client->m_retry_alarm = 0;
+    client->dispatch();
+    // Do not reschedule the alarm
+    return 0;
+}
+
+template <class Transport>
+bool basic_http_client<Transport>::redirect_pending() const {
+    uint16_t status = m_current_response.status();
+    if(m_redirects >= m_max_redirects || m_pipelining || m_prepared || !redirect_status(status)
+            || m_current_response.header("Location").empty()) {
+        return false;
+    }
+    // A streamed body is gone once it has been sent, so it cannot follow the redirect
+    bool keeps_body = status == 307 || status == 308 || (status != 303 && m_current_request.method_ != "POST");
+    return !(m_upload && keeps_body);
+}
+
+template <class Transport>
+bool basic_http_client<Transport>::follow_redirect() {
+    uint16_t status = m_current_response.status();
+    if(!redirect_pending()) {
+        if(redirect_status(status) && m_max_redirects > 0 && m_redirects >= m_max_redirects) {
+            warn("http_client: not following more than %d redirects\n", m_redirects);
+        }
+        return false;
+    }
+    std::string url = resolve_location(m_url_parser, m_current_request.target_, m_current_response.header("Location"));
+    LUrlParser::ParseURL parsed = LUrlParser::ParseURL::parseURL(url);
+    if(!parsed.isValid()) {
+        warn("http_client: cannot follow redirect to '%s'\n", url.c_str());
+        return false;
+    }
+    m_redirects++;
+    std::string &method = m_current_request.method_;
+    if((status == 303 && method != "HEAD") || ((status == 301 || status == 302) && method == "POST")) {
+        method = "GET";
+        m_current_request.body_.clear();
+        m_current_request.headers.erase("Content-Length");
+        m_current_request.headers.erase("Content-Type");
+        m_current_request.headers.erase("Transfer-Encoding");
+        m_body_provider = nullptr;
+        m_upload = false;
+    }
+    if(!m_cache_key.empty()) {
+        // Validators of the old target, revalidate() adds the new one's
+        m_current_request.headers.erase("If-None-Match");
+        m_current_request.headers.erase("If-Modified-Since");
+    }
+    m_current_request.target_ = "/" + parsed.path_;
+    if(parsed.query_.size() > 0) {
+        m_current_request.target_ += "?" + parsed.query_;
+    }
+    bool same_origin = iequals(origin_of(parsed), origin_of(m_url_parser));
+    info("http_client: %d redirect %d to %s, following with %s\n", status, m_redirects, url.c_str(), method.c_str());
+    if(!same_origin) {
+        // Credentials belong to the origin they were meant for
+        m_current_request.headers.erase("Authorization");
+        m_current_request.headers.erase("Cookie");
+        if(m_user_redirect_callback(url, method)) {
+            return true;
+        }
+    }
+    m_redirect_url = same_origin ? "" : url;
+    // Sending again from inside the transport's callbacks is not safe, so it happens from an alarm
+    if(m_redirect_alarm == 0) {
+        m_redirect_alarm = add_alarm_in_ms(1, redirect_callback, this, true);
+    }
+    return true;
+}
+
+template <class Transport>
+int64_t basic_http_client<Transport>::redirect_callback(alarm_id_t alarm, void* user_data) {
+    basic_http_client *client = (basic_http_client*)user_data;
+    client->m_redirect_alarm = 0;
+    if(!client->m_redirect_url.empty()) {
+        // The old connection is dropped quietly, the request carries on over a new one
+        client->m_tcp->on_closed([](){});
+        client->m_tcp->on_error([](err_t){});
+        client->m_tcp->close(ERR_CLSD);
+        client->m_url = std::move(client->m_redirect_url);
+        client->m_redirect_url.clear();
+        client->parse_url();
+    }
+    // A same origin redirect reuses the connection unless the server is closing it
+    client->send_request();
     // Do not reschedule the alarm
     return 0;
 }
 
-void http_client::tcp_connected_callback() {
+template <class Transport>
+void basic_http_client<Transport>::deadline(phase next) {
+    m_phase = next;
+    uint32_t timeout_ms = next == phase::none ? 0
+                        : next == phase::connect ? m_timeouts.connect
+                        : next == phase::first_byte ? m_timeouts.first_byte
+                        : m_timeouts.idle;
+    if(timeout_ms != 0) {
+        m_phase_timer.start(timeout_ms);
+    } else {
+        m_phase_timer.cancel();
+    }
+}
+
+template <class Transport>
+void basic_http_client<Transport>::arm_total() {
+    if(m_timeouts.total != 0) {
+        m_total_timer.start(m_timeouts.total);
+    } else {
+        m_total_timer.cancel();
+    }
+}
+
+template <class Transport>
+void basic_http_client<Transport>::timed_out([[maybe_unused]] bool total) {
+    [[maybe_unused]] static const char *phases[] = {"", "connecting", "sending the body", "waiting for the response", "receiving the response"};
+    warn("http_client: timed out %s\n", total ? "on the whole request" : phases[(uint8_t)m_phase]);
+    m_phase = phase::none;
+    m_phase_timer.cancel();
+    m_total_timer.cancel();
+    m_tcp->close(ERR_TIMEOUT);
+}
+
+template <class Transport>
+void basic_http_client<Transport>::tcp_connected_callback() {
     trace1("http_client::tcp_connected_callback entered\n");
-    std::string serialized = m_current_request.serialize();
-    debug("http_client sending:\n%.*s\n", serialized.size(), serialized.data());
-    m_tcp->write({(uint8_t*)serialized.data(), serialized.size()});
+    if(m_pipelining) {
+        m_connecting = false;
+        pump();
+        trace1("http_client::tcp_connected_callback exited\n");
+        return;
+    }
+    if(m_prepared) {
+        std::span<const uint8_t> serialized = m_prepared->finish();
+        debug("http_client sending prepared request:\n%.*s\n", serialized.size(), (char*)serialized.data());
+        m_tcp->write(serialized);
+    } else {
+        // The head is staged in one pooled block, a larger head goes out a block
+        // at a time. The body is written from where it already lives; the
+        // transport copies both into its send queue
+        buffer_block *staging = buffer_pool::shared().acquire();
+        if(staging == nullptr) {
+            error1("http_client: no buffer to send the request from\n");
+            m_tcp->close(ERR_MEM);
+            trace1("http_client::tcp_connected_callback exited\n");
+            return;
+        }
+        m_current_request.write_head({staging->data, sizeof(staging->data)}, [this](std::span<const uint8_t> piece){
+            debug("http_client sending:\n%.*s\n", piece.size(), (char*)piece.data());
+            m_tcp->write(piece);
+        });
+        buffer_pool::shared().release(staging);
+        std::span<const uint8_t> body = m_current_request.body();
+        if(body.size() > 0) {
+            debug("http_client sending body:\n%.*s\n", body.size(), (char*)body.data());
+            m_tcp->write(body);
+        }
+    }
     m_request_sent = true;
-    if(m_timeout_ms != 0) {
-        m_timeout_alarm = add_alarm_in_ms(m_timeout_ms, timeout_callback, this, true);
-        debug1("Adding timeout alarm\n");
+    if(m_body_provider) {
+        // The rest goes out from on_sent as the peer acknowledges what came before
+        m_tcp->on_sent(std::bind(&basic_http_client::write_body, this));
+        write_body();
+        trace1("http_client::tcp_connected_callback exited\n");
+        return;
     }
+    deadline(phase::first_byte);
     trace1("http_client::tcp_connected_callback exited\n");
 }
 
+template <class Transport>
+void basic_http_client<Transport>::write_body() {
+    trace1("http_client::write_body entered\n");
+    deadline(phase::send);
+    // A chunk goes out as one write: hex size and CRLF in front of the data, CRLF after it
+    constexpr size_t prefix = 10, suffix = 2;
+    bool chunked = m_body_remaining < 0;
+    while(m_body_provider) {
+        size_t space = m_tcp->writable();
+        size_t overhead = chunked ? prefix + suffix : 0;
+        if(space <= overhead) {
+            break;
+        }
+        size_t capacity = std::min(space - overhead, (size_t)HTTP_UPLOAD_CHUNK);
+        if(!chunked) {
+            capacity = std::min(capacity, (size_t)m_body_remaining);
+        }
+        uint8_t chunk[prefix + HTTP_UPLOAD_CHUNK + suffix];
+        size_t count = capacity > 0 ? m_body_provider({chunk + prefix, capacity}) : 0;
+        if(count == 0) {
+            if(chunked) {
+                m_tcp->write({(const uint8_t*)"0\r\n\r\n", 5});
+            } else if(m_body_remaining > 0) {
+                error("http_client::write_body: body ended %lld bytes short of its Content-Length\n", m_body_remaining);
+                m_body_provider = nullptr;
+                m_tcp->close(ERR_VAL);
+                trace1("http_client::write_body exited\n");
+                return;
+            }
+            debug1("http_client::write_body: body complete\n");
+            m_body_provider = nullptr;
+            m_tcp->on_sent([](){});
+            deadline(phase::first_byte);
+            break;
+        }
+        std::span<const uint8_t> out = {chunk + prefix, count};
+        if(chunked) {
+            char size[prefix];
+            size_t digits = std::to_chars(size, size + prefix, count, 16).ptr - size;
+            memcpy(chunk + prefix - digits - 2, size, digits);
+            memcpy(chunk + prefix - 2, "\r\n", 2);
+            memcpy(chunk + prefix + count, "\r\n", 2);
+            out = {chunk + prefix - digits - 2, digits + 2 + count + 2};
+        } else {
+            m_body_remaining -= count;
+        }
+        if(!m_tcp->write(out)) {
+            error1("http_client::write_body: write failed\n");
+            m_body_provider = nullptr;
+            m_tcp->close(ERR_MEM);
+            trace1("http_client::write_body exited\n");
+            return;
+        }
+    }
+    m_tcp->flush();
+    trace1("http_client::write_body exited\n");
+}
+
 #define MAX_RECV_BYTE_OUTPUT 256
 
-void http_client::tcp_recv_callback() {
+template <class Transport>
+void basic_http_client<Transport>::tcp_recv_callback() {
     trace1("http_client::tcp_recv_callback entered\n");
-    if(m_timeout_alarm != 0) {
-        debug1("Cancelling timeout alarm\n");
-        cancel_alarm(m_timeout_alarm);
-        m_timeout_alarm = 0;
-    }
     uint8_t data[m_tcp->available()];
     std::span<uint8_t> span = {(uint8_t*)data, (size_t)m_tcp->available()};
     m_tcp->read(span);
@@ -262,36 +919,125 @@ void http_client::tcp_recv_callback() {
         debug_cont1("\n");
     }
     #endif
-    m_current_response.parse(span);
-    m_response_ready = m_current_response.state == http_response::parse_state::done;
-    if(m_response_ready) {
-        m_tcp->on_receive([](){});
+    while(true) {
+        span = span.subspan(m_current_response.parse(span));
+        if(m_current_response.state == http_response::parse_state::failed) {
+            error1("http_client: malformed response, closing connection\n");
+            m_tcp->close(ERR_VAL);
+            break;
+        }
+        m_response_ready = m_current_response.state == http_response::parse_state::done;
+        if(!m_response_ready) {
+            break;
+        }
+        track_keep_alive();
+        deadline(phase::none);
+        if(!m_pipelining) {
+            m_tcp->on_receive([](){});
+            if(follow_redirect() || refetch_evicted()) {
+                if(m_redirect_alarm == 0) {
+                    // The redirect callback took the request over
+                    m_total_timer.cancel();
+                }
+                break;
+            }
+            m_total_timer.cancel();
+            apply_cache();
+            m_user_response_callback();
+            break;
+        }
+        // Retire the request this answered, then carry on with the next response
+        m_pipeline_retries = 0;
+        m_pipeline_first = (m_pipeline_first + 1) % HTTP_PIPELINE_DEPTH;
+        m_pipeline_count--;
+        if(m_pipeline_count > 0) {
+            deadline(phase::first_byte);
+            arm_total();
+        } else {
+            m_total_timer.cancel();
+        }
         m_user_response_callback();
+        if(m_pipeline_count == 0) {
+            if(span.size() > 0) {
+                warn("http_client: discarding %d bytes with no request in flight\n", span.size());
+            }
+            break;
+        }
+        next_response();
+        pump();
+        if(span.size() == 0) {
+            break;
+        }
+    }
+    if(!m_response_ready && (m_current_response.state != http_response::parse_state::status_line || m_current_response.index != 0)) {
+        // Restarted with every piece, so it only fires once the response stalls
+        deadline(phase::receive);
     }
     trace1("http_client::tcp_recv_callback exited\n");
 }
 
-void http_client::tcp_closed_callback() {
+template <class Transport>
+void basic_http_client<Transport>::tcp_closed_callback() {
     debug1("http_client closed callback called\n");
+    m_connecting = false;
+    if(m_redirect_alarm != 0 || retry_on_fresh_connection()) {
+        // The redirect or the retry reconnects anyway
+        return;
+    }
+    deadline(phase::none);
+    m_total_timer.cancel();
+    if(m_current_response.complete_at_close()) {
+        m_response_ready = true;
+        if(m_pipeline_count == 0 && (follow_redirect() || refetch_evicted())) {
+            return;
+        }
+        if(m_pipeline_count > 0) {
+            m_pipeline_first = (m_pipeline_first + 1) % HTTP_PIPELINE_DEPTH;
+            m_pipeline_count--;
+        }
+        apply_cache();
+        m_user_response_callback();
+    }
+    if(m_pipelining && m_pipeline_count > 0) {
+        recover_pipeline();
+        return;
+    }
     m_user_closed_callback();
 }
 
-void http_client::tcp_error_callback(err_t err) {
+template <class Transport>
+void basic_http_client<Transport>::tcp_error_callback(err_t err) {
     trace1("http_client::tcp_error_callback entered\n");
     error("Got error: '%s'\n", tcp_perror(err).c_str());
+    m_connecting = false;
+    if(m_redirect_alarm != 0 || retry_on_fresh_connection()) {
+        trace1("http_client::tcp_error_callback exited\n");
+        return;
+    }
     m_has_error = true;
+    deadline(phase::none);
+    m_total_timer.cancel();
+    // Whatever was in flight is lost along with the connection
+    m_pipeline_count = 0;
     m_user_error_callback(err);
     trace1("http_client::tcp_error_callback exited\n");
 }
 
-bool http_client::connected() const {
+template <class Transport>
+bool basic_http_client<Transport>::connected() const {
     return m_tcp->connected();
 }
 
-bool http_client::has_error() const {
+template <class Transport>
+bool basic_http_client<Transport>::has_error() const {
     return m_has_error;
 }
 
-void http_client::clear_error() {
+template <class Transport>
+void basic_http_client<Transport>::clear_error() {
     m_has_error = false;
-}
\ No newline at end of file
+}
+
+template class basic_http_client<tcp_base>;
+template class basic_http_client<tcp_client>;
+template class basic_http_client<tcp_tls_client>;
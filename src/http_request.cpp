@@ -1,7 +1,57 @@
 #include "http_request.h"
 
+#include <algorithm>
+#include <charconv>
+#include <string.h>
+
 #include "logger.h"
 
+static size_t decimal_digits(size_t value) {
+    size_t digits = 1;
+    while(value >= 10) {
+        value /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+// Copies text into staging, passing staging to write whenever it fills up
+class staged_writer {
+public:
+    staged_writer(std::span<uint8_t> staging, inplace_function<void(std::span<const uint8_t>)> &write)
+        : m_staging(staging)
+        , m_write(write)
+    {
+    }
+
+    void put(std::string_view text) {
+        m_total += text.size();
+        while(!text.empty()) {
+            size_t count = std::min(text.size(), m_staging.size() - m_used);
+            memcpy(m_staging.data() + m_used, text.data(), count);
+            m_used += count;
+            text.remove_prefix(count);
+            if(m_used == m_staging.size()) {
+                m_write(m_staging);
+                m_used = 0;
+            }
+        }
+    }
+
+    size_t finish() {
+        if(m_used > 0) {
+            m_write(m_staging.first(m_used));
+            m_used = 0;
+        }
+        return m_total;
+    }
+
+private:
+    std::span<uint8_t> m_staging;
+    inplace_function<void(std::span<const uint8_t>)> &m_write;
+    size_t m_used = 0, m_total = 0;
+};
+
 http_request::http_request(): method_(""), target_(""), body_("") {
     trace1("http_request ctor called\n");
 }
@@ -16,17 +66,100 @@ void http_request::add_header(std::string key, std::string value) {
     headers[key] = value;
 }
 
+void http_request::identify(std::string_view host, std::string_view user_agent) {
+    // Assigning into the same string reuses its storage from the last request
+    host_.assign(host);
+    user_agent_ = user_agent;
+}
+
 std::string http_request::serialize() {
     trace1("http_request::serialize entered\n");
-    std::string to_return = method_ + " " + target_ + " HTTP/1.1\r\n";
-    for(auto iter = headers.cbegin(); iter != headers.cend(); iter++) {
-        to_return += iter->first + ": " + iter->second + "\r\n";
-    }
-    to_return += "\r\n" + body_;
+    std::string to_return(head_size() + body_.size(), '\0');
+    size_t written = serialize_head({(uint8_t*)to_return.data(), to_return.size()});
+    memcpy(to_return.data() + written, body_.data(), body_.size());
     trace1("http_request::serialize exited\n");
     return to_return;
 }
 
+bool http_request::identified_by(std::string_view key) const {
+    // identify() wins over a Host or User-Agent added as an ordinary header
+    return (!host_.empty() && key == "Host") || (!user_agent_.empty() && key == "User-Agent");
+}
+
+bool http_request::needs_content_length() const {
+    return body_.size() > 0 && headers.find("Content-Length") == headers.end();
+}
+
+size_t http_request::head_size() const {
+    // "<method> <target> HTTP/1.1\r\n" ... "\r\n"
+    size_t size = method_.size() + 1 + target_.size() + 11 + 2;
+    if(!host_.empty()) {
+        size += 6 + host_.size() + 2;
+    }
+    if(!user_agent_.empty()) {
+        size += 12 + user_agent_.size() + 2;
+    }
+    for(auto iter = headers.cbegin(); iter != headers.cend(); iter++) {
+        if(!identified_by(iter->first)) {
+            size += iter->first.size() + 2 + iter->second.size() + 2;
+        }
+    }
+    if(needs_content_length()) {
+        size += 16 + decimal_digits(body_.size()) + 2;
+    }
+    return size;
+}
+
+size_t http_request::serialize_head(std::span<uint8_t> out) const {
+    trace1("http_request::serialize_head entered\n");
+    size_t size = head_size();
+    if(out.size() < size) {
+        error("http_request::serialize_head: %d byte buffer, need %d\n", out.size(), size);
+        return 0;
+    }
+    // The head fits, so the staging buffer is never handed on
+    size_t written = write_head(out.first(size), [](std::span<const uint8_t>){});
+    trace1("http_request::serialize_head exited\n");
+    return written;
+}
+
+size_t http_request::write_head(std::span<uint8_t> staging, inplace_function<void(std::span<const uint8_t>)> write) const {
+    trace1("http_request::write_head entered\n");
+    staged_writer out(staging, write);
+    out.put(method_);
+    out.put(" ");
+    out.put(target_);
+    out.put(" HTTP/1.1\r\n");
+    if(!host_.empty()) {
+        out.put("Host: ");
+        out.put(host_);
+        out.put("\r\n");
+    }
+    if(!user_agent_.empty()) {
+        out.put("User-Agent: ");
+        out.put(user_agent_);
+        out.put("\r\n");
+    }
+    for(auto iter = headers.cbegin(); iter != headers.cend(); iter++) {
+        if(identified_by(iter->first)) {
+            continue;
+        }
+        out.put(iter->first);
+        out.put(": ");
+        out.put(iter->second);
+        out.put("\r\n");
+    }
+    if(needs_content_length()) {
+        char digits[20];
+        out.put("Content-Length: ");
+        out.put({digits, (size_t)(std::to_chars(digits, digits + sizeof(digits), body_.size()).ptr - digits)});
+        out.put("\r\n");
+    }
+    out.put("\r\n");
+    trace1("http_request::write_head exited\n");
+    return out.finish();
+}
+
 std::string http_request::method() const {
     return method_;
 }
@@ -40,6 +173,8 @@ void http_request::clear() {
     method_.clear();
     target_.clear();
     body_.clear();
+    host_.clear();
+    user_agent_ = {};
     for(auto it = headers.begin(); it != headers.end(); it++) {
         it->second.clear();
     }
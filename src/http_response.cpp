@@ -1,11 +1,51 @@
 #include "http_response.h"
 
+#include <algorithm>
 #include <charconv>
+#include <iterator>
 #include "iequals.h"
 #include "http_request.h"
 #include "logger.h"
 #include <string.h>
 
+// Returns the first '\n' in [begin, begin + size) or nullptr. Once aligned it
+// tests four bytes per step with the usual has-zero-byte trick.
+static const uint8_t *find_line_end(const uint8_t *begin, size_t size) {
+    const uint8_t *p = begin, *end = begin + size;
+    while(p < end && ((uintptr_t)p & 3) != 0) {
+        if(*p == '\n') {
+            return p;
+        }
+        p++;
+    }
+    while(end - p >= 4) {
+        uint32_t word;
+        memcpy(&word, p, sizeof(word));
+        word ^= 0x0A0A0A0A;
+        if(((word - 0x01010101) & ~word & 0x80808080) != 0) {
+            break;
+        }
+        p += 4;
+    }
+    while(p < end) {
+        if(*p == '\n') {
+            return p;
+        }
+        p++;
+    }
+    return nullptr;
+}
+
+// Names of the known_header values, in the same order
+static constexpr std::string_view known_header_names[] = {
+    "content-length",
+    "content-type",
+    "transfer-encoding",
+    "connection",
+    "content-encoding"
+};
+static_assert(std::size(known_header_names) == (size_t)http_response::known_header::count);
+
 http_response::http_response(const http_request *request)
     : status_code(0)
     , state(parse_state::status_line)
@@ -32,46 +72,149 @@ http_response::~http_response() {
         free(data);
     }
 #endif
+    release_body();
+    delete decoder;
     trace1("http_response dtor exited\n");
 }
 
 http_response &http_response::operator=(http_response&& moved) {
     trace1("http_response move assignment operator entered\n");
-    this->data = std::move(moved.data);
+#ifndef HTTP_STATIC_SIZE
+    if(this->data != nullptr && this->data != moved.data) {
+        free(this->data);
+    }
+#endif
+#ifndef HTTP_STATIC_SIZE
+    this->data = moved.data;
+    moved.data = nullptr;
+#else
+    memcpy(this->data, moved.data, moved.index);
+#endif
     this->request = moved.request;
     this->state = moved.state;
     this->status_code = moved.status_code;
+    this->content_length = moved.content_length;
+    this->body_start = moved.body_start;
+    this->line_start = moved.line_start;
+    this->scan_index = moved.scan_index;
+    this->protocol = moved.protocol;
+    this->status_text = moved.status_text;
+    // Offsets into data, which came over with it
+    std::copy(moved.header_table, moved.header_table + moved.header_entries, this->header_table);
+    this->header_entries = moved.header_entries;
+    std::copy(std::begin(moved.known_headers), std::end(moved.known_headers), std::begin(this->known_headers));
+    this->excess = moved.excess;
+    this->chunked = moved.chunked;
+    this->chunk = moved.chunk;
+    this->chunk_remaining = moved.chunk_remaining;
+    this->trailer_length = moved.trailer_length;
+    this->chunk_digits = moved.chunk_digits;
     this->type = moved.type;
+    this->encoding = moved.encoding;
+    this->head_request = moved.head_request;
+    this->cached = moved.cached;
     this->index = moved.index;
     this->capacity = moved.capacity;
-    moved.data = nullptr;
+    this->body_received = moved.body_received;
+    this->body_callback = std::move(moved.body_callback);
+    std::swap(this->decoder, moved.decoder);
+    std::swap(this->body_head, moved.body_head);
+    std::swap(this->body_tail, moved.body_tail);
+    std::swap(this->buffered, moved.buffered);
+#ifndef HTTP_STATIC_SIZE
+    std::swap(this->flat, moved.flat);
+#else
+    // Laid out in the other response's buffer, get_body() makes it again
+    this->flat = nullptr;
+    moved.flat = nullptr;
+#endif
+    // Nothing of the head is left behind to point into
+    moved.header_entries = 0;
+    std::fill(std::begin(moved.known_headers), std::end(moved.known_headers), field{});
+    moved.protocol = {};
+    moved.status_text = {};
+    moved.line_start = 0;
+    moved.scan_index = 0;
     moved.index = 0;
     moved.capacity = 0;
     trace1("http_response move assignment operator exited\n");
     return *this;
 }
 
-void http_response::parse(std::span<uint8_t> chunk) {
+size_t http_response::parse(std::span<uint8_t> chunk) {
     trace("http_response::parse entered with chunk of size %d\n", chunk.size());
     debug1("Parsing http response:\n");
-    uint32_t start_index = index;
+    if(state == parse_state::body) {
+        // Body bytes go to the sink, the decoder or the block chain without touching the head buffer
+        size_t consumed = chunked ? decode_chunked(chunk) : deliver_body(chunk);
+        trace1("http_response::parse exited\n");
+        return consumed;
+    }
+    if(state == parse_state::done || state == parse_state::failed) {
+        trace1("http_response::parse exited\n");
+        return 0;
+    }
+    excess = 0;
     add_data(chunk);
-
-    std::string_view data_view = {(char*)data + start_index, (char*)data + index};
-    size_t line_start = 0, line_end = data_view.find("\r\n");
-    while(line_end != std::string::npos && (state != parse_state::body || type != content_type::binary)) {
-        trace("http_response::parse start of while loop\n    line_start = %d\n    line_end = %d\n", line_start, line_end);
-        parse_line({data_view.begin() + line_start, data_view.begin() + line_end});
-        line_start = line_end + 2;
-        line_end = data_view.find("\r\n", line_start);
-        trace1("http_response::parse end of while loop\n");
+    if(state == parse_state::status_line || state == parse_state::headers) {
+        parse_head();
     }
-    if(line_start < data_view.size() && state != parse_state::done) {
-        trace("http_response::parse start of if statement\n    line_start = %d\n    line_end = %d\n", line_start, line_end);
-        parse_line(std::string_view(data_view.begin() + line_start, data_view.end()));
-        trace1("http_response::parse end of if statement\n");
+    if(state == parse_state::body) {
+        parse_body();
     }
     trace1("http_response::parse exited\n");
+    return chunk.size() - excess;
+}
+
+void http_response::parse_head() {
+    // Only complete lines are parsed, a partial one is picked up again on the next chunk
+    while(state == parse_state::status_line || state == parse_state::headers) {
+        const uint8_t *line_end = find_line_end(data + scan_index, index - scan_index);
+        uint32_t end = line_end ? line_end - data : index;
+        if(end >= HTTP_MAX_HEAD_SIZE) {
+            error("http_response: head larger than %d bytes\n", HTTP_MAX_HEAD_SIZE);
+            state = parse_state::failed;
+            return;
+        }
+        if(line_end == nullptr) {
+            scan_index = index;
+            return;
+        }
+        scan_index = end + 1;
+        if(end > line_start && data[end - 1] == '\r') {
+            end--;
+        }
+        trace("http_response::parse_head line at %d, length %d\n", line_start, end - line_start);
+        parse_line({(char*)data + line_start, end - line_start});
+        line_start = scan_index;
+        if(state == parse_state::status_line) {
+            // That was an interim response, the final one starts after it
+            discard_head();
+        }
+    }
+    if(state == parse_state::done) {
+        // The response had no body, so whatever follows the head is not ours
+        excess = index - scan_index;
+        index = scan_index;
+    }
+}
+
+void http_response::discard_head() {
+    memmove(data, data + scan_index, index - scan_index);
+    index -= scan_index;
+    line_start = 0;
+    scan_index = 0;
+    status_code = 0;
+    status_text = {};
+    protocol = {};
+    header_entries = 0;
+    for(field &known : known_headers) {
+        known = {};
+    }
+    content_length = -1;
+    chunked = false;
+    encoding = content_encoding::identity;
+    type = content_type::text;
 }
 
 void http_response::clear() {
@@ -79,21 +222,39 @@ void http_response::clear() {
     status_code = 0;
     state = parse_state::status_line;
     status_text = {};
-    body = {};
     protocol = {};
     index = 0;
+    body_start = 0;
+    head_request = false;
+    cached = false;
+    line_start = 0;
+    scan_index = 0;
+    content_length = -1;
+    body_received = 0;
+    excess = 0;
+    chunked = false;
+    encoding = content_encoding::identity;
+    chunk = chunk_state::size;
+    chunk_remaining = 0;
+    trailer_length = 0;
+    chunk_digits = 0;
 #ifndef HTTP_STATIC_SIZE
     if(capacity > HTTP_DEFAULT_CAPACITY) {
+        // Only an unusually large head grows the buffer, so it is not kept
         capacity = HTTP_DEFAULT_CAPACITY;
         data = (uint8_t*)realloc(data, capacity);
         if(data == nullptr) {
             error1("http_response::clear: failed to reallocate data\n");
             panic("http_response::clear: failed to reallocate data\n");
         }
-        memset(data, 0, capacity);
     }
 #endif
-    headers.clear();
+    release_body();
+    buffer_pool::shared().settle();
+    header_entries = 0;
+    for(field &known : known_headers) {
+        known = {};
+    }
     trace1("http_response::clear exited\n");
 }
 
@@ -105,51 +266,61 @@ void http_response::parse_line(std::string_view line) {
         debug1("Parsing status line\n");
         // First find the protocol, which is from the beginning to the first space
         token_end = line.find(" ");
-        protocol = {line.begin(), token_end};
-        debug("    Protocol: %s\n", std::string(protocol).c_str());
+        if(token_end == std::string_view::npos) {
+            error1("http_response: malformed status line\n");
+            state = parse_state::failed;
+            break;
+        }
+        protocol = to_field(line.substr(0, token_end));
+        debug("    Protocol: %s\n", std::string(view(protocol)).c_str());
 
         // Then parse the status code, 1 character after the first space to the second space
-        //   std::from_chars converts it to an integer
+        //   std::from_chars converts it to an integer. The reason phrase may be missing entirely
         token_start = token_end + 1;
-        token_end = line.find(" ", token_start);
+        token_end = std::min(line.find(" ", token_start), line.size());
         std::from_chars(line.begin() + token_start, line.begin() + token_end, status_code);
         debug("    status code: %d\n", status_code);
 
         // Then the status text is the rest of the line
-        token_start = token_end + 1;
-        status_text = {line.begin() + token_start, line.end()};
-        debug("    status text: %s\n", std::string(status_text).c_str());
+        token_start = std::min(token_end + 1, line.size());
+        status_text = to_field(line.substr(token_start));
+        debug("    status text: %s\n", std::string(view(status_text)).c_str());
         state = parse_state::headers;
         break;
     case parse_state::headers:{
         debug1("Parsing header\n");
         if(line.size() == 0) {
-            debug("Empty header, transition to %s\n", only_parse_headers() ? "body" : "done");
+            if(status_code / 100 == 1 && status_code != 101) {
+                // 100 Continue, 103 Early Hints and the like come ahead of the real response
+                debug("http_response: skipping interim %d response\n", status_code);
+                state = parse_state::status_line;
+                break;
+            }
+            debug("Empty header, transition to %s\n", only_parse_headers() ? "done" : "body");
             if(only_parse_headers()) {
                 state = parse_state::done;
             } else {
                 state = parse_state::body;
-                body_start = (uint32_t)line.end() - (uint32_t)data + 2;
+                body_start = scan_index;
+                if(compressed() && !start_decoder()) {
+                    state = parse_state::failed;
+                }
             }
             break;
         }
-        token_end = line.find(": ");
-        std::string key(line.begin(), token_end);
-        std::string_view value(line.begin() + token_end + 2, line.end());
-        debug("        %s: %s\n", key.c_str(), std::string(value).c_str());
-        headers[key] = value;
-        if(iequals(key, "Content-Length")) {
-            std::from_chars(line.begin() + token_end + 2, line.end(), content_length);
-        }
-        if(iequals(key, "Content-Type")) {
-            if(iequals(value, "application/json")) {
-                type = content_type::json;
-            } else if(value.starts_with("text/")) {
-                type = content_type::text;
-            } else {
-                type = content_type::binary;
-            }
+        token_end = line.find(":");
+        if(token_end == std::string_view::npos) {
+            warn("http_response: skipping header line without a colon (%d bytes)\n", line.size());
+            break;
+        }
+        token_start = token_end + 1;
+        while(token_start < line.size() && (line[token_start] == ' ' || line[token_start] == '\t')) {
+            token_start++;
         }
+        std::string_view key = line.substr(0, token_end);
+        std::string_view value = line.substr(token_start);
+        debug("        %.*s: %.*s\n", key.size(), key.data(), value.size(), value.data());
+        add_header(key, value);
         break;
     }
     case parse_state::body:
@@ -158,12 +329,7 @@ void http_response::parse_line(std::string_view line) {
         } else {
             debug("Parsing body:\n(binary length %d)\n", line.size());
         }
-        body = {(char*)data + body_start, (char*)data + index};
-        debug("Body has size %d/%d\n", body.size(), content_length);
-        if(body.size() == content_length) {
-            debug1("Transition to done\n");
-            state = parse_state::done;
-        }
+        parse_body();
         break;
     default:
         error1("Shouldn't happen? parse_state == done\n");
@@ -172,39 +338,178 @@ void http_response::parse_line(std::string_view line) {
     trace1("http_response::parse_line exited\n");
 }
 
-const std::map<std::string, std::string_view>& http_response::get_headers() const {
-    return headers;
+void http_response::add_header(std::string_view name, std::string_view value) {
+    uint32_t hash = header_hash(name);
+    if(header_entries < HTTP_MAX_HEADERS) {
+        field name_field = to_field(name), value_field = to_field(value);
+        header_table[header_entries++] = {
+            hash,
+            (uint16_t)name_field.offset, (uint16_t)name_field.length,
+            (uint16_t)value_field.offset, (uint16_t)value_field.length
+        };
+    } else {
+        warn("http_response: header table full, dropping %.*s\n", name.size(), name.data());
+    }
+
+    // Known headers are recorded and acted on even if the table overflowed
+    known_header which;
+    switch(hash) {
+    case header_hash("content-length"):
+        which = known_header::content_length;
+        break;
+    case header_hash("content-type"):
+        which = known_header::content_type;
+        break;
+    case header_hash("transfer-encoding"):
+        which = known_header::transfer_encoding;
+        break;
+    case header_hash("connection"):
+        which = known_header::connection;
+        break;
+    case header_hash("content-encoding"):
+        which = known_header::content_encoding;
+        break;
+    default:
+        return;
+    }
+    // The hash only narrows it down, any name can be made to collide with these
+    if(!iequals(name, known_header_names[(size_t)which])) {
+        return;
+    }
+    known_headers[(size_t)which] = to_field(value);
+    switch(which) {
+    case known_header::content_length:
+        std::from_chars(value.begin(), value.end(), content_length);
+        break;
+    case known_header::transfer_encoding:
+        // chunked is always the last coding applied when present
+        chunked = value.size() >= 7 && iequals(value.substr(value.size() - 7), "chunked");
+        break;
+    case known_header::content_type:
+        if(iequals(value.substr(0, 16), "application/json")) {
+            type = content_type::json;
+        } else if(value.starts_with("text/")) {
+            type = content_type::text;
+        } else {
+            type = content_type::binary;
+        }
+        break;
+    case known_header::content_encoding:
+        if(iequals(value, "gzip") || iequals(value, "x-gzip")) {
+            encoding = content_encoding::gzip;
+        } else if(iequals(value, "deflate")) {
+            encoding = content_encoding::deflate;
+        } else if(!iequals(value, "identity")) {
+            warn("http_response: unsupported Content-Encoding '%.*s', body is left encoded\n", value.size(), value.data());
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+std::string_view http_response::header(std::string_view name) const {
+    uint32_t hash = header_hash(name);
+    for(size_t i = header_entries; i-- > 0;) {
+        if(header_table[i].hash == hash && iequals(header_name(i), name)) {
+            return header_value(i);
+        }
+    }
+    return {};
+}
+
+std::string_view http_response::header(known_header which) const {
+    return view(known_headers[(size_t)which]);
+}
+
+std::string_view http_response::header_name(size_t i) const {
+    return {(char*)data + header_table[i].name_offset, header_table[i].name_length};
+}
+
+std::string_view http_response::header_value(size_t i) const {
+    return {(char*)data + header_table[i].value_offset, header_table[i].value_length};
 }
 
 uint16_t http_response::status() const {
     return status_code;
 }
 
-const std::string_view &http_response::get_status_text() const {
-    return status_text;
+std::string_view http_response::get_status_text() const {
+    return view(status_text);
+}
+
+std::string_view http_response::get_protocol() const {
+    return view(protocol);
+}
+
+std::string_view http_response::get_body() const {
+    if(streaming() || body_head == nullptr) {
+        return {};
+    }
+    if(body_head->next == nullptr) {
+        return {(char*)body_head->data, body_head->used};
+    }
+    if(flat == nullptr) {
+#ifdef HTTP_STATIC_SIZE
+        // The head buffer is fixed anyway and only the head is in it
+        if(index + buffered > capacity) {
+            error("http_response::get_body: %d byte body does not fit after the head, see HTTP_DEFAULT_CAPACITY\n", buffered);
+            return {};
+        }
+        flat = const_cast<uint8_t*>(data) + index;
+#else
+        flat = (uint8_t*)malloc(buffered);
+        if(flat == nullptr) {
+            error("http_response::get_body: could not allocate %d bytes\n", buffered);
+            return {};
+        }
+#endif
+        uint32_t offset = 0;
+        for(const buffer_block *block = body_head; block; block = block->next) {
+            memcpy(flat + offset, block->data, block->used);
+            offset += block->used;
+        }
+    }
+    return {(char*)flat, buffered};
+}
+
+void http_response::visit_body(inplace_function<void(std::span<const uint8_t>)> visitor) const {
+    for(const buffer_block *block = body_head; block; block = block->next) {
+        visitor({block->data, block->used});
+    }
+}
+
+bool http_response::complete_at_close() {
+    if(state != parse_state::body || chunked || content_length >= 0) {
+        return false;
+    }
+    debug("Connection closed, body has size %d\n", streaming() ? body_received : buffered);
+    state = parse_state::done;
+    return true;
 }
 
-const std::string_view &http_response::get_protocol() const {
-    return protocol;
+std::string_view http_response::view(field f) const {
+    return {(char*)data + f.offset, f.length};
 }
 
-const std::string_view &http_response::get_body() const {
-    return body;
+http_response::field http_response::to_field(std::string_view text) const {
+    return {(uint32_t)(text.data() - (char*)data), (uint32_t)text.size()};
 }
 
-void http_response::add_data(std::span<uint8_t> data) {
+void http_response::add_data(std::span<const uint8_t> data) {
     trace("http_response::add_data entered with data of size %d\n", data.size());
     if(index + data.size() >= capacity) {
 #ifdef HTTP_STATIC_SIZE
         error("http_response: Cannot add data of length %d - would exceed static capacity of %d\n", data.size(), capacity);
         return;
 #else
-        this->data = (uint8_t*)realloc(this->data, index + data.size() + 512);
+        uint32_t grown = std::max(capacity * 2, (uint32_t)(index + data.size() + 1));
+        this->data = (uint8_t*)realloc(this->data, grown);
         if(this->data == nullptr) {
-            error("http_response::add_data: reallocating data to size %d failed!\n", index + data.size() + 512);
-            panic("http_response::add_data: reallocating data to size %d failed!\n", index + data.size() + 512);
+            error("http_response::add_data: reallocating data to size %d failed!\n", grown);
+            panic("http_response::add_data: reallocating data to size %d failed!\n", grown);
         }
-        capacity = index + data.size() + 512;
+        capacity = grown;
 #endif
     }
     memcpy(this->data + index, data.data(), data.size());
@@ -212,6 +517,201 @@ void http_response::add_data(std::span<uint8_t> data) {
     trace1("http_response::add_data exited\n");
 }
 
+void http_response::parse_body() {
+    // Hand over whatever arrived along with the headers and drop it from the head buffer
+    uint32_t length = index - body_start;
+    index = body_start;
+    if(length == 0) {
+        return;
+    }
+    excess = length - (chunked ? decode_chunked({data + body_start, length}) : deliver_body({data + body_start, length}));
+}
+
+size_t http_response::deliver_body(std::span<const uint8_t> chunk) {
+    if(content_length >= 0 && body_received + chunk.size() > (uint32_t)content_length) {
+        chunk = chunk.first(content_length - body_received);
+    }
+    body_received += chunk.size();
+    debug("Streaming %d body bytes (%d/%d)\n", chunk.size(), body_received, content_length);
+    if(chunk.size() > 0) {
+        emit_content(chunk);
+    }
+    if(state == parse_state::body && content_length >= 0 && body_received == (uint32_t)content_length) {
+        debug1("Transition to done\n");
+        state = parse_state::done;
+    }
+    return chunk.size();
+}
+
+size_t http_response::decode_chunked(std::span<const uint8_t> raw) {
+    size_t i = 0;
+    while(i < raw.size() && state == parse_state::body) {
+        uint8_t c = raw[i];
+        switch(chunk) {
+        case chunk_state::size: {
+            int digit = c >= '0' && c <= '9' ? c - '0'
+                      : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                      : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                      : -1;
+            if(digit >= 0 && chunk_remaining <= 0x0FFFFFFF) {
+                chunk_remaining = chunk_remaining * 16 + digit;
+                chunk_digits++;
+            } else if(c == ';' || c == ' ' || c == '\t') {
+                chunk = chunk_state::extension;
+            } else if(c == '\n') {
+                end_chunk_size_line();
+            } else if(c != '\r') {
+                error("http_response: invalid chunk size byte 0x%02x\n", c);
+                state = parse_state::failed;
+            }
+            i++;
+            break;
+        }
+        case chunk_state::extension:
+            // Chunk extensions are ignored
+            if(c == '\n') {
+                end_chunk_size_line();
+            }
+            i++;
+            break;
+        case chunk_state::data: {
+            size_t count = std::min((size_t)chunk_remaining, raw.size() - i);
+            emit_chunk_data(raw.subspan(i, count));
+            chunk_remaining -= count;
+            i += count;
+            if(chunk_remaining == 0) {
+                chunk = chunk_state::data_end;
+            }
+            break;
+        }
+        case chunk_state::data_end:
+            if(c == '\n') {
+                chunk = chunk_state::size;
+            } else if(c != '\r') {
+                error("http_response: missing CRLF after chunk, got 0x%02x\n", c);
+                state = parse_state::failed;
+            }
+            i++;
+            break;
+        case chunk_state::trailer:
+            // Trailer fields are skipped, an empty line ends the body
+            if(c == '\n') {
+                if(trailer_length == 0) {
+                    debug("Last chunk received, body has size %d\n", body_received);
+                    state = parse_state::done;
+                }
+                trailer_length = 0;
+            } else if(c != '\r') {
+                trailer_length++;
+            }
+            i++;
+            break;
+        }
+    }
+    return i;
+}
+
+void http_response::end_chunk_size_line() {
+    if(chunk_digits == 0) {
+        error1("http_response: chunk size line without a size\n");
+        state = parse_state::failed;
+        return;
+    }
+    debug("Chunk of size %d\n", chunk_remaining);
+    chunk = chunk_remaining == 0 ? chunk_state::trailer : chunk_state::data;
+    chunk_digits = 0;
+    trailer_length = 0;
+}
+
+void http_response::emit_chunk_data(std::span<const uint8_t> payload) {
+    emit_content(payload);
+    body_received += payload.size();
+}
+
+void http_response::emit_content(std::span<const uint8_t> content) {
+    if(!compressed()) {
+        emit_decoded(content);
+        return;
+    }
+    inflater::status result = decoder->feed(content, [this](std::span<const uint8_t> decoded){ emit_decoded(decoded); });
+    if(result == inflater::status::error) {
+        error1("http_response: could not decompress body\n");
+        state = parse_state::failed;
+    }
+}
+
+void http_response::emit_decoded(std::span<const uint8_t> decoded) {
+    if(streaming()) {
+        body_callback(decoded);
+    } else {
+        append_body(decoded);
+    }
+}
+
+void http_response::append_body(std::span<const uint8_t> bytes) {
+    while(!bytes.empty()) {
+        if(body_tail == nullptr || body_tail->used == HTTP_BUFFER_BLOCK_SIZE) {
+            buffer_block *block = buffer_pool::shared().acquire();
+            if(block == nullptr) {
+                error("http_response: no buffer for the body after %d bytes\n", buffered);
+                state = parse_state::failed;
+                return;
+            }
+            if(body_tail) {
+                body_tail->next = block;
+            } else {
+                body_head = block;
+            }
+            body_tail = block;
+        }
+        size_t count = std::min(bytes.size(), (size_t)(HTTP_BUFFER_BLOCK_SIZE - body_tail->used));
+        memcpy(body_tail->data + body_tail->used, bytes.data(), count);
+        body_tail->used += count;
+        buffered += count;
+        bytes = bytes.subspan(count);
+    }
+}
+
+void http_response::release_body() {
+    buffer_pool::shared().release(body_head);
+    body_head = nullptr;
+    body_tail = nullptr;
+    buffered = 0;
+#ifndef HTTP_STATIC_SIZE
+    free(flat);
+#endif
+    flat = nullptr;
+}
+
+void http_response::serve_cached(uint16_t status, std::span<const uint8_t> body) {
+    debug("http_response: 304, serving %d cached bytes\n", body.size());
+    status_code = status;
+    cached = true;
+    body_start = index;
+    release_body();
+    if(streaming()) {
+        body_callback(body);
+    } else {
+        append_body(body);
+    }
+}
+
+bool http_response::start_decoder() {
+    if(decoder == nullptr) {
+        decoder = new inflater();
+    }
+    debug("http_response: decompressing %s body\n", encoding == content_encoding::gzip ? "gzip" : "deflate");
+    return decoder->reset(encoding == content_encoding::gzip ? inflater::format::gzip : inflater::format::zlib);
+}
+
 bool http_response::only_parse_headers() {
-    return content_length <= 0 || request != nullptr && request->method() == "HEAD";
+    if(head_request || (request != nullptr && request->method() == "HEAD")) {
+        return true;
+    }
+    // Other 1xx responses never get here, parse_line skips them
+    if(status_code == 101 || status_code == 204 || status_code == 304) {
+        return true;
+    }
+    // Without Content-Length or chunked encoding the body is read until the connection closes
+    return !chunked && content_length == 0;
 }
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include "http_scheduler.h"
+
+#include <algorithm>
+
+#include "LUrlParser.h"
+#include "logger.h"
+
+static void split_url(const LUrlParser::ParseURL &parsed, std::string &origin, std::string &target) {
+    origin = parsed.scheme_ + "://" + parsed.host_;
+    if(parsed.port_.size() > 0) {
+        origin += ":" + parsed.port_;
+    }
+    // Scheme and host are case insensitive, so "HTTP://Example.com" shares connections and single flight with "http://example.com"
+    std::transform(origin.begin(), origin.end(), origin.begin(), ::tolower);
+    target = "/" + parsed.path_;
+    if(parsed.query_.size() > 0) {
+        target += "?" + parsed.query_;
+    }
+}
+
+http_scheduler::http_scheduler(std::span<uint8_t> cert)
+    : http_scheduler([](uint8_t){ return (tcp_base*)nullptr; }, cert)
+{
+}
+
+http_scheduler::http_scheduler(inplace_function<tcp_base*(uint8_t index)> transports, std::span<uint8_t> cert)
+    : m_cert(cert)
+    , m_transports(transports)
+    , m_sequence(0)
+    , m_timeout_ms(0)
+    , m_schedule_alarm(0)
+{
+    for(pending &request : m_queue) {
+        request.used = false;
+        request.dispatched = false;
+        request.leader = -1;
+        request.joinable = false;
+    }
+    for(connection &conn : m_connections) {
+        conn.client = nullptr;
+        conn.request = -1;
+    }
+}
+
+http_scheduler::~http_scheduler() {
+    trace1("http_scheduler dtor entered\n");
+    if(m_schedule_alarm != 0) {
+        cancel_alarm(m_schedule_alarm);
+        m_schedule_alarm = 0;
+    }
+    for(connection &conn : m_connections) {
+        if(conn.client) {
+            delete conn.client;
+            conn.client = nullptr;
+        }
+    }
+    trace1("http_scheduler dtor exited\n");
+}
+
+bool http_scheduler::submit(
+    std::string url,
+    inplace_function<void(const http_response&)> response_callback,
+    inplace_function<void(err_t)> error_callback,
+    std::string method,
+    std::string body,
+    uint8_t priority
+) {
+    trace("http_scheduler::submit entered with %.*s %.*s\n", method.size(), method.data(), url.size(), url.data());
+    LUrlParser::ParseURL parsed = LUrlParser::ParseURL::parseURL(url);
+    if(!parsed.isValid()) {
+        error("http_scheduler::submit: invalid url %.*s\n", url.size(), url.data());
+        return false;
+    }
+    pending *request = nullptr;
+    for(pending &slot : m_queue) {
+        if(!slot.used) {
+            request = &slot;
+            break;
+        }
+    }
+    if(request == nullptr) {
+        error("http_scheduler::submit: queue full, dropping %.*s\n", url.size(), url.data());
+        return false;
+    }
+
+    split_url(parsed, request->origin, request->target);
+    request->method = method;
+    request->body = body;
+    request->response_callback = response_callback;
+    request->error_callback = error_callback;
+    request->sequence = m_sequence++;
+    request->priority = priority;
+    request->redirects = 0;
+    request->leader = -1;
+    request->joinable = method == "GET" && body.empty();
+    request->used = true;
+    request->dispatched = false;
+    if(m_single_flight && request->joinable) {
+        for(int8_t i = 0; i < HTTP_SCHEDULER_QUEUE_SIZE; i++) {
+            pending &leader = m_queue[i];
+            if(&leader != request && leader.used && leader.joinable && leader.origin == request->origin && leader.target == request->target) {
+                debug("http_scheduler: %.*s joins the request already %s\n", url.size(), url.data(), leader.dispatched ? "in flight" : "queued");
+                request->leader = i;
+                request->joinable = false;
+                leader.priority = std::max(leader.priority, priority);
+                return true;
+            }
+        }
+    }
+    schedule_soon();
+    return true;
+}
+
+void http_scheduler::set_timeout(uint32_t timeout_ms) {
+    m_timeout_ms = timeout_ms;
+    for(connection &conn : m_connections) {
+        if(conn.client) {
+            conn.client->set_timeout(timeout_ms);
+        }
+    }
+}
+
+size_t http_scheduler::queued() const {
+    size_t count = 0;
+    for(const pending &request : m_queue) {
+        // A request that joined another shares its state
+        count += request.used && !(request.leader == -1 ? request : m_queue[request.leader]).dispatched;
+    }
+    return count;
+}
+
+size_t http_scheduler::in_flight() const {
+    size_t count = 0;
+    for(const pending &request : m_queue) {
+        count += request.used && (request.leader == -1 ? request : m_queue[request.leader]).dispatched;
+    }
+    return count;
+}
+
+void http_scheduler::schedule() {
+    trace1("http_scheduler::schedule entered\n");
+    // Requests that cannot go out yet are skipped so they do not block other hosts
+    bool blocked[HTTP_SCHEDULER_QUEUE_SIZE] = {};
+    while(true) {
+        int8_t best = -1;
+        for(int8_t i = 0; i < HTTP_SCHEDULER_QUEUE_SIZE; i++) {
+            const pending &request = m_queue[i];
+            if(!request.used || request.dispatched || request.leader != -1 || blocked[i]) {
+                continue;
+            }
+            if(best == -1 || request.priority > m_queue[best].priority
+                || (request.priority == m_queue[best].priority && (int32_t)(request.sequence - m_queue[best].sequence) < 0)) {
+                best = i;
+            }
+        }
+        if(best == -1) {
+            break;
+        }
+        int8_t index = connection_for(m_queue[best].origin);
+        if(index == -1) {
+            blocked[best] = true;
+            continue;
+        }
+        dispatch(index, best);
+    }
+    trace1("http_scheduler::schedule exited\n");
+}
+
+void http_scheduler::schedule_soon() {
+    // Scheduling from inside a client's callbacks could retarget or reuse that
+    // client while it is still running, so it always happens from an alarm
+    if(m_schedule_alarm == 0) {
+        m_schedule_alarm = add_alarm_in_ms(1, schedule_alarm_callback, this, true);
+    }
+}
+
+int8_t http_scheduler::connection_for(const std::string &origin) const {
+    int8_t empty = -1, other = -1;
+    for(int8_t i = 0; i < HTTP_SCHEDULER_MAX_CONNECTIONS; i++) {
+        const connection &conn = m_connections[i];
+        if(conn.client == nullptr) {
+            if(empty == -1) {
+                empty = i;
+            }
+        } else if(conn.request == -1) {
+            if(conn.origin == origin) {
+                // An idle connection to the same host, probably still open
+                return i;
+            }
+            if(other == -1) {
+                other = i;
+            }
+        }
+    }
+    if(connections_to(origin) >= HTTP_SCHEDULER_MAX_PER_HOST) {
+        return -1;
+    }
+    return empty != -1 ? empty : other;
+}
+
+uint8_t http_scheduler::connections_to(const std::string &origin) const {
+    uint8_t count = 0;
+    for(const connection &conn : m_connections) {
+        count += conn.client != nullptr && conn.origin == origin;
+    }
+    return count;
+}
+
+void http_scheduler::dispatch(uint8_t index, int8_t request_index) {
+    connection &conn = m_connections[index];
+    pending &request = m_queue[request_index];
+    if(conn.client == nullptr) {
+        debug("http_scheduler: opening connection %d to %s\n", index, request.origin.c_str());
+        tcp_base *transport = m_transports(index);
+        conn.client = transport ? new http_client(request.origin, transport, m_cert) : new http_client(request.origin, m_cert);
+        conn.client->set_timeout(m_timeout_ms);
+        conn.client->on_response([this, index](){ response_callback(index); });
+        conn.client->on_error([this, index](err_t err){ error_callback(index, err); });
+        conn.client->on_close([this, index](){ closed_callback(index); });
+        conn.client->on_redirect([this, index](const std::string &url, std::string_view method){ return redirect_callback(index, url, method); });
+    } else if(conn.origin != request.origin) {
+        debug("http_scheduler: moving connection %d from %s to %s\n", index, conn.origin.c_str(), request.origin.c_str());
+        // Closing the old connection fires on_close while the slot is idle, which is ignored
+        conn.client->url(request.origin);
+    }
+    conn.origin = request.origin;
+    conn.request = request_index;
+    request.dispatched = true;
+    info("http_scheduler: %s %s%s on connection %d\n", request.method.c_str(), request.origin.c_str(), request.target.c_str(), index);
+    conn.client->clear_error();
+    conn.client->follow_redirects(HTTP_MAX_REDIRECTS - request.redirects);
+    conn.client->send_request(request.method, request.target, request.body);
+    if(conn.client->has_error() && conn.request == request_index) {
+        // The transport could not even be set up, so no callback is coming
+        error_callback(index, ERR_CONN);
+    }
+}
+
+void http_scheduler::finish(uint8_t index) {
+    connection &conn = m_connections[index];
+    release(conn.request);
+    conn.request = -1;
+    schedule_soon();
+}
+
+void http_scheduler::release(int8_t request_index) {
+    pending &request = m_queue[request_index];
+    request.used = false;
+    request.dispatched = false;
+    request.leader = -1;
+    request.joinable = false;
+    request.response_callback = nullptr;
+    request.error_callback = nullptr;
+}
+
+uint8_t http_scheduler::take_followers(int8_t request_index, int8_t *followers) {
+    // Detached before any callback runs, so one that submits the same url again
+    // starts a new request rather than joining this finished one
+    m_queue[request_index].joinable = false;
+    uint8_t count = 0;
+    for(int8_t i = 0; i < HTTP_SCHEDULER_QUEUE_SIZE; i++) {
+        pending &request = m_queue[i];
+        if(request.used && request.leader == request_index) {
+            request.leader = -1;
+            // Keeps schedule() away from it until it is released
+            request.dispatched = true;
+            followers[count++] = i;
+        }
+    }
+    return count;
+}
+
+void http_scheduler::response_callback(uint8_t index) {
+    connection &conn = m_connections[index];
+    if(conn.request == -1) {
+        return;
+    }
+    debug("http_scheduler: connection %d got %d\n", index, conn.client->response().status());
+    int8_t followers[HTTP_SCHEDULER_QUEUE_SIZE];
+    uint8_t count = take_followers(conn.request, followers);
+    // Moved out first so the callback may submit into the freed slot
+    inplace_function<void(const http_response&)> callback = std::move(m_queue[conn.request].response_callback);
+    finish(index);
+    callback(conn.client->response());
+    for(uint8_t i = 0; i < count; i++) {
+        callback = std::move(m_queue[followers[i]].response_callback);
+        release(followers[i]);
+        callback(conn.client->response());
+    }
+}
+
+void http_scheduler::error_callback(uint8_t index, err_t err) {
+    connection &conn = m_connections[index];
+    if(conn.request == -1) {
+        return;
+    }
+    warn("http_scheduler: connection %d failed with %d\n", index, err);
+    int8_t followers[HTTP_SCHEDULER_QUEUE_SIZE];
+    uint8_t count = take_followers(conn.request, followers);
+    inplace_function<void(err_t)> callback = std::move(m_queue[conn.request].error_callback);
+    finish(index);
+    callback(err);
+    for(uint8_t i = 0; i < count; i++) {
+        callback = std::move(m_queue[followers[i]].error_callback);
+        release(followers[i]);
+        callback(err);
+    }
+}
+
+void http_scheduler::closed_callback(uint8_t index) {
+    // A close with a request still in flight means its response is not coming
+    if(m_connections[index].request != -1) {
+        error_callback(index, ERR_CLSD);
+    }
+}
+
+bool http_scheduler::redirect_callback(uint8_t index, const std::string &url, std::string_view method) {
+    connection &conn = m_connections[index];
+    if(conn.request == -1) {
+        return false;
+    }
+    pending &request = m_queue[conn.request];
+    split_url(LUrlParser::ParseURL::parseURL(url), request.origin, request.target);
+    if(method != request.method) {
+        request.method = method;
+        request.body.clear();
+    }
+    request.redirects += conn.client->redirects();
+    debug("http_scheduler: connection %d redirected to %s, requeueing\n", index, url.c_str());
+    // Keeps its place in the queue, and the connection stays open to its host for the next request
+    request.dispatched = false;
+    conn.request = -1;
+    schedule_soon();
+    return true;
+}
+
+int64_t http_scheduler::schedule_alarm_callback(alarm_id_t, void* user_data) {
+    http_scheduler *scheduler = (http_scheduler*)user_data;
+    scheduler->m_schedule_alarm = 0;
+    scheduler->schedule();
+    // Do not reschedule the alarm
+    return 0;
+}
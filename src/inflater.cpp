@@ -0,0 +1,559 @@
+#include "inflater.h"
+
+#include <array>
+#include <stdlib.h>
+
+#include "logger.h"
+
+static constexpr uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static constexpr uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static constexpr uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static constexpr uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+// Order the code length code lengths are sent in
+static constexpr uint8_t code_length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static constexpr std::array<uint32_t, 256> crc32_table = [](){
+    std::array<uint32_t, 256> table{};
+    for(uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for(int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}();
+
+// gzip header flags
+#define GZIP_FHCRC 0x02
+#define GZIP_FEXTRA 0x04
+#define GZIP_FNAME 0x08
+#define GZIP_FCOMMENT 0x10
+
+// Builds the canonical code for n symbols with the given code lengths. Returns 0
+// for a complete code, a positive number for an incomplete one and a negative
+// number for an over-subscribed one
+static int construct(uint16_t *count, uint16_t *symbol, const uint8_t *lengths, int n) {
+    uint16_t offsets[16];
+    for(int len = 0; len < 16; len++) {
+        count[len] = 0;
+    }
+    for(int s = 0; s < n; s++) {
+        count[lengths[s]]++;
+    }
+    if(count[0] == n) {
+        return 0;
+    }
+    int left = 1;
+    for(int len = 1; len < 16; len++) {
+        left <<= 1;
+        left -= count[len];
+        if(left < 0) {
+            return left;
+        }
+    }
+    offsets[1] = 0;
+    for(int len = 1; len < 15; len++) {
+        offsets[len + 1] = offsets[len] + count[len];
+    }
+    for(int s = 0; s < n; s++) {
+        if(lengths[s] != 0) {
+            symbol[offsets[lengths[s]]++] = s;
+        }
+    }
+    return left;
+}
+
+inflater::inflater()
+    : m_window(nullptr)
+    , m_window_pos(0)
+    , m_flushed(0)
+    , m_total_out(0)
+    , m_check(0)
+    , m_bitbuf(0)
+    , m_in(nullptr)
+    , m_in_end(nullptr)
+    , m_sink(nullptr)
+    , m_bitcnt(0)
+    , m_format(format::raw)
+    , m_stage(stage::failed)
+    , m_last(false)
+    , m_flags(0)
+    , m_index(0)
+    , m_remaining(0)
+    , m_nlen(0)
+    , m_ndist(0)
+    , m_ncode(0)
+{}
+
+inflater::~inflater() {
+    if(m_window) {
+        free(m_window);
+    }
+}
+
+bool inflater::reset(format stream_format) {
+    if(m_window == nullptr) {
+        m_window = (uint8_t*)malloc(INFLATE_WINDOW_SIZE);
+        if(m_window == nullptr) {
+            error("inflater: could not allocate %d byte window\n", INFLATE_WINDOW_SIZE);
+            m_stage = stage::failed;
+            return false;
+        }
+    }
+    m_format = stream_format;
+    m_window_pos = 0;
+    m_flushed = 0;
+    m_total_out = 0;
+    m_check = stream_format == format::gzip ? 0xFFFFFFFF : 1;
+    m_bitbuf = 0;
+    m_bitcnt = 0;
+    m_last = false;
+    switch(stream_format) {
+    case format::gzip:
+        m_stage = stage::gzip_header;
+        break;
+    case format::zlib:
+        m_stage = stage::zlib_header;
+        break;
+    default:
+        m_stage = stage::block_header;
+        break;
+    }
+    return true;
+}
+
+inflater::status inflater::feed(std::span<const uint8_t> in, const inplace_function<void(std::span<const uint8_t>)> &sink) {
+    m_in = in.data();
+    m_in_end = in.data() + in.size();
+    m_sink = &sink;
+    while(step()) {}
+    flush();
+    m_sink = nullptr;
+    if(m_stage == stage::finished) {
+        return status::done;
+    }
+    return m_stage == stage::failed ? status::error : status::more;
+}
+
+void inflater::fill() {
+    while(m_bitcnt <= 56 && m_in < m_in_end) {
+        m_bitbuf |= (uint64_t)*m_in++ << m_bitcnt;
+        m_bitcnt += 8;
+    }
+}
+
+bool inflater::need(uint8_t count) {
+    fill();
+    return m_bitcnt >= count;
+}
+
+uint32_t inflater::bits(uint8_t count) {
+    uint32_t value = m_bitbuf & ((1ull << count) - 1);
+    m_bitbuf >>= count;
+    m_bitcnt -= count;
+    return value;
+}
+
+void inflater::put(uint8_t byte) {
+    m_window[m_window_pos] = byte;
+    m_window_pos = (m_window_pos + 1) & (INFLATE_WINDOW_SIZE - 1);
+    m_total_out++;
+    if(m_format == format::gzip) {
+        m_check = crc32_table[(m_check ^ byte) & 0xFF] ^ (m_check >> 8);
+    } else if(m_format == format::zlib) {
+        // Adler-32, reduced every byte to keep it simple
+        uint32_t a = ((m_check & 0xFFFF) + byte) % 65521;
+        uint32_t b = ((m_check >> 16) + a) % 65521;
+        m_check = (b << 16) | a;
+    }
+    if(m_window_pos == 0) {
+        // Wrapped, so hand over the end of the window before it is overwritten
+        (*m_sink)({m_window + m_flushed, INFLATE_WINDOW_SIZE - m_flushed});
+        m_flushed = 0;
+    }
+}
+
+void inflater::flush() {
+    if(m_window_pos > m_flushed && m_sink) {
+        (*m_sink)({m_window + m_flushed, m_window_pos - m_flushed});
+        m_flushed = m_window_pos;
+    }
+}
+
+bool inflater::fail(const char *reason) {
+    error("inflater: %s\n", reason);
+    m_stage = stage::failed;
+    return false;
+}
+
+// Decodes the symbol starting skip bits into the bit buffer without consuming
+// it. Returns -1 if more input is needed and -2 for an invalid code
+int inflater::decode(const huffman &code, uint8_t skip, uint8_t &used) const {
+    int value = 0, first = 0, index = 0;
+    for(uint8_t len = 1; len < 16; len++) {
+        if(skip + len > m_bitcnt) {
+            return -1;
+        }
+        value |= (m_bitbuf >> (skip + len - 1)) & 1;
+        int count = code.count[len];
+        if(value - count < first) {
+            used = len;
+            return code.symbol[index + (value - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        value <<= 1;
+    }
+    return -2;
+}
+
+bool inflater::build_fixed() {
+    for(int s = 0; s < 144; s++) {
+        m_lengths[s] = 8;
+    }
+    for(int s = 144; s < 256; s++) {
+        m_lengths[s] = 9;
+    }
+    for(int s = 256; s < 280; s++) {
+        m_lengths[s] = 7;
+    }
+    for(int s = 280; s < 288; s++) {
+        m_lengths[s] = 8;
+    }
+    construct(m_len_count, m_len_symbol, m_lengths, 288);
+    for(int s = 0; s < 30; s++) {
+        m_lengths[s] = 5;
+    }
+    construct(m_dist_count, m_dist_symbol, m_lengths, 30);
+    return true;
+}
+
+bool inflater::build_dynamic() {
+    if(m_lengths[256] == 0) {
+        return fail("no end of block code");
+    }
+    int err = construct(m_len_count, m_len_symbol, m_lengths, m_nlen);
+    // An incomplete code is only allowed for a single length
+    if(err < 0 || (err > 0 && m_nlen - m_len_count[0] != 1)) {
+        return fail("bad literal/length code");
+    }
+    err = construct(m_dist_count, m_dist_symbol, m_lengths + m_nlen, m_ndist);
+    if(err < 0 || (err > 0 && m_ndist - m_dist_count[0] != 1)) {
+        return fail("bad distance code");
+    }
+    return true;
+}
+
+// Runs one step of the decoder. Returns false when it needs more input or the stream has ended
+bool inflater::step() {
+    switch(m_stage) {
+    case stage::gzip_header:
+        if(!need(32)) {
+            return false;
+        }
+        if(bits(8) != 0x1F || bits(8) != 0x8B || bits(8) != 8) {
+            return fail("not a gzip stream");
+        }
+        m_flags = bits(8);
+        m_stage = stage::gzip_fixed;
+        return true;
+    case stage::gzip_fixed:
+        // MTIME, XFL and OS
+        if(!need(48)) {
+            return false;
+        }
+        bits(24);
+        bits(24);
+        m_stage = stage::gzip_extra_length;
+        return true;
+    case stage::gzip_extra_length:
+        if(m_flags & GZIP_FEXTRA) {
+            if(!need(16)) {
+                return false;
+            }
+            m_remaining = bits(16);
+        } else {
+            m_remaining = 0;
+        }
+        m_stage = stage::gzip_extra;
+        return true;
+    case stage::gzip_extra:
+        while(m_remaining > 0) {
+            if(!need(8)) {
+                return false;
+            }
+            bits(8);
+            m_remaining--;
+        }
+        m_stage = stage::gzip_name;
+        return true;
+    case stage::gzip_name:
+    case stage::gzip_comment:
+        if(m_flags & (m_stage == stage::gzip_name ? GZIP_FNAME : GZIP_FCOMMENT)) {
+            // Zero-terminated
+            while(true) {
+                if(!need(8)) {
+                    return false;
+                }
+                if(bits(8) == 0) {
+                    break;
+                }
+            }
+        }
+        m_stage = m_stage == stage::gzip_name ? stage::gzip_comment : stage::gzip_header_crc;
+        return true;
+    case stage::gzip_header_crc:
+        if(m_flags & GZIP_FHCRC) {
+            if(!need(16)) {
+                return false;
+            }
+            bits(16);
+        }
+        m_stage = stage::block_header;
+        return true;
+    case stage::zlib_header: {
+        if(!need(16)) {
+            return false;
+        }
+        uint32_t cmf = m_bitbuf & 0xFF, flg = (m_bitbuf >> 8) & 0xFF;
+        if((cmf & 0x0F) != 8 || (cmf * 256 + flg) % 31 != 0) {
+            // Some servers send raw deflate for Content-Encoding: deflate
+            debug1("inflater: no zlib header, decoding raw deflate\n");
+            m_format = format::raw;
+            m_stage = stage::block_header;
+            return true;
+        }
+        if((cmf >> 4) + 8 > INFLATE_WINDOW_BITS) {
+            return fail("stream window is larger than INFLATE_WINDOW_BITS");
+        }
+        if(flg & 0x20) {
+            return fail("preset dictionaries are not supported");
+        }
+        bits(16);
+        m_stage = stage::block_header;
+        return true;
+    }
+    case stage::block_header: {
+        if(!need(3)) {
+            return false;
+        }
+        m_last = bits(1);
+        uint32_t type = bits(2);
+        if(type == 0) {
+            // Stored blocks start on a byte boundary
+            bits(m_bitcnt & 7);
+            m_stage = stage::stored_length;
+        } else if(type == 1) {
+            build_fixed();
+            m_stage = stage::codes;
+        } else if(type == 2) {
+            m_stage = stage::table_sizes;
+        } else {
+            return fail("invalid block type");
+        }
+        return true;
+    }
+    case stage::stored_length: {
+        if(!need(32)) {
+            return false;
+        }
+        uint32_t length = bits(16);
+        if((bits(16) ^ 0xFFFF) != length) {
+            return fail("stored block length check failed");
+        }
+        m_remaining = length;
+        m_stage = stage::stored_copy;
+        return true;
+    }
+    case stage::stored_copy:
+        while(m_remaining > 0) {
+            // Bytes already pulled into the bit buffer come first
+            if(m_bitcnt >= 8) {
+                put(bits(8));
+            } else if(m_in < m_in_end) {
+                put(*m_in++);
+            } else {
+                return false;
+            }
+            m_remaining--;
+        }
+        m_stage = m_last ? stage::trailer : stage::block_header;
+        return true;
+    case stage::table_sizes:
+        if(!need(14)) {
+            return false;
+        }
+        m_nlen = bits(5) + 257;
+        m_ndist = bits(5) + 1;
+        m_ncode = bits(4) + 4;
+        if(m_nlen > 286 || m_ndist > 30) {
+            return fail("bad table sizes");
+        }
+        m_index = 0;
+        m_stage = stage::code_length_codes;
+        return true;
+    case stage::code_length_codes:
+        while(m_index < m_ncode) {
+            if(!need(3)) {
+                return false;
+            }
+            m_lengths[code_length_order[m_index++]] = bits(3);
+        }
+        for(; m_index < 19; m_index++) {
+            m_lengths[code_length_order[m_index]] = 0;
+        }
+        // The code length code goes in the distance tables until they are built
+        if(construct(m_dist_count, m_dist_symbol, m_lengths, 19) != 0) {
+            return fail("bad code length code");
+        }
+        m_index = 0;
+        m_stage = stage::code_lengths;
+        return true;
+    case stage::code_lengths: {
+        huffman code = {m_dist_count, m_dist_symbol};
+        while(m_index < m_nlen + m_ndist) {
+            fill();
+            uint8_t used;
+            int symbol = decode(code, 0, used);
+            if(symbol == -1) {
+                return false;
+            }
+            if(symbol < 0) {
+                return fail("bad code length");
+            }
+            if(symbol < 16) {
+                bits(used);
+                m_lengths[m_index++] = symbol;
+                continue;
+            }
+            uint8_t extra = symbol == 16 ? 2 : symbol == 17 ? 3 : 7;
+            if(m_bitcnt < used + extra) {
+                return false;
+            }
+            bits(used);
+            uint8_t length = 0;
+            uint32_t repeat;
+            if(symbol == 16) {
+                if(m_index == 0) {
+                    return fail("repeat with no previous length");
+                }
+                length = m_lengths[m_index - 1];
+                repeat = 3 + bits(2);
+            } else if(symbol == 17) {
+                repeat = 3 + bits(3);
+            } else {
+                repeat = 11 + bits(7);
+            }
+            if(m_index + repeat > m_nlen + m_ndist) {
+                return fail("too many code lengths");
+            }
+            while(repeat--) {
+                m_lengths[m_index++] = length;
+            }
+        }
+        if(!build_dynamic()) {
+            return false;
+        }
+        m_stage = stage::codes;
+        return true;
+    }
+    case stage::codes: {
+        huffman lencode = {m_len_count, m_len_symbol}, distcode = {m_dist_count, m_dist_symbol};
+        while(true) {
+            // A whole length/distance pair is decoded before any of it is consumed, at most 48 bits
+            fill();
+            uint8_t used;
+            int symbol = decode(lencode, 0, used);
+            if(symbol == -1) {
+                return false;
+            }
+            if(symbol < 0) {
+                return fail("bad literal/length code");
+            }
+            if(symbol < 256) {
+                bits(used);
+                put(symbol);
+                continue;
+            }
+            if(symbol == 256) {
+                bits(used);
+                m_stage = m_last ? stage::trailer : stage::block_header;
+                return true;
+            }
+            symbol -= 257;
+            if(symbol >= 29) {
+                return fail("bad length symbol");
+            }
+            uint8_t skip = used + length_extra[symbol];
+            if(m_bitcnt < skip) {
+                return false;
+            }
+            uint32_t length = length_base[symbol] + ((m_bitbuf >> used) & ((1u << length_extra[symbol]) - 1));
+            uint8_t dist_used;
+            int dist_symbol = decode(distcode, skip, dist_used);
+            if(dist_symbol == -1) {
+                return false;
+            }
+            if(dist_symbol < 0 || dist_symbol >= 30) {
+                return fail("bad distance code");
+            }
+            uint8_t total = skip + dist_used + dist_extra[dist_symbol];
+            if(m_bitcnt < total) {
+                return false;
+            }
+            uint32_t distance = dist_base[dist_symbol] + ((m_bitbuf >> (skip + dist_used)) & ((1u << dist_extra[dist_symbol]) - 1));
+            bits(total);
+            if(distance > m_total_out || distance > INFLATE_WINDOW_SIZE) {
+                return fail("distance too far back");
+            }
+            while(length--) {
+                put(m_window[(m_window_pos - distance) & (INFLATE_WINDOW_SIZE - 1)]);
+            }
+        }
+    }
+    case stage::trailer:
+        if(m_format == format::raw) {
+            m_stage = stage::finished;
+            return false;
+        }
+        bits(m_bitcnt & 7);
+        if(m_format == format::gzip) {
+            if(!need(64)) {
+                return false;
+            }
+            uint32_t crc = bits(32), size = bits(32);
+            if(crc != (m_check ^ 0xFFFFFFFF) || size != m_total_out) {
+                return fail("gzip trailer mismatch");
+            }
+        } else {
+            if(!need(32)) {
+                return false;
+            }
+            uint32_t adler = bits(32);
+            adler = (adler >> 24) | ((adler >> 8) & 0xFF00) | ((adler << 8) & 0xFF0000) | (adler << 24);
+            if(adler != m_check) {
+                return fail("zlib checksum mismatch");
+            }
+        }
+        m_stage = stage::finished;
+        return false;
+    default:
+        return false;
+    }
+}
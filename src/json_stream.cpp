@@ -0,0 +1,376 @@
+#include "json_stream.h"
+
+#include <charconv>
+#include <string.h>
+
+#include "logger.h"
+
+static bool whitespace(uint8_t c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int hex_digit(uint8_t c) {
+    return c >= '0' && c <= '9' ? c - '0'
+         : c >= 'a' && c <= 'f' ? c - 'a' + 10
+         : c >= 'A' && c <= 'F' ? c - 'A' + 10
+         : -1;
+}
+
+json_stream::json_stream() {
+    reset();
+}
+
+bool json_stream::watch(std::string_view pointer, inplace_function<void(const nlohmann::json&)> callback) {
+    if(m_watch_count == JSON_STREAM_MAX_WATCHES || (!pointer.empty() && pointer[0] != '/')) {
+        error("json_stream::watch: cannot watch '%.*s'\n", pointer.size(), pointer.data());
+        return false;
+    }
+    watcher &watch = m_watches[m_watch_count];
+    watch.path.clear();
+    while(!pointer.empty()) {
+        pointer.remove_prefix(1);
+        size_t slash = pointer.find('/');
+        std::string_view raw = pointer.substr(0, slash);
+        pointer = slash == std::string_view::npos ? std::string_view() : pointer.substr(slash);
+        segment part = {"", -1, raw == "*"};
+        // ~1 stands for '/' and ~0 for '~'
+        for(size_t i = 0; i < raw.size(); i++) {
+            if(raw[i] != '~') {
+                part.key.push_back(raw[i]);
+            } else if(i + 1 < raw.size() && (raw[i + 1] == '0' || raw[i + 1] == '1')) {
+                part.key.push_back(raw[++i] == '0' ? '~' : '/');
+            } else {
+                error1("json_stream::watch: '~' not followed by 0 or 1\n");
+                return false;
+            }
+        }
+        // Array indices have no leading zeros
+        const char *end = part.key.data() + part.key.size();
+        if(!part.key.empty() && (part.key[0] != '0' || part.key.size() == 1)) {
+            int32_t index;
+            auto result = std::from_chars(part.key.data(), end, index);
+            if(result.ec == std::errc() && result.ptr == end) {
+                part.index = index;
+            }
+        }
+        watch.path.push_back(std::move(part));
+    }
+    if(watch.path.size() > JSON_STREAM_MAX_DEPTH) {
+        error("json_stream::watch: path is deeper than %d\n", JSON_STREAM_MAX_DEPTH);
+        return false;
+    }
+    watch.callback = callback;
+    m_matches[0] |= 1u << m_watch_count++;
+    return true;
+}
+
+void json_stream::reset() {
+    m_state = state::value;
+    m_depth = 0;
+    m_capturing = false;
+    m_capture.clear();
+    m_high_surrogate = 0;
+    m_offset = 0;
+    m_matches[0] = m_watch_count == 32 ? UINT32_MAX : (1u << m_watch_count) - 1;
+}
+
+bool json_stream::feed(std::span<const uint8_t> data) {
+    if(m_state == state::failed) {
+        return false;
+    }
+    m_chunk = data;
+    m_capture_start = 0;
+    for(size_t i = 0; i < data.size() && m_state != state::failed; i++) {
+        // The byte after a number ends it and is then looked at again
+        while(!step(data[i], i)) {
+        }
+        m_offset++;
+    }
+    if(m_capturing) {
+        // The rest of the value is in the pieces still to come
+        m_capture.append((const char*)data.data() + m_capture_start, data.size() - m_capture_start);
+    }
+    m_chunk = {};
+    return m_state != state::failed;
+}
+
+bool json_stream::finish() {
+    if(m_state == state::number && m_depth == 0) {
+        // Nothing after a top level number to end it
+        end_value(0);
+    }
+    if(m_state == state::done) {
+        return true;
+    }
+    if(m_state != state::failed) {
+        fail("document ended early");
+    }
+    return false;
+}
+
+bool json_stream::step(uint8_t c, size_t pos) {
+    switch(m_state) {
+    case state::value_or_end:
+        if(whitespace(c)) {
+            return true;
+        }
+        if(c == ']') {
+            pop(pos + 1);
+            return true;
+        }
+        enter(m_depth);
+        m_state = state::value;
+        return false;
+    case state::value:
+        if(whitespace(c)) {
+            return true;
+        }
+        begin_value(pos);
+        if(c == '{') {
+            if(push(true)) {
+                m_state = state::key_or_end;
+            }
+        } else if(c == '[') {
+            if(push(false)) {
+                m_state = state::value_or_end;
+            }
+        } else if(c == '"') {
+            m_key = false;
+            m_state = state::string;
+        } else if(c == '-' || (c >= '0' && c <= '9')) {
+            m_state = state::number;
+        } else if(c == 't' || c == 'f' || c == 'n') {
+            m_literal = c == 't' ? "true" : c == 'f' ? "false" : "null";
+            m_literal_pos = 1;
+            m_state = state::literal;
+        } else {
+            fail("expected a value");
+        }
+        return true;
+    case state::key_or_end:
+        if(c == '}') {
+            pop(pos + 1);
+            return true;
+        }
+        [[fallthrough]];
+    case state::key:
+        if(whitespace(c)) {
+            return true;
+        }
+        if(c != '"') {
+            fail("expected a key");
+            return true;
+        }
+        m_stack[m_depth - 1].key.clear();
+        m_key = true;
+        m_state = state::string;
+        return true;
+    case state::colon:
+        if(whitespace(c)) {
+            return true;
+        }
+        if(c != ':') {
+            fail("expected ':'");
+            return true;
+        }
+        enter(m_depth);
+        m_state = state::value;
+        return true;
+    case state::after_value: {
+        if(whitespace(c)) {
+            return true;
+        }
+        frame &top = m_stack[m_depth - 1];
+        if(c == ',') {
+            if(top.object) {
+                m_state = state::key;
+            } else {
+                top.index++;
+                enter(m_depth);
+                m_state = state::value;
+            }
+        } else if(c == (top.object ? '}' : ']')) {
+            pop(pos + 1);
+        } else {
+            fail("expected ',' or the end of the container");
+        }
+        return true;
+    }
+    case state::string:
+        if(c == '"') {
+            if(m_key) {
+                m_state = state::colon;
+            } else {
+                end_value(pos + 1);
+            }
+        } else if(c == '\\') {
+            m_state = state::escape;
+        } else if(c < 0x20) {
+            fail("control character in a string");
+        } else if(m_key) {
+            m_stack[m_depth - 1].key.push_back(c);
+        }
+        return true;
+    case state::escape: {
+        static const char escapes[] = "\"\\/bfnrt", replacements[] = "\"\\/\b\f\n\r\t";
+        const char *found = c != 0 ? strchr(escapes, c) : nullptr;
+        if(c == 'u') {
+            m_unicode = 0;
+            m_unicode_digits = 0;
+            m_state = state::unicode;
+        } else if(found) {
+            if(m_key) {
+                m_stack[m_depth - 1].key.push_back(replacements[found - escapes]);
+            }
+            m_state = state::string;
+        } else {
+            fail("invalid escape");
+        }
+        return true;
+    }
+    case state::unicode: {
+        int digit = hex_digit(c);
+        if(digit < 0) {
+            fail("invalid \\u escape");
+            return true;
+        }
+        m_unicode = m_unicode << 4 | digit;
+        if(++m_unicode_digits == 4) {
+            if(m_key) {
+                append_key(m_unicode);
+            }
+            m_state = state::string;
+        }
+        return true;
+    }
+    case state::number:
+        // Only the extent is found here, nlohmann::json checks the format of the numbers it parses
+        if((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+            return true;
+        }
+        end_value(pos);
+        return false;
+    case state::literal:
+        if(c != m_literal[m_literal_pos]) {
+            fail("invalid literal");
+            return true;
+        }
+        if(m_literal[++m_literal_pos] == '\0') {
+            end_value(pos + 1);
+        }
+        return true;
+    case state::done:
+        if(!whitespace(c)) {
+            fail("data after the end of the document");
+        }
+        return true;
+    case state::failed:
+        return true;
+    }
+    return true;
+}
+
+void json_stream::begin_value(size_t pos) {
+    if(m_capturing) {
+        return;
+    }
+    uint32_t watches = 0;
+    for(uint8_t w = 0; w < m_watch_count; w++) {
+        if((m_matches[m_depth] & (1u << w)) && m_watches[w].path.size() == m_depth) {
+            watches |= 1u << w;
+        }
+    }
+    if(watches != 0) {
+        m_capturing = true;
+        m_capture_watches = watches;
+        m_capture_depth = m_depth;
+        m_capture_start = pos;
+        m_capture.clear();
+    }
+}
+
+void json_stream::end_value(size_t end) {
+    m_state = m_depth == 0 ? state::done : state::after_value;
+    if(!m_capturing || m_depth != m_capture_depth) {
+        return;
+    }
+    m_capturing = false;
+    m_capture.append((const char*)m_chunk.data() + m_capture_start, end - m_capture_start);
+    nlohmann::json value = nlohmann::json::parse(m_capture, nullptr, false);
+    m_capture.clear();
+    if(value.is_discarded()) {
+        fail("invalid watched value");
+        return;
+    }
+    for(uint8_t w = 0; w < m_watch_count; w++) {
+        if(m_capture_watches & (1u << w)) {
+            m_watches[w].callback(value);
+        }
+    }
+}
+
+bool json_stream::push(bool object) {
+    if(m_depth == JSON_STREAM_MAX_DEPTH) {
+        fail("nested too deeply");
+        return false;
+    }
+    frame &top = m_stack[m_depth++];
+    top.object = object;
+    top.index = 0;
+    top.key.clear();
+    return true;
+}
+
+void json_stream::pop(size_t end) {
+    m_depth--;
+    end_value(end);
+}
+
+void json_stream::enter(uint8_t depth) {
+    // The path just gained the segment of the innermost container
+    const frame &parent = m_stack[depth - 1];
+    uint32_t matches = 0;
+    for(uint8_t w = 0; w < m_watch_count; w++) {
+        if(!(m_matches[depth - 1] & (1u << w)) || m_watches[w].path.size() < depth) {
+            continue;
+        }
+        const segment &part = m_watches[w].path[depth - 1];
+        if(part.wildcard || (parent.object ? part.key == parent.key : part.index == (int32_t)parent.index)) {
+            matches |= 1u << w;
+        }
+    }
+    m_matches[depth] = matches;
+}
+
+void json_stream::append_key(uint32_t code_point) {
+    std::string &key = m_stack[m_depth - 1].key;
+    if(code_point >= 0xD800 && code_point <= 0xDBFF) {
+        m_high_surrogate = code_point;
+        return;
+    }
+    if(code_point >= 0xDC00 && code_point <= 0xDFFF && m_high_surrogate != 0) {
+        code_point = 0x10000 + ((m_high_surrogate - 0xD800) << 10) + (code_point - 0xDC00);
+    }
+    m_high_surrogate = 0;
+    if(code_point < 0x80) {
+        key.push_back(code_point);
+    } else if(code_point < 0x800) {
+        key.push_back(0xC0 | code_point >> 6);
+        key.push_back(0x80 | (code_point & 0x3F));
+    } else if(code_point < 0x10000) {
+        key.push_back(0xE0 | code_point >> 12);
+        key.push_back(0x80 | (code_point >> 6 & 0x3F));
+        key.push_back(0x80 | (code_point & 0x3F));
+    } else {
+        key.push_back(0xF0 | code_point >> 18);
+        key.push_back(0x80 | (code_point >> 12 & 0x3F));
+        key.push_back(0x80 | (code_point >> 6 & 0x3F));
+        key.push_back(0x80 | (code_point & 0x3F));
+    }
+}
+
+void json_stream::fail(const char *reason) {
+    error("json_stream: %s at byte %u\n", reason, m_offset);
+    m_state = state::failed;
+    m_capturing = false;
+}
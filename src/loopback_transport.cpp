@@ -0,0 +1,198 @@
+#include "loopback_transport.h"
+
+loopback_transport::loopback_transport(size_t segment_size, uint32_t latency_ms, uint32_t jitter_ms, bool secure)
+    : peer(nullptr)
+    , segment_size(segment_size > 0 ? segment_size : LOOPBACK_SEGMENT_SIZE)
+    , latency_ms(latency_ms)
+    , jitter_ms(jitter_ms)
+    , rng_state(1)
+    , now_ms(0)
+    , last_delivery_ms(0)
+    , poll_interval_ms(0)
+    , next_poll_ms(0)
+    , connected_(false)
+    , initialized_(false)
+    , secure_(secure)
+    , connect_pending(false)
+    , reconnect_pending(false)
+    , user_receive_callback([](){})
+    , user_connected_callback([](){})
+    , user_poll_callback([](){})
+    , user_closed_callback([](){})
+    , user_sent_callback([](){})
+    , user_error_callback([](err_t){})
+{
+    initialized_ = init();
+}
+
+loopback_transport::~loopback_transport() {
+    if(peer != nullptr) {
+        if(connected_ || connect_pending) {
+            enqueue({}, ERR_RST);
+        }
+        peer->peer = nullptr;
+        peer = nullptr;
+    }
+}
+
+void loopback_transport::pair(loopback_transport &a, loopback_transport &b) {
+    a.peer = &b;
+    b.peer = &a;
+}
+
+bool loopback_transport::init() {
+    initialized_ = true;
+    return true;
+}
+
+int loopback_transport::available() const {
+    return buffer.size();
+}
+
+size_t loopback_transport::read(std::span<uint8_t> out) {
+    return buffer.get(out);
+}
+
+bool loopback_transport::write(std::span<const uint8_t> data) {
+    if(!connected_ || peer == nullptr) {
+        return false;
+    }
+    enqueue(data);
+    return true;
+}
+
+size_t loopback_transport::writable() const {
+    if(!connected_ || peer == nullptr) {
+        return 0;
+    }
+    size_t queued = peer->in_flight();
+    return queued < LOOPBACK_SEND_BUFFER ? LOOPBACK_SEND_BUFFER - queued : 0;
+}
+
+void loopback_transport::flush() {
+    // Segments are queued on write and only delivered by the peer's advance()
+}
+
+bool loopback_transport::connect(std::string, uint16_t) {
+    if(peer == nullptr) {
+        return false;
+    }
+    connect_pending = true;
+    initialized_ = true;
+    if(!peer->connected_) {
+        peer->connect_pending = true;
+        peer->initialized_ = true;
+    } else {
+        peer->reconnect_pending = true;
+    }
+    return true;
+}
+
+err_t loopback_transport::close(err_t reason) {
+    bool was_open = connected_ || connect_pending;
+    connected_ = false;
+    connect_pending = false;
+    initialized_ = false;
+    inbound.clear();
+    if(was_open && !reconnect_pending && peer != nullptr && (peer->connected_ || peer->connect_pending)) {
+        enqueue({}, reason == ERR_CLSD ? ERR_CLSD : ERR_RST);
+    }
+    if(reason == ERR_CLSD) {
+        user_closed_callback();
+    } else {
+        user_error_callback(reason);
+    }
+    return ERR_OK;
+}
+
+bool loopback_transport::connected() const {
+    return connected_;
+}
+
+bool loopback_transport::initialized() const {
+    return initialized_;
+}
+
+void loopback_transport::advance(uint32_t ms) {
+    now_ms += ms;
+    if(connect_pending) {
+        connect_pending = false;
+        connected_ = true;
+        user_connected_callback();
+    }
+
+    bool delivered = false;
+    while(connected_ && !inbound.empty() && inbound.front().deliver_at <= now_ms) {
+        segment &front = inbound.front();
+        if(front.close_reason != ERR_OK) {
+            err_t reason = front.close_reason;
+            inbound.pop_front();
+            std::deque<segment> next;
+            next.swap(inbound);
+            close(reason);
+            if(reconnect_pending) {
+                reconnect_pending = false;
+                inbound.swap(next);
+                connect_pending = true;
+                initialized_ = true;
+            }
+            break;
+        }
+        size_t count = buffer.put({front.data.data() + front.offset, front.data.size() - front.offset});
+        if(count == 0) {
+            // Receive buffer is full, wait for the application to read
+            break;
+        }
+        front.offset += count;
+        if(front.offset == front.data.size()) {
+            inbound.pop_front();
+        }
+        delivered = true;
+        user_receive_callback();
+    }
+    if(delivered && peer != nullptr) {
+        // Delivery stands in for the acknowledgement
+        peer->user_sent_callback();
+    }
+
+    if(poll_interval_ms != 0 && now_ms >= next_poll_ms) {
+        next_poll_ms = now_ms + poll_interval_ms;
+        user_poll_callback();
+    }
+}
+
+size_t loopback_transport::in_flight() const {
+    size_t total = 0;
+    for(const segment &seg : inbound) {
+        total += seg.data.size() - seg.offset;
+    }
+    return total;
+}
+
+void loopback_transport::enqueue(std::span<const uint8_t> data, err_t close_reason) {
+    size_t offset = 0;
+    do {
+        size_t length = std::min(segment_size, data.size() - offset);
+        // Jitter may delay a segment but never lets it overtake an earlier one
+        uint32_t deliver_at = std::max(peer->now_ms + latency_ms + next_jitter(), peer->last_delivery_ms);
+        peer->last_delivery_ms = deliver_at;
+        peer->inbound.push_back({
+            std::vector<uint8_t>(data.begin() + offset, data.begin() + offset + length),
+            0,
+            deliver_at,
+            length == data.size() - offset ? close_reason : (err_t)ERR_OK
+        });
+        offset += length;
+    } while(offset < data.size());
+}
+
+uint32_t loopback_transport::next_jitter() {
+    if(jitter_ms == 0) {
+        return 0;
+    }
+    // xorshift32, deterministic for a given seed
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state % (jitter_ms + 1);
+}
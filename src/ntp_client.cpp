@@ -17,7 +17,8 @@
 ntp_client::ntp_client(std::string server, uint32_t retry_time)
     : udp(nullptr)
     , ntp_server(server)
-    , ntp_resend_alarm(0)
+    , ntp_resend_timer(std::bind(&ntp_client::send_packet, this))
+    , rtc_rearm_timer(rtc_enable_alarm)
     , ntp_retry_time(retry_time)
     , last_sync(0)
     , m_state(ntp_state::NOT_SYNCED)
@@ -36,7 +37,7 @@ ntp_client::ntp_client(std::string server, uint32_t retry_time)
 
     udp->on_receive([&](const ip_addr_t* addr, uint16_t port){
         recv_ms = to_ms_since_boot(get_absolute_time());
-        debug("ntp_client: received packet from %d.%d.%d.%d:%d\n", ip4_addr1(addr), ip4_addr2(addr), ip4_addr3(addr), ip4_addr4(addr), port);
+        debug("ntp_client: received packet from %s:%d\n", ipaddr_ntoa(addr), port);
         ip_addr_t remote_addr = udp->remote_address();
         if(ip_addr_cmp(addr, &remote_addr) && port == NTP_PORT) {
             ntp_packet packet;
@@ -48,7 +49,7 @@ ntp_client::ntp_client(std::string server, uint32_t retry_time)
                 error("ntp_client: Unhandled mode 0x%02x\n", mode);
                 return;
             }
-            cancel_alarm(ntp_resend_alarm);
+            ntp_resend_timer.cancel();
             uint32_t delay_ms = (recv_ms - sent_ms) - (1000 * (int32_t)(ntohl(packet.m_tx_timestamp.seconds) - ntohl(packet.m_rx_timestamp.seconds)) + (packet.m_tx_timestamp.fraction_to_ms() - packet.m_rx_timestamp.fraction_to_ms()));
             time_t epoch = ntp_client::time_t_from_ntp_timestamp(packet.m_tx_timestamp.seconds);
             epoch += (delay_ms / 2 + packet.m_tx_timestamp.fraction_to_ms()) / 1000;
@@ -89,7 +90,7 @@ void ntp_client::send_packet() {
     
     debug1("ntp_client: Sending ntp packet\n");
 
-    ntp_resend_alarm = add_alarm_in_ms(ntp_retry_time, ntp_client::alarm_callback, this, true);
+    ntp_resend_timer.start(ntp_retry_time);
     sent_ms = to_ms_since_boot(get_absolute_time());
     udp->write({packet.data, NTP_MESSAGE_LEN});
 }
@@ -115,24 +116,13 @@ ntp_state ntp_client::state() const {
     return m_state;
 }
 
-int64_t reenable_rtc(alarm_id_t, void*) {
-    rtc_enable_alarm();
-    return 0;
-}
-
 void ntp_client::rtc_callback() {
     rtc_disable_alarm();
-    add_alarm_in_ms(1500, reenable_rtc, nullptr, true);
     ntp_client* client = (ntp_client*)rtc_cb_data;
+    client->rtc_rearm_timer.start(1500);
     client->sync_time();
 }
 
-int64_t ntp_client::alarm_callback(alarm_id_t alarm, void* user_data) {
-    ntp_client* client = (ntp_client*)user_data;
-    client->send_packet();
-    return 0;
-}
-
 datetime_t ntp_client::datetime_from_tm(struct tm time_tm) {
     datetime_t datetime = {
         .year = (int16_t)(time_tm.tm_year + 1900),
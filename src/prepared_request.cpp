@@ -0,0 +1,74 @@
+#include "prepared_request.h"
+
+#include <charconv>
+#include <string.h>
+
+#include "logger.h"
+
+prepared_request::prepared_request(std::string_view method, std::string_view target)
+    : m_frozen_size(0)
+    , m_method_size(method.size())
+    , m_finished(false)
+    , m_sent(false)
+{
+    append(method);
+    append(" ");
+    append(target);
+    append(" HTTP/1.1\r\n");
+    m_frozen_size = m_buffer.size();
+}
+
+void prepared_request::freeze_header(std::string_view key, std::string_view value) {
+    if(m_sent || m_buffer.size() != m_frozen_size) {
+        error("prepared_request::freeze_header: '%.*s' added after the request was used\n", key.size(), key.data());
+        return;
+    }
+    header(key, value);
+    m_frozen_size = m_buffer.size();
+}
+
+void prepared_request::header(std::string_view key, std::string_view value) {
+    restart();
+    append(key);
+    append(": ");
+    append(value);
+    append("\r\n");
+}
+
+void prepared_request::body(std::span<const uint8_t> data) {
+    restart();
+    if(data.size() > 0) {
+        char digits[20];
+        std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), data.size());
+        append("Content-Length: ");
+        append({digits, (size_t)(result.ptr - digits)});
+        append("\r\n");
+    }
+    append("\r\n");
+    append({(const char*)data.data(), data.size()});
+    m_finished = true;
+}
+
+std::span<const uint8_t> prepared_request::finish() {
+    if(!m_finished) {
+        restart();
+        append("\r\n");
+        m_finished = true;
+    }
+    m_sent = true;
+    return m_buffer;
+}
+
+void prepared_request::append(std::string_view text) {
+    size_t size = m_buffer.size();
+    m_buffer.resize(size + text.size());
+    memcpy(m_buffer.data() + size, text.data(), text.size());
+}
+
+void prepared_request::restart() {
+    if(m_finished) {
+        trace1("prepared_request: starting over from the frozen head\n");
+        m_buffer.resize(m_frozen_size);
+        m_finished = false;
+    }
+}
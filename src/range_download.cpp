@@ -0,0 +1,299 @@
+#include "range_download.h"
+
+#include <algorithm>
+#include <charconv>
+
+#include "LUrlParser.h"
+#include "tcp_base.h"
+#include "logger.h"
+
+static bool parse_number(std::string_view text, int64_t &value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+range_download::range_download(std::string url, std::span<uint8_t> cert)
+    : m_client(url, cert)
+    , m_url(url)
+    , m_user_data_callback([](uint32_t, std::span<const uint8_t>){})
+    , m_user_complete_callback([](){})
+    , m_user_error_callback([](err_t){})
+{
+    init();
+}
+
+range_download::range_download(std::string url, tcp_base *transport, std::span<uint8_t> cert)
+    : m_client(url, transport, cert)
+    , m_url(url)
+    , m_user_data_callback([](uint32_t, std::span<const uint8_t>){})
+    , m_user_complete_callback([](){})
+    , m_user_error_callback([](err_t){})
+{
+    init();
+}
+
+void range_download::init() {
+    LUrlParser::ParseURL parsed = LUrlParser::ParseURL::parseURL(m_url);
+    m_target = "/" + parsed.path_;
+    if(parsed.query_.size() > 0) {
+        m_target += "?" + parsed.query_;
+    }
+    m_client.on_body_chunk(std::bind(&range_download::body_callback, this, std::placeholders::_1));
+    m_client.on_response(std::bind(&range_download::response_callback, this));
+    m_client.on_close(std::bind(&range_download::closed_callback, this));
+    m_client.on_error(std::bind(&range_download::error_callback, this, std::placeholders::_1));
+    // Retries ask the original url for m_target again, so the client must not move elsewhere
+    m_client.follow_redirects(0);
+    m_timer.on_expire(std::bind(&range_download::timer_callback, this));
+    m_watchdog.on_expire(std::bind(&range_download::watchdog_callback, this));
+}
+
+range_download::~range_download() {
+    trace1("range_download dtor entered\n");
+    m_timer.cancel();
+    m_watchdog.cancel();
+    trace1("range_download dtor exited\n");
+}
+
+void range_download::start(uint32_t offset, std::string etag, std::string last_modified) {
+    trace("range_download::start entered with offset %u\n", offset);
+    if(m_active) {
+        cancel();
+    }
+    m_committed = offset;
+    m_watched = offset;
+    m_etag = etag;
+    m_last_modified = last_modified;
+    m_total = -1;
+    m_retries = 0;
+    m_changed = false;
+    m_active = true;
+    if(m_timeout_ms != 0 && !m_watchdog.armed()) {
+        m_watchdog.start(m_timeout_ms);
+    }
+    request();
+    trace1("range_download::start exited\n");
+}
+
+void range_download::cancel() {
+    trace1("range_download::cancel entered\n");
+    m_active = false;
+    m_interrupted = false;
+    m_timer.cancel();
+    m_watchdog.cancel();
+    // Drops the connection, the close is ignored now that the download is inactive
+    m_client.url(m_url);
+    trace1("range_download::cancel exited\n");
+}
+
+void range_download::set_timeout(uint32_t timeout_ms) {
+    m_timeout_ms = timeout_ms;
+    m_client.set_timeout(timeout_ms);
+}
+
+void range_download::request() {
+    debug("range_download: requesting %s from byte %u\n", m_target.c_str(), m_committed);
+    m_validated = false;
+    m_skip = 0;
+    m_client.clear_error();
+    m_client.header("Range", "bytes=" + std::to_string(m_committed) + "-");
+    m_client.get(m_target);
+    if(m_client.has_error()) {
+        // The transport could not even be set up, so no callback is coming
+        retry(ERR_CONN);
+    }
+}
+
+bool range_download::validate() {
+    const http_response &response = m_client.response();
+    std::string_view etag = response.header("ETag"), modified = response.header("Last-Modified");
+    int64_t first = 0, total = -1;
+    if(response.status() == 206) {
+        // Content-Range: bytes <first>-<last>/<total or *>
+        std::string_view range = response.header("Content-Range");
+        size_t dash = range.find('-'), slash = range.find('/');
+        if(!range.starts_with("bytes ") || dash == std::string_view::npos || slash == std::string_view::npos
+                || !parse_number(range.substr(6, dash - 6), first)
+                || (range.substr(slash + 1) != "*" && !parse_number(range.substr(slash + 1), total))) {
+            error("range_download: bad Content-Range '%.*s'\n", range.size(), range.data());
+            interrupt(ERR_VAL, false);
+            return false;
+        }
+        if(first > m_committed) {
+            error("range_download: asked for byte %u, got %lld\n", m_committed, first);
+            interrupt(ERR_VAL, false);
+            return false;
+        }
+    } else if(!parse_number(response.header(http_response::known_header::content_length), total)) {
+        total = -1;
+    }
+    if(m_committed > 0) {
+        bool changed = (!m_etag.empty() && !etag.empty() && etag != m_etag)
+            || (m_etag.empty() && !m_last_modified.empty() && !modified.empty() && modified != m_last_modified)
+            || (m_total >= 0 && total >= 0 && total != m_total);
+        if(changed) {
+            warn("range_download: %s changed after %u bytes\n", m_target.c_str(), m_committed);
+            m_changed = true;
+            interrupt(ERR_VAL, false);
+            return false;
+        }
+        if(etag.empty() && modified.empty() && m_etag.empty() && m_last_modified.empty()) {
+            warn1("range_download: no validators, cannot tell whether the resource changed\n");
+        }
+    }
+    if(!etag.empty()) {
+        m_etag = etag;
+    }
+    if(!modified.empty()) {
+        m_last_modified = modified;
+    }
+    if(total >= 0) {
+        m_total = total;
+    }
+    // A 200 is the whole resource whatever was asked for, so the part already delivered is skipped
+    m_skip = m_committed - first;
+    if(m_skip > 0) {
+        debug("range_download: skipping %u bytes already delivered\n", m_skip);
+    }
+    m_validated = true;
+    return true;
+}
+
+void range_download::interrupt(err_t err, bool retry) {
+    // Dropping the connection from inside the client's callbacks is not safe, so it
+    // happens from the timer. Anything arriving until then is ignored
+    m_interrupted = true;
+    m_retry = retry;
+    m_error = err;
+    schedule(1);
+}
+
+void range_download::retry(err_t err) {
+    if(m_retries >= HTTP_DOWNLOAD_RETRIES) {
+        error("range_download: giving up on %s at byte %u after %d retries\n", m_target.c_str(), m_committed, m_retries);
+        finish(err);
+        return;
+    }
+    uint32_t delay = HTTP_DOWNLOAD_RETRY_DELAY_MS << m_retries++;
+    warn("range_download: '%s' at byte %u, retrying in %u ms\n", tcp_perror(err).c_str(), m_committed, delay);
+    schedule(delay);
+}
+
+void range_download::finish(err_t err) {
+    m_active = false;
+    m_watchdog.cancel();
+    if(err == ERR_OK) {
+        info("range_download: %s complete, %u bytes\n", m_target.c_str(), m_committed);
+        m_user_complete_callback();
+    } else {
+        m_user_error_callback(err);
+    }
+}
+
+void range_download::schedule(uint32_t delay_ms) {
+    m_timer.start(delay_ms);
+}
+
+void range_download::body_callback(std::span<const uint8_t> data) {
+    if(!m_active || m_interrupted || (!m_validated && !validate())) {
+        return;
+    }
+    if(m_skip > 0) {
+        uint32_t count = std::min((size_t)m_skip, data.size());
+        data = data.subspan(count);
+        m_skip -= count;
+    }
+    if(data.empty()) {
+        return;
+    }
+    m_user_data_callback(m_committed, data);
+    m_committed += data.size();
+    // Data is getting through, so the connection problems so far are forgiven
+    m_retries = 0;
+}
+
+void range_download::response_callback() {
+    if(!m_active || m_interrupted) {
+        return;
+    }
+    const http_response &response = m_client.response();
+    uint16_t status = response.status();
+    if(status == 416) {
+        // Nothing at or past the offset asked for, which is fine if that is the end
+        std::string_view range = response.header("Content-Range");
+        size_t slash = range.find('/');
+        int64_t total = -1;
+        if(slash != std::string_view::npos && parse_number(range.substr(slash + 1), total) && total == m_committed) {
+            m_total = total;
+            finish(ERR_OK);
+            return;
+        }
+        warn("range_download: %s is shorter than the %u bytes already delivered\n", m_target.c_str(), m_committed);
+        m_changed = true;
+        finish(ERR_VAL);
+        return;
+    }
+    if(status >= 500) {
+        retry(ERR_VAL);
+        return;
+    }
+    if(status != 200 && status != 206) {
+        error("range_download: server answered %d %.*s\n", status, response.get_status_text().size(), response.get_status_text().data());
+        finish(ERR_VAL);
+        return;
+    }
+    if(!m_validated && !validate()) {
+        return;
+    }
+    if(m_total < 0 || m_committed >= m_total) {
+        finish(ERR_OK);
+        return;
+    }
+    // The server sent less than the rest, ask for what is still missing
+    schedule(1);
+}
+
+void range_download::closed_callback() {
+    // A pending timer already takes care of what happens next
+    if(!m_active || m_interrupted || m_timer.armed()) {
+        return;
+    }
+    retry(ERR_CLSD);
+}
+
+void range_download::error_callback(err_t err) {
+    if(!m_active || m_interrupted || m_timer.armed()) {
+        return;
+    }
+    retry(err);
+}
+
+void range_download::timer_callback() {
+    if(m_interrupted) {
+        // The close this causes is ignored while m_interrupted is set
+        m_client.url(m_url);
+        m_interrupted = false;
+        if(m_retry) {
+            retry(m_error);
+        } else {
+            finish(m_error);
+        }
+    } else if(m_active) {
+        request();
+    }
+}
+
+void range_download::watchdog_callback() {
+    if(!m_active) {
+        return;
+    }
+    // Only a request in flight can stall, not one waiting to be retried
+    if(!m_timer.armed() && m_committed == m_watched) {
+        warn("range_download: no data for %u ms\n", m_timeout_ms);
+        interrupt(ERR_TIMEOUT, true);
+    }
+    m_watched = m_committed;
+    if(m_timeout_ms != 0) {
+        m_watchdog.start(m_timeout_ms);
+    }
+}
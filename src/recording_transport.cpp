@@ -0,0 +1,154 @@
+#include "recording_transport.h"
+
+#include <algorithm>
+
+#include <pico/time.h>
+
+#include "logger.h"
+
+size_t capture::put_varint(uint8_t *out, uint64_t value) {
+    size_t count = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[count++] = byte | (value ? 0x80 : 0);
+    } while(value);
+    return count;
+}
+
+size_t capture::get_varint(std::span<const uint8_t> in, uint64_t &value) {
+    value = 0;
+    for(size_t i = 0; i < in.size() && i < 10; i++) {
+        value |= (uint64_t)(in[i] & 0x7F) << (7 * i);
+        if((in[i] & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+recording_transport::recording_transport(tcp_base *inner, inplace_function<void(std::span<const uint8_t>)> sink)
+    : inner(inner)
+    , last_record_us(to_us_since_boot(get_absolute_time()))
+    , sink(sink)
+    , user_receive_callback([](){})
+    , user_connected_callback([](){})
+    , user_closed_callback([](){})
+    , user_error_callback([](err_t){})
+{
+    uint8_t header[] = {'P', 'W', 'C', 'T', TRANSPORT_TRACE_VERSION};
+    sink({header, sizeof(header)});
+    inner->on_receive(std::bind(&recording_transport::inner_recv_callback, this));
+    inner->on_connected(std::bind(&recording_transport::inner_connected_callback, this));
+    inner->on_closed(std::bind(&recording_transport::inner_closed_callback, this));
+    inner->on_error(std::bind(&recording_transport::inner_error_callback, this, std::placeholders::_1));
+}
+
+recording_transport::~recording_transport() {
+    trace1("recording_transport dtor entered\n");
+    delete inner;
+    trace1("recording_transport dtor exited\n");
+}
+
+bool recording_transport::init() {
+    return inner->init();
+}
+
+int recording_transport::available() const {
+    // What did not fit in buffer yet is still waiting in inner
+    return buffer.size() + std::max(inner->available(), 0);
+}
+
+size_t recording_transport::read(std::span<uint8_t> out) {
+    size_t count = buffer.get(out);
+    // Reading made room, so the rest of what inner holds comes over before it is asked for
+    pull();
+    std::span<uint8_t> rest = out.subspan(count);
+    return count + buffer.get(rest);
+}
+
+bool recording_transport::write(std::span<const uint8_t> data) {
+    record(capture::record_type::written, data);
+    return inner->write(data);
+}
+
+size_t recording_transport::writable() const {
+    return inner->writable();
+}
+
+void recording_transport::flush() {
+    inner->flush();
+}
+
+bool recording_transport::connect(std::string host, uint16_t port) {
+    return inner->connect(host, port);
+}
+
+err_t recording_transport::close(err_t reason) {
+    return inner->close(reason);
+}
+
+bool recording_transport::connected() const {
+    return inner->connected();
+}
+
+bool recording_transport::initialized() const {
+    return inner->initialized();
+}
+
+bool recording_transport::secure() const {
+    return inner->secure();
+}
+
+void recording_transport::record(capture::record_type type, std::span<const uint8_t> payload, err_t reason) {
+    uint8_t header[1 + 10 + 10];
+    uint64_t now_us = to_us_since_boot(get_absolute_time());
+    size_t length = 0;
+    header[length++] = (uint8_t)type;
+    length += capture::put_varint(header + length, now_us - last_record_us);
+    last_record_us = now_us;
+    if(type == capture::record_type::received || type == capture::record_type::written) {
+        length += capture::put_varint(header + length, payload.size());
+    } else if(type == capture::record_type::error) {
+        header[length++] = (uint8_t)reason;
+    }
+    sink({header, length});
+    if(payload.size() > 0) {
+        sink(payload);
+    }
+}
+
+void recording_transport::pull() {
+    // Move what inner holds into our own buffer so it can be recorded as delivered
+    uint8_t chunk[BUF_SIZE];
+    size_t space;
+    // A full circular_buffer reports its capacity as its size
+    while(inner->available() > 0 && !buffer.full() && (space = buffer.capacity() - 1 - buffer.size()) > 0) {
+        size_t count = inner->read({chunk, std::min((size_t)inner->available(), space)});
+        if(count == 0) {
+            break;
+        }
+        buffer.put({chunk, count});
+        record(capture::record_type::received, {chunk, count});
+    }
+}
+
+void recording_transport::inner_recv_callback() {
+    pull();
+    user_receive_callback();
+}
+
+void recording_transport::inner_connected_callback() {
+    record(capture::record_type::connected);
+    user_connected_callback();
+}
+
+void recording_transport::inner_closed_callback() {
+    record(capture::record_type::closed);
+    user_closed_callback();
+}
+
+void recording_transport::inner_error_callback(err_t reason) {
+    record(capture::record_type::error, {}, reason);
+    user_error_callback(reason);
+}
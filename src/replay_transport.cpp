@@ -0,0 +1,197 @@
+#include "replay_transport.h"
+
+#include <cstring>
+
+replay_transport::replay_transport(std::span<const uint8_t> trace, bool paced, bool secure)
+    : trace_data(trace)
+    , position(0)
+    , pending{}
+    , has_pending(false)
+    , paced(paced)
+    , valid_(true)
+    , secure_(secure)
+    , connect_requested(false)
+    , connected_(false)
+    , initialized_(false)
+    , now_us(0)
+    , offset_us(0)
+    , recorded_us(0)
+    , poll_interval_us(0)
+    , next_poll_us(0)
+    , writes_seen(0)
+    , writes_replayed(0)
+    , user_receive_callback([](){})
+    , user_connected_callback([](){})
+    , user_poll_callback([](){})
+    , user_closed_callback([](){})
+    , user_error_callback([](err_t){})
+{
+    size_t header_size = sizeof(TRANSPORT_TRACE_MAGIC) - 1;
+    if(trace_data.size() < header_size + 1
+        || memcmp(trace_data.data(), TRANSPORT_TRACE_MAGIC, header_size) != 0
+        || trace_data[header_size] != TRANSPORT_TRACE_VERSION) {
+        valid_ = false;
+        position = trace_data.size();
+    } else {
+        position = header_size + 1;
+    }
+    initialized_ = init();
+}
+
+bool replay_transport::init() {
+    initialized_ = true;
+    return true;
+}
+
+int replay_transport::available() const {
+    return buffer.size();
+}
+
+size_t replay_transport::read(std::span<uint8_t> out) {
+    return buffer.get(out);
+}
+
+bool replay_transport::write(std::span<const uint8_t>) {
+    if(!connected_) {
+        return false;
+    }
+    writes_seen++;
+    return true;
+}
+
+size_t replay_transport::writable() const {
+    return connected_ ? SIZE_MAX : 0;
+}
+
+void replay_transport::flush() {}
+
+bool replay_transport::connect(std::string, uint16_t) {
+    connect_requested = true;
+    offset_us = now_us;
+    return true;
+}
+
+err_t replay_transport::close(err_t reason) {
+    connected_ = false;
+    connect_requested = false;
+    initialized_ = false;
+    // Whatever the trace still holds belongs to the closed connection
+    has_pending = false;
+    position = trace_data.size();
+    if(reason == ERR_CLSD) {
+        user_closed_callback();
+    } else {
+        user_error_callback(reason);
+    }
+    return ERR_OK;
+}
+
+bool replay_transport::connected() const {
+    return connected_;
+}
+
+bool replay_transport::initialized() const {
+    return initialized_;
+}
+
+bool replay_transport::finished() const {
+    return !has_pending && position >= trace_data.size();
+}
+
+void replay_transport::advance(uint32_t ms) {
+    now_us += ms * 1000ull;
+
+    while(connect_requested && (has_pending || decode_next())) {
+        if(paced && pending.at_us + offset_us > now_us) {
+            break;
+        }
+        switch(pending.type) {
+        case capture::record_type::connected:
+            connected_ = true;
+            user_connected_callback();
+            break;
+        case capture::record_type::received:{
+            size_t count = buffer.put({const_cast<uint8_t*>(pending.payload.data()), pending.payload.size()});
+            pending.payload = pending.payload.subspan(count);
+            if(count > 0) {
+                user_receive_callback();
+            }
+            if(pending.payload.size() > 0) {
+                // Receive buffer is full, wait for the application to read
+                return;
+            }
+            break;
+        }
+        case capture::record_type::written:
+            if(writes_seen <= writes_replayed) {
+                return;
+            }
+            writes_replayed++;
+            // Pace the rest of the trace from when the application actually wrote
+            if(now_us > pending.at_us + offset_us) {
+                offset_us = now_us - pending.at_us;
+            }
+            break;
+        case capture::record_type::closed:
+            has_pending = false;
+            close(ERR_CLSD);
+            return;
+        case capture::record_type::error:
+            has_pending = false;
+            close(pending.reason);
+            return;
+        }
+        has_pending = false;
+    }
+
+    if(poll_interval_us != 0 && now_us >= next_poll_us) {
+        next_poll_us = now_us + poll_interval_us;
+        user_poll_callback();
+    }
+}
+
+bool replay_transport::decode_next() {
+    if(position >= trace_data.size()) {
+        return false;
+    }
+    std::span<const uint8_t> rest = trace_data.subspan(position);
+    uint64_t delta_us, length = 0;
+    size_t used = 1, count;
+    if(rest[0] < (uint8_t)capture::record_type::connected || rest[0] > (uint8_t)capture::record_type::error) {
+        // Not a trace this version wrote, nothing after it can be trusted
+        valid_ = false;
+        position = trace_data.size();
+        return false;
+    }
+    pending.type = (capture::record_type)rest[0];
+    pending.payload = {};
+    pending.reason = ERR_OK;
+    if((count = capture::get_varint(rest.subspan(used), delta_us)) == 0) {
+        valid_ = false;
+        position = trace_data.size();
+        return false;
+    }
+    used += count;
+    if(pending.type == capture::record_type::received || pending.type == capture::record_type::written) {
+        if((count = capture::get_varint(rest.subspan(used), length)) == 0 || used + count + length > rest.size()) {
+            valid_ = false;
+            position = trace_data.size();
+            return false;
+        }
+        used += count;
+        pending.payload = rest.subspan(used, length);
+        used += length;
+    } else if(pending.type == capture::record_type::error) {
+        if(used >= rest.size()) {
+            valid_ = false;
+            position = trace_data.size();
+            return false;
+        }
+        pending.reason = (err_t)rest[used++];
+    }
+    recorded_us += delta_us;
+    pending.at_us = recorded_us;
+    position += used;
+    has_pending = true;
+    return true;
+}
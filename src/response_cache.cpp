@@ -0,0 +1,261 @@
+#include "response_cache.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "http_response.h"
+#include "iequals.h"
+#include "logger.h"
+
+#ifdef HTTP_CACHE_FLASH_OFFSET
+#include <pico/cyw43_arch.h>
+#include <hardware/regs/addressmap.h>
+#include <hardware/sync.h>
+
+// Written at the start of each flash slot, followed by the key, ETag,
+// Last-Modified and body
+struct flash_record {
+    uint32_t magic;
+    uint16_t status, key_length, etag_length, modified_length;
+    uint32_t body_length;
+};
+
+#define FLASH_RECORD_MAGIC 0x31434850 // "PHC1"
+#endif
+
+static bool no_store(std::string_view cache_control) {
+    for(size_t i = 0; i + 8 <= cache_control.size(); i++) {
+        if(iequals(cache_control.substr(i, 8), "no-store")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::span<const uint8_t> response_cache::entry::body() const {
+#ifdef HTTP_CACHE_FLASH_OFFSET
+    if(work == flash_work::write) {
+        return {(const uint8_t*)pending.data(), pending.size()};
+    }
+    return {body_data, body_length};
+#else
+    return {(const uint8_t*)body_data.data(), body_data.size()};
+#endif
+}
+
+response_cache::response_cache() {
+#ifdef HTTP_CACHE_FLASH_OFFSET
+    load();
+#endif
+}
+
+const response_cache::entry *response_cache::find(std::string_view key) {
+    entry *found = lookup(key);
+    if(found) {
+        found->last_used = ++m_clock;
+    }
+    return found;
+}
+
+void response_cache::store(std::string_view key, const http_response &response) {
+    trace1("response_cache::store entered\n");
+    entry *slot = lookup(key);
+    std::string_view etag = response.header("ETag"), modified = response.header("Last-Modified");
+    if(response.status() != 200 || response.streaming() || (etag.empty() && modified.empty())
+            || response.body_size() > HTTP_CACHE_MAX_BODY || no_store(response.header("Cache-Control"))) {
+        if(slot) {
+            debug("response_cache: dropping %.*s\n", key.size(), key.data());
+            release(*slot);
+        }
+        trace1("response_cache::store exited\n");
+        return;
+    }
+    std::string_view body = response.get_body();
+    if(slot && slot->status == response.status() && slot->etag == etag && slot->last_modified == modified
+            && std::ranges::equal(slot->body(), std::span<const uint8_t>((const uint8_t*)body.data(), body.size()))) {
+        // The server sent the same response again, there is nothing to write
+        debug("response_cache: %.*s is unchanged\n", key.size(), key.data());
+        slot->last_used = ++m_clock;
+        trace1("response_cache::store exited\n");
+        return;
+    }
+    if(!slot) {
+        slot = std::min_element(std::begin(m_entries), std::end(m_entries), [](const entry &a, const entry &b){
+            return a.last_used < b.last_used;
+        });
+    }
+    slot->key = key;
+    slot->etag = etag;
+    slot->last_modified = modified;
+    slot->status = response.status();
+    slot->last_used = ++m_clock;
+#ifdef HTTP_CACHE_FLASH_OFFSET
+    slot->pending = body;
+    slot->work = entry::flash_work::write;
+#else
+    slot->body_data = body;
+#endif
+    debug("response_cache: stored %d bytes for %.*s\n", body.size(), key.size(), key.data());
+    trace1("response_cache::store exited\n");
+}
+
+void response_cache::remove(std::string_view key) {
+    entry *found = lookup(key);
+    if(found) {
+        release(*found);
+    }
+}
+
+void response_cache::clear() {
+    for(entry &slot : m_entries) {
+        if(!slot.key.empty()) {
+            release(slot);
+        }
+    }
+}
+
+void response_cache::flush() {
+#ifdef HTTP_CACHE_FLASH_OFFSET
+    for(size_t i = 0; i < HTTP_CACHE_ENTRIES; i++) {
+        // Holding lwIP off keeps store() from changing the entry while it is written
+        cyw43_arch_lwip_begin();
+        entry &slot = m_entries[i];
+        if(slot.work == entry::flash_work::write && !persist(i)) {
+            release(slot);
+        }
+        if(slot.work == entry::flash_work::erase) {
+            wipe(i);
+        }
+        slot.work = entry::flash_work::none;
+        cyw43_arch_lwip_end();
+    }
+#endif
+}
+
+size_t response_cache::size() const {
+    return std::count_if(std::begin(m_entries), std::end(m_entries), [](const entry &slot){
+        return !slot.key.empty();
+    });
+}
+
+response_cache::entry *response_cache::lookup(std::string_view key) {
+    for(entry &slot : m_entries) {
+        if(!slot.key.empty() && slot.key == key) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+void response_cache::release(entry &slot) {
+#ifdef HTTP_CACHE_FLASH_OFFSET
+    // flush() wipes the record so the entry is not loaded again after a reset
+    slot.body_data = nullptr;
+    slot.body_length = 0;
+    std::string().swap(slot.pending);
+    slot.work = entry::flash_work::erase;
+#else
+    std::string().swap(slot.body_data);
+#endif
+    std::string().swap(slot.key);
+    std::string().swap(slot.etag);
+    std::string().swap(slot.last_modified);
+    slot.status = 0;
+    slot.last_used = 0;
+}
+
+#ifdef HTTP_CACHE_FLASH_OFFSET
+void response_cache::load() {
+    for(size_t i = 0; i < HTTP_CACHE_ENTRIES; i++) {
+        const uint8_t *base = (const uint8_t*)XIP_BASE + HTTP_CACHE_FLASH_OFFSET + i * HTTP_CACHE_FLASH_SLOT_SIZE;
+        flash_record record;
+        memcpy(&record, base, sizeof(record));
+        size_t length = sizeof(record) + record.key_length + record.etag_length + record.modified_length + record.body_length;
+        if(record.magic != FLASH_RECORD_MAGIC || record.key_length == 0 || length > HTTP_CACHE_FLASH_SLOT_SIZE) {
+            continue;
+        }
+        entry &slot = m_entries[i];
+        const char *text = (const char*)base + sizeof(record);
+        slot.key.assign(text, record.key_length);
+        text += record.key_length;
+        slot.etag.assign(text, record.etag_length);
+        text += record.etag_length;
+        slot.last_modified.assign(text, record.modified_length);
+        text += record.modified_length;
+        slot.status = record.status;
+        slot.body_data = (const uint8_t*)text;
+        slot.body_length = record.body_length;
+        debug("response_cache: loaded %.*s from flash\n", slot.key.size(), slot.key.data());
+    }
+}
+
+static void program_page(uint32_t offset, const uint8_t *page) {
+    uint32_t interrupts = save_and_disable_interrupts();
+    flash_range_program(offset, page, FLASH_PAGE_SIZE);
+    restore_interrupts(interrupts);
+}
+
+void response_cache::wipe(size_t slot) {
+    // Erasing the first sector is enough to invalidate the record
+    uint32_t interrupts = save_and_disable_interrupts();
+    flash_range_erase(HTTP_CACHE_FLASH_OFFSET + slot * HTTP_CACHE_FLASH_SLOT_SIZE, FLASH_SECTOR_SIZE);
+    restore_interrupts(interrupts);
+}
+
+bool response_cache::persist(size_t slot) {
+    entry &cached = m_entries[slot];
+    std::span<const uint8_t> body = {(const uint8_t*)cached.pending.data(), cached.pending.size()};
+    flash_record record = {
+        FLASH_RECORD_MAGIC,
+        cached.status,
+        (uint16_t)cached.key.size(),
+        (uint16_t)cached.etag.size(),
+        (uint16_t)cached.last_modified.size(),
+        (uint32_t)body.size()
+    };
+    std::span<const uint8_t> pieces[] = {
+        {(const uint8_t*)&record, sizeof(record)},
+        {(const uint8_t*)cached.key.data(), cached.key.size()},
+        {(const uint8_t*)cached.etag.data(), cached.etag.size()},
+        {(const uint8_t*)cached.last_modified.data(), cached.last_modified.size()},
+        body
+    };
+    size_t length = 0;
+    for(std::span<const uint8_t> piece : pieces) {
+        length += piece.size();
+    }
+    if(length > HTTP_CACHE_FLASH_SLOT_SIZE) {
+        debug("response_cache: %d byte entry does not fit a flash slot\n", length);
+        return false;
+    }
+    uint32_t offset = HTTP_CACHE_FLASH_OFFSET + slot * HTTP_CACHE_FLASH_SLOT_SIZE;
+    const uint8_t *body_data = (const uint8_t*)XIP_BASE + offset + (length - body.size());
+    uint32_t interrupts = save_and_disable_interrupts();
+    flash_range_erase(offset, (length + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1));
+    restore_interrupts(interrupts);
+    // Programmed a page at a time so only one page is ever buffered
+    uint8_t page[FLASH_PAGE_SIZE];
+    size_t used = 0;
+    for(std::span<const uint8_t> piece : pieces) {
+        while(!piece.empty()) {
+            size_t count = std::min(piece.size(), sizeof(page) - used);
+            memcpy(page + used, piece.data(), count);
+            piece = piece.subspan(count);
+            used += count;
+            if(used == sizeof(page)) {
+                program_page(offset, page);
+                offset += sizeof(page);
+                used = 0;
+            }
+        }
+    }
+    if(used > 0) {
+        memset(page + used, 0xFF, sizeof(page) - used);
+        program_page(offset, page);
+    }
+    cached.body_data = body_data;
+    cached.body_length = body.size();
+    std::string().swap(cached.pending);
+    return true;
+}
+#endif
@@ -0,0 +1,433 @@
+#include "segmented_download.h"
+
+#include <algorithm>
+#include <charconv>
+
+#include "LUrlParser.h"
+#include "tcp_base.h"
+#include "logger.h"
+
+static bool parse_number(std::string_view text, int64_t &value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+segmented_download::segmented_download(std::string url, std::span<uint8_t> cert)
+    : segmented_download(url, [](uint8_t){ return (tcp_base*)nullptr; }, cert)
+{
+}
+
+segmented_download::segmented_download(std::string url, inplace_function<tcp_base*(uint8_t index)> transports, std::span<uint8_t> cert)
+    : m_url(url)
+    , m_cert(cert)
+    , m_transports(transports)
+    , m_user_data_callback([](uint32_t, std::span<const uint8_t>){})
+    , m_user_complete_callback([](){})
+    , m_user_error_callback([](err_t){})
+{
+    LUrlParser::ParseURL parsed = LUrlParser::ParseURL::parseURL(url);
+    m_target = "/" + parsed.path_;
+    if(parsed.query_.size() > 0) {
+        m_target += "?" + parsed.query_;
+    }
+    m_timer.on_expire([this](){
+        if(m_active) {
+            advance();
+        }
+    });
+}
+
+segmented_download::~segmented_download() {
+    trace1("segmented_download dtor entered\n");
+    m_timer.cancel();
+    if(m_alarm != 0) {
+        cancel_alarm(m_alarm);
+        m_alarm = 0;
+    }
+    for(lane &l : m_lanes) {
+        if(l.client) {
+            delete l.client;
+            l.client = nullptr;
+        }
+    }
+    trace1("segmented_download dtor exited\n");
+}
+
+void segmented_download::start() {
+    trace1("segmented_download::start entered\n");
+    if(m_active) {
+        cancel();
+    }
+    for(lane &l : m_lanes) {
+        l.busy = false;
+        release(l);
+    }
+    m_delivered = 0;
+    m_next = 0;
+    m_total = -1;
+    m_etag.clear();
+    m_retries = 0;
+    m_single = false;
+    m_failed = false;
+    m_active = true;
+    m_started_ms = to_ms_since_boot(get_absolute_time());
+    // Only the first segment goes out until its response says how large the resource is
+    assign(0);
+    schedule(1);
+    trace1("segmented_download::start exited\n");
+}
+
+void segmented_download::cancel() {
+    trace1("segmented_download::cancel entered\n");
+    m_active = false;
+    m_timer.cancel();
+    if(m_alarm != 0) {
+        cancel_alarm(m_alarm);
+        m_alarm = 0;
+    }
+    for(lane &l : m_lanes) {
+        if(l.client && l.busy && !l.complete) {
+            // The close is ignored now that the download is inactive
+            l.client->url(m_url);
+        }
+        l.busy = false;
+    }
+    trace1("segmented_download::cancel exited\n");
+}
+
+void segmented_download::set_timeout(uint32_t timeout_ms) {
+    m_timeout_ms = timeout_ms;
+    for(lane &l : m_lanes) {
+        if(l.client) {
+            l.client->set_timeout(timeout_ms);
+        }
+    }
+}
+
+size_t segmented_download::buffered() const {
+    size_t total = 0;
+    for(const std::vector<uint8_t> &buffer : m_buffers) {
+        total += buffer.size();
+    }
+    return total;
+}
+
+uint32_t segmented_download::throughput() const {
+    uint32_t elapsed = to_ms_since_boot(get_absolute_time()) - m_started_ms;
+    return (uint64_t)m_delivered * 1000 / std::max(elapsed, (uint32_t)1);
+}
+
+void segmented_download::advance() {
+    trace1("segmented_download::advance entered\n");
+    if(m_failed) {
+        for(lane &l : m_lanes) {
+            if(l.client && l.busy && !l.complete) {
+                l.client->url(m_url);
+            }
+            l.busy = false;
+        }
+        m_active = false;
+        m_user_error_callback(m_error);
+        trace1("segmented_download::advance exited\n");
+        return;
+    }
+    for(lane &l : m_lanes) {
+        if(l.busy && l.complete && m_delivered > l.last) {
+            // Passed straight through as it arrived
+            l.busy = false;
+        }
+    }
+    // Pass on whatever is held for the front of the download, as far as it goes
+    while(true) {
+        lane *front = nullptr;
+        for(lane &l : m_lanes) {
+            if(l.busy && l.first <= m_delivered && m_delivered <= l.last) {
+                front = &l;
+                break;
+            }
+        }
+        if(front == nullptr) {
+            break;
+        }
+        if(front->buffer) {
+            deliver(*front->buffer);
+            release(*front);
+        }
+        if(!front->complete) {
+            break;
+        }
+        front->busy = false;
+    }
+    if(m_total >= 0 && m_delivered >= m_total) {
+        m_active = false;
+        info("segmented_download: %s complete, %u bytes at %u bytes/s\n", m_target.c_str(), m_delivered, throughput());
+        m_user_complete_callback();
+        trace1("segmented_download::advance exited\n");
+        return;
+    }
+    uint32_t now = to_ms_since_boot(get_absolute_time()), wait = UINT32_MAX;
+    for(uint8_t i = 0; i < HTTP_SEGMENT_CONNECTIONS; i++) {
+        lane &l = m_lanes[i];
+        if(!l.busy && !m_single && m_total >= 0 && m_next < m_total) {
+            assign(i);
+        }
+        if(l.busy && !l.complete && !l.requested) {
+            if((int32_t)(now - l.retry_at_ms) >= 0) {
+                request(i);
+            } else {
+                wait = std::min(wait, l.retry_at_ms - now);
+            }
+        }
+    }
+    if(wait != UINT32_MAX && m_alarm == 0 && !m_timer.armed()) {
+        schedule(wait);
+    }
+    trace1("segmented_download::advance exited\n");
+}
+
+void segmented_download::assign(uint8_t index) {
+    lane &l = m_lanes[index];
+    l.first = m_next;
+    l.last = m_next + HTTP_SEGMENT_SIZE - 1;
+    if(m_total >= 0) {
+        l.last = std::min(l.last, (uint32_t)(m_total - 1));
+    }
+    l.received = 0;
+    l.retry_at_ms = 0;
+    l.busy = true;
+    l.requested = false;
+    l.complete = false;
+    m_next = l.last + 1;
+}
+
+void segmented_download::request(uint8_t index) {
+    lane &l = m_lanes[index];
+    if(l.client == nullptr) {
+        debug("segmented_download: opening connection %d\n", index);
+        tcp_base *transport = m_transports(index);
+        l.client = transport ? new http_client(m_url, transport, m_cert) : new http_client(m_url, m_cert);
+        l.client->set_timeout(m_timeout_ms);
+        l.client->on_body_chunk([this, index](std::span<const uint8_t> data){ body_callback(index, data); });
+        l.client->on_response([this, index](){ response_callback(index); });
+        l.client->on_close([this, index](){ closed_callback(index); });
+        l.client->on_error([this, index](err_t err){ error_callback(index, err); });
+        // Every segment has to come from the same resource on the same origin
+        l.client->follow_redirects(0);
+    }
+    debug("segmented_download: bytes %u-%u on connection %d\n", l.first + l.received, l.last, index);
+    l.requested = true;
+    l.validated = false;
+    l.client->clear_error();
+    l.client->header("Range", "bytes=" + std::to_string(l.first + l.received) + "-" + std::to_string(l.last));
+    l.client->get(m_target);
+    if(l.client->has_error()) {
+        // The transport could not even be set up, so no callback is coming
+        retry(index, ERR_CONN);
+    }
+}
+
+bool segmented_download::validate(uint8_t index) {
+    lane &l = m_lanes[index];
+    const http_response &response = l.client->response();
+    std::string_view etag = response.header("ETag");
+    if(!m_etag.empty() && !etag.empty() && etag != m_etag) {
+        warn("segmented_download: %s changed while downloading\n", m_target.c_str());
+        fail(ERR_VAL);
+        return false;
+    }
+    if(!etag.empty()) {
+        m_etag = etag;
+    }
+    if(response.status() == 200) {
+        // Range is not supported, so the whole body comes down this connection
+        if(l.first != 0 || l.received != 0) {
+            error1("segmented_download: server stopped honouring Range\n");
+            fail(ERR_VAL);
+            return false;
+        }
+        int64_t length;
+        if(!parse_number(response.header(http_response::known_header::content_length), length)) {
+            length = -1;
+        }
+        info1("segmented_download: no Range support, using one connection\n");
+        m_single = true;
+        m_total = length;
+        l.last = length >= 0 ? (uint32_t)length - 1 : UINT32_MAX;
+        l.validated = true;
+        return true;
+    }
+    // Content-Range: bytes <first>-<last>/<total>
+    std::string_view range = response.header("Content-Range");
+    size_t dash = range.find('-'), slash = range.find('/');
+    int64_t first, total;
+    if(!range.starts_with("bytes ") || dash == std::string_view::npos || slash == std::string_view::npos
+            || !parse_number(range.substr(6, dash - 6), first) || !parse_number(range.substr(slash + 1), total)) {
+        error("segmented_download: unusable Content-Range '%.*s'\n", range.size(), range.data());
+        fail(ERR_VAL);
+        return false;
+    }
+    if(first != l.first + l.received || (m_total >= 0 && total != m_total)) {
+        warn("segmented_download: %s does not line up with the earlier responses\n", m_target.c_str());
+        fail(ERR_VAL);
+        return false;
+    }
+    if(m_total < 0) {
+        m_total = total;
+        debug("segmented_download: %lld bytes, fetching on %d connections\n", total, HTTP_SEGMENT_CONNECTIONS);
+        // The other connections can start now
+        schedule(1);
+    }
+    if(total > 0) {
+        l.last = std::min(l.last, (uint32_t)(total - 1));
+    }
+    l.validated = true;
+    return true;
+}
+
+void segmented_download::deliver(std::span<const uint8_t> data) {
+    m_user_data_callback(m_delivered, data);
+    m_delivered += data.size();
+}
+
+bool segmented_download::hold(uint8_t index, std::span<const uint8_t> data) {
+    lane &l = m_lanes[index];
+    for(size_t i = 0; i < std::size(m_buffers) && !l.buffer; i++) {
+        std::vector<uint8_t> *buffer = &m_buffers[i];
+        if(std::none_of(std::begin(m_lanes), std::end(m_lanes), [buffer](const lane &other){ return other.buffer == buffer; })) {
+            l.buffer = buffer;
+            // Capacity for a whole segment, so buffering never reallocates
+            l.buffer->reserve(HTTP_SEGMENT_SIZE);
+        }
+    }
+    if(!l.buffer) {
+        // Only the segments behind the front are held, so this does not happen
+        error("segmented_download: no buffer left for connection %d\n", index);
+        fail(ERR_MEM);
+        return false;
+    }
+    l.buffer->insert(l.buffer->end(), data.begin(), data.end());
+    return true;
+}
+
+void segmented_download::release(lane &l) {
+    if(l.buffer) {
+        // Cleared without shrinking, the capacity is kept for the next segment
+        l.buffer->clear();
+        l.buffer = nullptr;
+    }
+}
+
+void segmented_download::retry(uint8_t index, err_t err) {
+    lane &l = m_lanes[index];
+    if(m_single && l.received > 0) {
+        // Without Range there is no way to pick up where it stopped
+        fail(err);
+        return;
+    }
+    if(m_retries >= HTTP_SEGMENT_RETRIES) {
+        error("segmented_download: giving up on %s at byte %u\n", m_target.c_str(), m_delivered);
+        fail(err);
+        return;
+    }
+    uint32_t delay = HTTP_SEGMENT_RETRY_DELAY_MS << m_retries++;
+    warn("segmented_download: '%s' on connection %d, retrying in %u ms\n", tcp_perror(err).c_str(), index, delay);
+    l.requested = false;
+    l.retry_at_ms = to_ms_since_boot(get_absolute_time()) + delay;
+    if(m_alarm == 0 && !m_timer.armed()) {
+        schedule(delay);
+    }
+}
+
+void segmented_download::fail(err_t err) {
+    // Connections are dropped from the alarm, not from inside their callbacks
+    m_failed = true;
+    m_error = err;
+    schedule(1);
+}
+
+void segmented_download::schedule(uint32_t delay_ms) {
+    if(delay_ms > 1) {
+        m_timer.start(delay_ms);
+        return;
+    }
+    // Not a timeout but the next segment waiting to go out, which a wheel tick
+    // would hold up every time, the way http_client defers its own sends
+    if(m_alarm == 0) {
+        m_alarm = add_alarm_in_ms(1, alarm_callback, this, true);
+    }
+}
+
+void segmented_download::body_callback(uint8_t index, std::span<const uint8_t> data) {
+    lane &l = m_lanes[index];
+    if(!m_active || m_failed || !l.busy || l.complete || (!l.validated && !validate(index))) {
+        return;
+    }
+    if(!(m_single && m_total < 0)) {
+        // A 200 without Content-Length runs until the connection closes, so only a known size is enforced
+        data = data.first(std::min(data.size(), (size_t)(l.last - l.first + 1 - l.received)));
+    }
+    if(l.first + l.received == m_delivered && !l.buffer) {
+        deliver(data);
+    } else if(!hold(index, data)) {
+        return;
+    }
+    l.received += data.size();
+    // Data is getting through, so the connection problems so far are forgiven
+    m_retries = 0;
+}
+
+void segmented_download::response_callback(uint8_t index) {
+    lane &l = m_lanes[index];
+    if(!m_active || m_failed || !l.busy || l.complete) {
+        return;
+    }
+    uint16_t status = l.client->response().status();
+    if(status >= 500) {
+        retry(index, ERR_VAL);
+        return;
+    }
+    if(status != 200 && status != 206) {
+        error("segmented_download: server answered %d\n", status);
+        fail(ERR_VAL);
+        return;
+    }
+    if(!l.validated && !validate(index)) {
+        return;
+    }
+    if(m_single && m_total < 0) {
+        // The body ran until the connection closed, so now the size is known
+        m_total = l.received;
+    }
+    if(l.first + l.received <= l.last && !(m_single && m_total == l.received)) {
+        retry(index, ERR_CLSD);
+        return;
+    }
+    l.complete = true;
+    schedule(1);
+}
+
+void segmented_download::closed_callback(uint8_t index) {
+    lane &l = m_lanes[index];
+    if(!m_active || m_failed || !l.busy || l.complete || !l.requested) {
+        return;
+    }
+    retry(index, ERR_CLSD);
+}
+
+void segmented_download::error_callback(uint8_t index, err_t err) {
+    lane &l = m_lanes[index];
+    if(!m_active || m_failed || !l.busy || l.complete || !l.requested) {
+        return;
+    }
+    retry(index, err);
+}
+
+int64_t segmented_download::alarm_callback(alarm_id_t alarm, void* user_data) {
+    segmented_download *download = (segmented_download*)user_data;
+    download->m_alarm = 0;
+    if(download->m_active) {
+        download->advance();
+    }
+    // Do not reschedule the alarm
+    return 0;
+}
@@ -4,23 +4,11 @@
 #define SIO_HTTP_TIMEOUT 30000
 #endif
 
-volatile int alarms_fired = 0;
-
-int64_t alarm_callback(alarm_id_t id, void* user_data) {
-    debug1("timer: refreshed watchdog\n");
-    watchdog_update();
-    if(alarms_fired < 2) {
-        alarms_fired = alarms_fired + 1;
-        // Reschedule the alarm for 7.33 seconds from now 3 times (gives the sio client 30 seconds to connect before reset)
-        return 7333333ll;
-    }
-    return 0;
-}
-
 sio_client::sio_client(std::string url, std::map<std::string, std::string> query)
         : m_raw_url(url)
     , m_engine(nullptr)
     , m_reconnect_time(nil_time)
+    , m_watchdog_extender(std::bind(&sio_client::watchdog_extender_callback, this))
 {
     m_http = new http_client(url);
     m_query_string = "?EIO=4&transport=websocket";
@@ -97,7 +85,7 @@ sio_socket* sio_client::socket(std::string ns) {
     return m_namespace_connections[ns];
 }
 
-void sio_client::on_open(std::function<void()> callback) {
+void sio_client::on_open(inplace_function<void()> callback) {
     m_user_open_callback = callback;
 }
 
@@ -124,12 +112,16 @@ void sio_client::reconnect() {
     m_http->on_response(std::bind(&sio_client::http_response_callback, this));
     m_http->on_error(std::bind(&sio_client::http_error_callback, this, std::placeholders::_1));
     m_http->set_timeout(SIO_HTTP_TIMEOUT);
-    std::function<void()> old_open_callback = m_user_open_callback;
-    on_open([&, old_open_callback](){
+    if(!m_reconnecting) {
+        m_saved_open_callback = m_user_open_callback;
+        m_reconnecting = true;
+    }
+    on_open([this](){
         for(auto iter = m_namespace_connections.begin(); iter != m_namespace_connections.end(); iter++) {
             this->connect(iter->first);
         }
-        this->m_user_open_callback = old_open_callback;
+        this->m_reconnecting = false;
+        this->m_user_open_callback = this->m_saved_open_callback;
     });
     open();
 }
@@ -144,16 +136,13 @@ void sio_client::set_refresh_watchdog() {
 void sio_client::run() {
     info1("Setting up watchdog...\n");
     watchdog_enable(8000000, true);
-    debug1("Setting up alarm to extend watchdog to 30 seconds\n");
-    m_watchdog_extender = add_alarm_in_us(7333333ull, alarm_callback, NULL, false);
+    extend_watchdog();
     debug1("opening socket.io connection...\n");
     open();
     while(true) {
         if(!is_nil_time(m_reconnect_time) && time_reached(m_reconnect_time)) {
-            alarms_fired = 0;
             watchdog_update();
-            debug1("Setting up alarm to extend watchdog to 30 seconds\n");
-            m_watchdog_extender = add_alarm_in_us(7333333ull, alarm_callback, NULL, false);
+            extend_watchdog();
             this->reconnect();
         } else {
             sleep_ms(100);
@@ -161,6 +150,22 @@ void sio_client::run() {
     }
 }
 
+void sio_client::extend_watchdog() {
+    debug1("Setting up timer to extend watchdog to 30 seconds\n");
+    m_extensions = 0;
+    m_watchdog_extender.start(7333);
+}
+
+void sio_client::watchdog_extender_callback() {
+    debug1("timer: refreshed watchdog\n");
+    watchdog_update();
+    if(m_extensions < 2) {
+        m_extensions++;
+        // Again 7.33 seconds from now, 3 times in all (gives the sio client 30 seconds to connect before reset)
+        m_watchdog_extender.start(7333);
+    }
+}
+
 void sio_client::http_response_callback() {
     info("Got http response: %d %s\n", m_http->response().status(), std::string(m_http->response().get_status_text()).c_str());
     
@@ -177,12 +182,11 @@ void sio_client::http_response_callback() {
         }
         m_engine->on_open([this](){
             m_open = true;
-            if(this->m_watchdog_extender) {
+            if(this->m_watchdog_extender.armed()) {
                 debug1("Cancelling watchdog extension\n");
-                cancel_alarm(this->m_watchdog_extender);
-                this->m_watchdog_extender = 0;
+                this->m_watchdog_extender.cancel();
             } else {
-                debug1("Watchdog extension timer id not set?\n");
+                debug1("Watchdog extension already ran out\n");
             }
             m_user_open_callback();
         });
@@ -5,15 +5,14 @@ sio_socket::sio_socket(eio_client *engine_ref, std::string ns)
     , m_engine(engine_ref)
 {}
 
-void sio_socket::on(std::string event, std::function<void(nlohmann::json)> handler) {
+void sio_socket::on(std::string event, inplace_function<void(nlohmann::json)> handler) {
     event_handlers[event] = handler;
+    once_events.erase(event);
 }
 
-void sio_socket::once(std::string event, std::function<void(nlohmann::json)> handler) {
-    event_handlers[event] = [&](nlohmann::json body) {
-        handler(body);
-        this->event_handlers.erase(event);
-    };
+void sio_socket::once(std::string event, inplace_function<void(nlohmann::json)> handler) {
+    event_handlers[event] = handler;
+    once_events.insert(event);
 }
 
 bool sio_socket::emit(std::string event, nlohmann::json array) {
@@ -47,17 +46,13 @@ void sio_socket::connect_callback(nlohmann::json body) {
         m_sid = body["sid"];
     }
 
-    if(event_handlers.find("connect") != event_handlers.end()){
-        event_handlers["connect"](body);
-    }
+    dispatch("connect", body);
 }
 
 void sio_socket::disconnect_callback(nlohmann::json body) {
     debug("sio_socket::disconnect_callback\n%s\n", body.dump(4).c_str());
 
-    if(event_handlers.find("disconnect") != event_handlers.end()){
-        event_handlers["disconnect"](body);
-    }
+    dispatch("disconnect", body);
 }
 
 void sio_socket::event_callback(nlohmann::json array) {
@@ -68,7 +63,20 @@ void sio_socket::event_callback(nlohmann::json array) {
     std::string event = array[0];
     array.erase(0);
     debug("sio_socket::event_callback for event '%s'\n", event.c_str());
-    if(event_handlers.find(event) != event_handlers.end()) {
-        event_handlers[event](array);
+    dispatch(event, array);
+}
+
+void sio_socket::dispatch(const std::string &event, nlohmann::json body) {
+    auto handler = event_handlers.find(event);
+    if(handler == event_handlers.end()) {
+        return;
+    }
+    if(once_events.erase(event) > 0) {
+        // Take the handler out before calling it so it may register itself again
+        inplace_function<void(nlohmann::json)> callback = std::move(handler->second);
+        event_handlers.erase(handler);
+        callback(body);
+        return;
     }
+    handler->second(body);
 }
\ No newline at end of file
@@ -0,0 +1,351 @@
+#include "sse_client.h"
+
+#include <algorithm>
+#include <charconv>
+
+#include "LUrlParser.h"
+#include "iequals.h"
+#include "tcp_base.h"
+#include "logger.h"
+
+sse_client::sse_client(std::string url, std::span<uint8_t> cert)
+    : m_client(url, cert)
+    , m_url(url)
+    , m_user_event_callback([](std::string_view, std::string_view, std::string_view){})
+    , m_user_open_callback([](){})
+    , m_user_error_callback([](err_t){})
+{
+    init();
+}
+
+sse_client::sse_client(std::string url, tcp_base *transport, std::span<uint8_t> cert)
+    : m_client(url, transport, cert)
+    , m_url(url)
+    , m_user_event_callback([](std::string_view, std::string_view, std::string_view){})
+    , m_user_open_callback([](){})
+    , m_user_error_callback([](err_t){})
+{
+    init();
+}
+
+void sse_client::init() {
+    LUrlParser::ParseURL parsed = LUrlParser::ParseURL::parseURL(m_url);
+    m_target = "/" + parsed.path_;
+    if(parsed.query_.size() > 0) {
+        m_target += "?" + parsed.query_;
+    }
+    m_client.on_body_chunk(std::bind(&sse_client::body_callback, this, std::placeholders::_1));
+    m_client.on_response(std::bind(&sse_client::response_callback, this));
+    m_client.on_close(std::bind(&sse_client::closed_callback, this));
+    m_client.on_error(std::bind(&sse_client::error_callback, this, std::placeholders::_1));
+    // Retries ask the original url for m_target again, so the client must not move elsewhere
+    m_client.follow_redirects(0);
+    m_timer.on_expire(std::bind(&sse_client::timer_callback, this));
+    m_watchdog.on_expire(std::bind(&sse_client::watchdog_callback, this));
+}
+
+sse_client::~sse_client() {
+    trace1("sse_client dtor entered\n");
+    m_timer.cancel();
+    m_watchdog.cancel();
+    trace1("sse_client dtor exited\n");
+}
+
+void sse_client::start(std::string last_event_id) {
+    trace1("sse_client::start entered\n");
+    m_timer.cancel();
+    if(m_interrupted || m_active) {
+        // Whatever was open or being dropped goes now, its close is ignored while inactive
+        m_active = false;
+        m_interrupted = false;
+        m_client.url(m_url);
+    }
+    m_last_event_id = last_event_id;
+    m_retry_ms = SSE_RETRY_MS;
+    m_failures = 0;
+    m_active = true;
+    watch();
+    connect();
+    trace1("sse_client::start exited\n");
+}
+
+void sse_client::stop() {
+    trace1("sse_client::stop entered\n");
+    if(!m_active) {
+        trace1("sse_client::stop exited\n");
+        return;
+    }
+    m_active = false;
+    m_open = false;
+    m_watchdog.cancel();
+    // stop() may come from inside the client's callbacks, so the connection is dropped from the timer
+    interrupt(ERR_OK, false);
+    trace1("sse_client::stop exited\n");
+}
+
+void sse_client::header(std::string key, std::string value) {
+    m_headers.emplace_back(key, value);
+}
+
+void sse_client::set_idle_timeout(uint32_t timeout_ms) {
+    m_idle_timeout_ms = timeout_ms;
+    if(m_active) {
+        watch();
+    }
+}
+
+void sse_client::watch() {
+    m_watchdog.cancel();
+    m_watched = m_received;
+    if(m_idle_timeout_ms != 0) {
+        m_watchdog.start(m_idle_timeout_ms);
+    }
+}
+
+void sse_client::connect() {
+    debug("sse_client: opening %s\n", m_target.c_str());
+    m_open = false;
+    m_validated = false;
+    m_type.clear();
+    m_data.clear();
+    m_line.clear();
+    m_id_buffer = m_last_event_id;
+    m_last_cr = false;
+    m_first_line = true;
+    m_discard = false;
+    m_client.clear_error();
+    for(const auto &[key, value] : m_headers) {
+        m_client.header(key, value);
+    }
+    m_client.header("Accept", "text/event-stream");
+    m_client.header("Cache-Control", "no-cache");
+    if(!m_last_event_id.empty()) {
+        m_client.header("Last-Event-ID", m_last_event_id);
+    }
+    m_client.get(m_target);
+    if(m_client.has_error()) {
+        // The transport could not even be set up, so no callback is coming
+        reconnect(ERR_CONN);
+    }
+}
+
+bool sse_client::validate() {
+    const http_response &response = m_client.response();
+    uint16_t status = response.status();
+    std::string_view type = response.header(http_response::known_header::content_type);
+    if(status == 200 && iequals(type.substr(0, 17), "text/event-stream")) {
+        info("sse_client: %s open\n", m_target.c_str());
+        m_validated = true;
+        m_open = true;
+        m_user_open_callback();
+        return true;
+    }
+    if(status == 204) {
+        info("sse_client: server ended %s\n", m_target.c_str());
+        interrupt(ERR_CLSD, false);
+    } else if(status >= 500) {
+        warn("sse_client: server answered %d\n", status);
+        interrupt(ERR_VAL, true);
+    } else {
+        error("sse_client: server answered %d with '%.*s'\n", status, type.size(), type.data());
+        interrupt(ERR_VAL, false);
+    }
+    return false;
+}
+
+void sse_client::parse(std::string_view text) {
+    while(!text.empty()) {
+        if(m_last_cr) {
+            m_last_cr = false;
+            if(text[0] == '\n') {
+                text.remove_prefix(1);
+                continue;
+            }
+        }
+        size_t end = text.find_first_of("\r\n");
+        std::string_view piece = text.substr(0, end);
+        if(m_line.size() + piece.size() > SSE_MAX_EVENT_SIZE) {
+            // The line is cut short and the event it belongs to is dropped
+            m_discard = true;
+        } else {
+            m_line.append(piece);
+        }
+        if(end == std::string_view::npos) {
+            return;
+        }
+        m_last_cr = text[end] == '\r';
+        text.remove_prefix(end + 1);
+        end_line();
+        if(!m_active || m_interrupted) {
+            return;
+        }
+    }
+}
+
+void sse_client::end_line() {
+    std::string_view line = m_line;
+    if(m_first_line) {
+        m_first_line = false;
+        if(line.starts_with("\xEF\xBB\xBF")) {
+            line.remove_prefix(3);
+        }
+    }
+    process_line(line);
+    m_line.clear();
+}
+
+void sse_client::process_line(std::string_view line) {
+    if(line.empty()) {
+        dispatch_event();
+        return;
+    }
+    if(line[0] == ':') {
+        // Comment, often sent just to keep the connection alive
+        return;
+    }
+    size_t colon = line.find(':');
+    std::string_view field = line.substr(0, colon), value;
+    if(colon != std::string_view::npos) {
+        value = line.substr(colon + 1);
+        if(value.starts_with(' ')) {
+            value.remove_prefix(1);
+        }
+    }
+    if(field == "data") {
+        if(m_data.size() + value.size() + 1 > SSE_MAX_EVENT_SIZE) {
+            m_discard = true;
+        } else {
+            m_data.append(value);
+            m_data.push_back('\n');
+        }
+    } else if(field == "event") {
+        m_type = value;
+    } else if(field == "id") {
+        if(value.find('\0') == std::string_view::npos) {
+            m_id_buffer = value;
+        }
+    } else if(field == "retry") {
+        uint32_t retry;
+        auto result = std::from_chars(value.data(), value.data() + value.size(), retry);
+        if(!value.empty() && result.ec == std::errc() && result.ptr == value.data() + value.size()) {
+            debug("sse_client: server asks for %u ms between reconnects\n", retry);
+            m_retry_ms = retry;
+        }
+    }
+}
+
+void sse_client::dispatch_event() {
+    m_last_event_id = m_id_buffer;
+    if(m_discard) {
+        warn("sse_client: dropping an event larger than %d bytes\n", SSE_MAX_EVENT_SIZE);
+    } else if(!m_data.empty()) {
+        m_data.pop_back();
+        // Events are getting through, so the failures so far are forgiven
+        m_failures = 0;
+        m_user_event_callback(m_type.empty() ? std::string_view("message") : std::string_view(m_type), m_data, m_last_event_id);
+    }
+    m_type.clear();
+    m_data.clear();
+    m_discard = false;
+}
+
+void sse_client::interrupt(err_t err, bool reconnect) {
+    // Dropping the connection from inside the client's callbacks is not safe, so it
+    // happens from the timer. Anything arriving until then is ignored
+    m_interrupted = true;
+    m_reconnect = reconnect;
+    m_error = err;
+    m_open = false;
+    schedule(1);
+}
+
+void sse_client::reconnect(err_t err) {
+    m_open = false;
+    uint64_t delay = (uint64_t)m_retry_ms << std::min(m_failures, (uint8_t)16);
+    delay = std::min(delay, (uint64_t)std::max(m_retry_ms, (uint32_t)SSE_MAX_RETRY_MS));
+    if(m_failures < UINT8_MAX) {
+        m_failures++;
+    }
+    warn("sse_client: '%s', reconnecting in %u ms\n", tcp_perror(err).c_str(), (uint32_t)delay);
+    schedule(delay);
+    m_user_error_callback(err);
+}
+
+void sse_client::finish(err_t err) {
+    m_active = false;
+    m_open = false;
+    m_watchdog.cancel();
+    m_user_error_callback(err);
+}
+
+void sse_client::schedule(uint32_t delay_ms) {
+    m_timer.start(delay_ms);
+}
+
+void sse_client::body_callback(std::span<const uint8_t> data) {
+    if(!m_active || m_interrupted) {
+        return;
+    }
+    m_received += data.size();
+    if(!m_validated && !validate()) {
+        return;
+    }
+    parse({(const char*)data.data(), data.size()});
+}
+
+void sse_client::response_callback() {
+    if(!m_active || m_interrupted) {
+        return;
+    }
+    if(!m_validated && !validate()) {
+        return;
+    }
+    // The body ended, which for an event stream means the server closed it
+    reconnect(ERR_CLSD);
+}
+
+void sse_client::closed_callback() {
+    // A pending timer already takes care of what happens next
+    if(!m_active || m_interrupted || m_timer.armed()) {
+        return;
+    }
+    reconnect(ERR_CLSD);
+}
+
+void sse_client::error_callback(err_t err) {
+    if(!m_active || m_interrupted || m_timer.armed()) {
+        return;
+    }
+    reconnect(err);
+}
+
+void sse_client::timer_callback() {
+    if(m_interrupted) {
+        // The close this causes is ignored while m_interrupted is set
+        m_client.url(m_url);
+        m_interrupted = false;
+        // Nothing more to do if the caller stopped it
+        if(m_active && m_reconnect) {
+            reconnect(m_error);
+        } else if(m_active) {
+            finish(m_error);
+        }
+    } else if(m_active) {
+        connect();
+    }
+}
+
+void sse_client::watchdog_callback() {
+    if(!m_active) {
+        return;
+    }
+    // Only a stream that is open or being opened can stall, not one waiting to reconnect
+    if(!m_timer.armed() && m_received == m_watched) {
+        warn("sse_client: nothing for %u ms\n", m_idle_timeout_ms);
+        interrupt(ERR_TIMEOUT, true);
+    }
+    m_watched = m_received;
+    if(m_idle_timeout_ms != 0) {
+        m_watchdog.start(m_idle_timeout_ms);
+    }
+}
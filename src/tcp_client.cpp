@@ -13,18 +13,29 @@ tcp_client::tcp_client()
     , sent_len(0)
     , buffer_len(0)
     , tcp_controlblock(nullptr)
+    , race_controlblock(nullptr)
     , remote_addr({0})
     , user_receive_callback([](){})
     , user_connected_callback([](){})
     , user_poll_callback([](){})
     , user_closed_callback([](){})
+    , user_sent_callback([](){})
     , user_error_callback([](err_t){})
 {
     debug1("Initializing DNS...\n");
     dns_init();
     ip_addr_t dnsserver;
-    ip4addr_aton("1.1.1.1", &dnsserver);
+    ipaddr_aton("1.1.1.1", &dnsserver);
     dns_setserver(0, &dnsserver);
+#if LWIP_IPV6
+    ipaddr_aton("2606:4700:4700::1111", &dnsserver);
+    dns_setserver(1, &dnsserver);
+#endif
+
+    eyeballs.on_attempt(std::bind(&tcp_client::start_attempt, this, std::placeholders::_1, std::placeholders::_2));
+    eyeballs.on_failed([this](err_t err){
+        close(err);
+    });
     
     debug1("Initializing TCP Client\n");
     initialized_ = init();
@@ -42,7 +53,7 @@ bool tcp_client::init() {
         error1("tcp_controlblock != null!\n");
         return false;
     }
-    tcp_controlblock = tcp_new_ip_type(IPADDR_TYPE_V4);
+    tcp_controlblock = tcp_new_ip_type(IPADDR_TYPE_ANY);
     if(tcp_controlblock == nullptr) {
         error1("Failed to create tcp control block");
         return false;
@@ -73,6 +84,17 @@ bool tcp_client::write(std::span<const uint8_t> data) {
     return err == ERR_OK;
 }
 
+size_t tcp_client::writable() const {
+    if(tcp_controlblock == nullptr) {
+        return 0;
+    }
+    cyw43_arch_lwip_begin();
+    // tcp_write also fails once too many segments are queued, whatever the byte count
+    size_t space = tcp_sndqueuelen(tcp_controlblock) < TCP_SND_QUEUELEN ? tcp_sndbuf(tcp_controlblock) : 0;
+    cyw43_arch_lwip_end();
+    return space;
+}
+
 void tcp_client::flush() {
     cyw43_arch_lwip_begin();
     err_t err = tcp_output(tcp_controlblock);
@@ -90,7 +112,7 @@ bool tcp_client::initialized() const {
 }
 
 bool tcp_client::connect(ip_addr_t addr, uint16_t port) {
-    debug("tcp_client::connect to %s:%d\n", ip4addr_ntoa(&addr), port);
+    debug("tcp_client::connect to %s:%d\n", ipaddr_ntoa(&addr), port);
     remote_addr = addr;
     port_ = port;
 
@@ -99,18 +121,15 @@ bool tcp_client::connect(ip_addr_t addr, uint16_t port) {
 
 bool tcp_client::connect(std::string addr, uint16_t port) {
     info("tcp_client::connect to %s:%d\n", addr.c_str(), port);
-    err_t err = dns_gethostbyname(addr.c_str(), &remote_addr, dns_callback, this);
     port_ = port;
-    if(err == ERR_OK) {
-        debug1("No dns lookup needed\n");
-        err = connect();
-    } else if(err != ERR_INPROGRESS) {
-        error("gethostbyname failed with error code %d\n", err);
+    err_t err = eyeballs.resolve(addr);
+    if(err != ERR_OK && err != ERR_INPROGRESS) {
+        error("tcp_client::connect failed with error code %s\n", tcp_perror(err).c_str());
         close(err);
         return false;
     }
 
-    return err == ERR_OK || err == ERR_INPROGRESS;
+    return true;
 }
 
 bool tcp_client::connect() {
@@ -121,8 +140,70 @@ bool tcp_client::connect() {
     return err == ERR_OK;
 }
 
+bool tcp_client::start_attempt(uint8_t slot, const ip_addr_t &addr) {
+    if(slot == 0) {
+        if(tcp_controlblock == nullptr) {
+            error1("tcp_client::start_attempt: tcp_controlblock is null\n");
+            return false;
+        }
+        remote_addr = addr;
+        return connect();
+    }
+
+    // Later attempts race the first one on a pcb of their own
+    cyw43_arch_lwip_begin();
+    err_t err = ERR_MEM;
+    race_controlblock = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if(race_controlblock != nullptr) {
+        tcp_arg(race_controlblock, this);
+        tcp_err(race_controlblock, race_err_callback);
+        err = tcp_connect(race_controlblock, &addr, port_, race_connected_callback);
+        if(err != ERR_OK) {
+            tcp_close(race_controlblock);
+            race_controlblock = nullptr;
+        }
+    }
+    cyw43_arch_lwip_end();
+
+    if(err != ERR_OK) {
+        error("tcp_client::start_attempt: tcp_connect returned %s\n", tcp_perror(err).c_str());
+    }
+    return err == ERR_OK;
+}
+
+void tcp_client::attempt_won(tcp_pcb *pcb) {
+    eyeballs.reset();
+    tcp_pcb *loser = pcb == tcp_controlblock ? race_controlblock : tcp_controlblock;
+    if(loser != nullptr) {
+        debug1("tcp_client: aborting slower connection attempt\n");
+        tcp_arg(loser, NULL);
+        tcp_poll(loser, NULL, 0);
+        tcp_sent(loser, NULL);
+        tcp_recv(loser, NULL);
+        tcp_err(loser, NULL);
+        tcp_abort(loser);
+    }
+    race_controlblock = nullptr;
+    if(pcb != tcp_controlblock) {
+        tcp_controlblock = pcb;
+        tcp_poll(tcp_controlblock, poll_callback, POLL_TIME_S * 2);
+        tcp_sent(tcp_controlblock, sent_callback);
+        tcp_recv(tcp_controlblock, recv_callback);
+        tcp_err(tcp_controlblock, err_callback);
+    }
+    connected_ = true;
+    user_connected_callback();
+}
+
 err_t tcp_client::close(err_t reason) {
     err_t err = ERR_OK;
+    eyeballs.reset();
+    if (race_controlblock != NULL) {
+        tcp_arg(race_controlblock, NULL);
+        tcp_err(race_controlblock, NULL);
+        tcp_abort(race_controlblock);
+        race_controlblock = NULL;
+    }
     if (tcp_controlblock != NULL) {
         debug1("Connection closing...\n");
         tcp_arg(tcp_controlblock, NULL);
@@ -148,22 +229,11 @@ err_t tcp_client::close(err_t reason) {
     return err;
 }
 
-void tcp_client::on_poll(uint8_t interval_seconds, std::function<void()> callback) {
+void tcp_client::on_poll(uint8_t interval_seconds, inplace_function<void()> callback) {
     tcp_poll(tcp_controlblock, poll_callback, interval_seconds * 2);
     user_poll_callback = callback;
 }
 
-void tcp_client::dns_callback(const char* name, const ip_addr_t *addr, void* arg) {
-    if(addr == nullptr) {
-        error1("dns_callback: addr is nullptr\n");
-        return;
-    }
-    info("ip of %s found: %s\n", name, ipaddr_ntoa(addr));
-    tcp_client *client = (tcp_client*)arg;
-    client->remote_addr = *addr;
-    client->connect();
-}
-
 err_t tcp_client::poll_callback(void* arg, tcp_pcb* pcb) {
     debug1("poll_callback\n");
     tcp_client *client = (tcp_client*)arg;
@@ -174,6 +244,7 @@ err_t tcp_client::poll_callback(void* arg, tcp_pcb* pcb) {
 err_t tcp_client::sent_callback(void* arg, tcp_pcb* pcb, u16_t len) {
     tcp_client *client = (tcp_client*)arg;
     debug("Sent %d bytes\n", len);
+    client->user_sent_callback();
     return ERR_OK;
 }
 
@@ -207,6 +278,11 @@ void tcp_client::err_callback(void* arg, err_t err) {
     tcp_client *client = (tcp_client*)arg;
     error("TCP error: code %s\n", tcp_perror(err).c_str());
     client->clear_pcb();
+    if(!client->connected_ && client->eyeballs.racing()) {
+        // Another candidate address may still connect
+        client->eyeballs.attempt_failed(0, err);
+        return;
+    }
     client->close(err);
 }
 
@@ -217,8 +293,27 @@ err_t tcp_client::connected_callback(void* arg, tcp_pcb* pcb, err_t err) {
         error("connect failed with error code %s\n", tcp_perror(err).c_str());
         return client->close(err);
     }
-    client->connected_ = true;
-    client->user_connected_callback();
+    client->attempt_won(pcb);
+    return ERR_OK;
+}
+
+void tcp_client::race_err_callback(void* arg, err_t err) {
+    tcp_client *client = (tcp_client*)arg;
+    debug("tcp_client::race_err_callback: %s\n", tcp_perror(err).c_str());
+    client->race_controlblock = nullptr;
+    client->eyeballs.attempt_failed(1, err);
+}
+
+err_t tcp_client::race_connected_callback(void* arg, tcp_pcb* pcb, err_t err) {
+    tcp_client *client = (tcp_client*)arg;
+    debug1("tcp_client::race_connected_callback\n");
+    if(err != ERR_OK) {
+        client->race_controlblock = nullptr;
+        client->eyeballs.attempt_failed(1, err);
+        return err;
+    }
+    client->remote_addr = client->eyeballs.candidate(1);
+    client->attempt_won(pcb);
     return ERR_OK;
 }
 
@@ -14,17 +14,23 @@ tcp_tls_client::tcp_tls_client(std::span<uint8_t> cert)
     , sent_len(0)
     , buffer_len(0)
     , tcp_controlblock(nullptr)
+    , race_controlblock(nullptr)
     , remote_addr({0})
     , user_receive_callback([](){})
     , user_connected_callback([](){})
     , user_poll_callback([](){})
     , user_closed_callback([](){})
+    , user_sent_callback([](){})
     , user_error_callback([](err_t){})
 {
     if(tls_config == nullptr) {
         debug1("Creating tls_config...\n");
         tls_config = altcp_tls_create_config_client(cert.data(), cert.size());
     }
+    eyeballs.on_attempt(std::bind(&tcp_tls_client::start_attempt, this, std::placeholders::_1, std::placeholders::_2));
+    eyeballs.on_failed([this](err_t err){
+        close(err);
+    });
 }
 
 tcp_tls_client::~tcp_tls_client() {
@@ -41,7 +47,7 @@ bool tcp_tls_client::init() {
         error1("tcp_controlblock != null!\n");
         return false;
     }
-    tcp_controlblock = altcp_tls_new(tls_config, IPADDR_TYPE_V4);
+    tcp_controlblock = altcp_tls_new(tls_config, IPADDR_TYPE_ANY);
     if(tcp_controlblock == nullptr) {
         error1("Failed to create tcp control block\n");
         return false;
@@ -96,6 +102,17 @@ bool tcp_tls_client::write(std::span<const uint8_t> data) {
     return err == ERR_OK;
 }
 
+size_t tcp_tls_client::writable() const {
+    if(tcp_controlblock == nullptr) {
+        return 0;
+    }
+    cyw43_arch_lwip_begin();
+    // altcp_write also fails once too many segments are queued, whatever the byte count
+    size_t space = altcp_sndqueuelen(tcp_controlblock) < TCP_SND_QUEUELEN ? altcp_sndbuf(tcp_controlblock) : 0;
+    cyw43_arch_lwip_end();
+    return space;
+}
+
 void tcp_tls_client::flush() {
     cyw43_arch_lwip_begin();
     err_t err = altcp_output(tcp_controlblock);
@@ -106,6 +123,13 @@ void tcp_tls_client::flush() {
 
 err_t tcp_tls_client::close(err_t reason) {
     err_t err = ERR_OK;
+    eyeballs.reset();
+    if (race_controlblock != NULL) {
+        altcp_arg(race_controlblock, NULL);
+        altcp_err(race_controlblock, NULL);
+        altcp_abort(race_controlblock);
+        race_controlblock = NULL;
+    }
     if (tcp_controlblock != NULL) {
         debug1("Connection closing...\n");
         altcp_arg(tcp_controlblock, NULL);
@@ -139,18 +163,17 @@ bool tcp_tls_client::connect(std::string hostname, uint16_t port) {
     int code = mbedtls_ssl_set_hostname(ssl_context, hostname.c_str());
     debug("mbedtls_ssl_set_hostname rc = %d\n", code);
 
-    err_t err = dns_gethostbyname(hostname.c_str(), &remote_addr, dns_callback, this);
+    hostname_ = hostname;
     port_ = port;
-    if(err == ERR_OK) {
-        debug1("No dns lookup needed\n");
-        err = connect();
-    } else if(err != ERR_INPROGRESS) {
-        error("gethostbyname failed with error code %d\n", err);
+    err_t err = eyeballs.resolve(hostname);
+    if(err != ERR_OK && err != ERR_INPROGRESS) {
+        std::string err_str = tcp_perror(err);
+        error("tcp_tls_client::connect failed with error code %*s\n", err_str.size(), err_str.data());
         close(err);
         return false;
     }
 
-    return err == ERR_OK || err == ERR_INPROGRESS;
+    return true;
 }
 
 bool tcp_tls_client::connect() {
@@ -161,15 +184,62 @@ bool tcp_tls_client::connect() {
     return err == ERR_OK;
 }
 
-void tcp_tls_client::dns_callback(const char* name, const ip_addr_t *addr, void* arg) {
-    if(addr == nullptr) {
-        error1("dns_callback: addr is nullptr\n");
-        return;
+bool tcp_tls_client::start_attempt(uint8_t slot, const ip_addr_t &addr) {
+    if(slot == 0) {
+        if(tcp_controlblock == nullptr) {
+            error1("tcp_tls_client::start_attempt: tcp_controlblock is null\n");
+            return false;
+        }
+        remote_addr = addr;
+        return connect();
     }
-    info("ip of %s found: %s\n", name, ipaddr_ntoa(addr));
-    tcp_tls_client *client = (tcp_tls_client*)arg;
-    client->remote_addr = *addr;
-    client->connect();
+
+    // Later attempts race the first one with a TLS session of their own
+    cyw43_arch_lwip_begin();
+    err_t err = ERR_MEM;
+    race_controlblock = altcp_tls_new(tls_config, IPADDR_TYPE_ANY);
+    if(race_controlblock != nullptr) {
+        mbedtls_ssl_context* ssl_context = (mbedtls_ssl_context*)altcp_tls_context(race_controlblock);
+        mbedtls_ssl_set_hostname(ssl_context, hostname_.c_str());
+        altcp_arg(race_controlblock, this);
+        altcp_err(race_controlblock, race_err_callback);
+        err = altcp_connect(race_controlblock, &addr, port_, race_connected_callback);
+        if(err != ERR_OK) {
+            altcp_close(race_controlblock);
+            race_controlblock = nullptr;
+        }
+    }
+    cyw43_arch_lwip_end();
+
+    if(err != ERR_OK) {
+        std::string err_str = tcp_perror(err);
+        error("tcp_tls_client::start_attempt: altcp_connect returned %*s\n", err_str.size(), err_str.data());
+    }
+    return err == ERR_OK;
+}
+
+void tcp_tls_client::attempt_won(altcp_pcb *pcb) {
+    eyeballs.reset();
+    altcp_pcb *loser = pcb == tcp_controlblock ? race_controlblock : tcp_controlblock;
+    if(loser != nullptr) {
+        debug1("tcp_tls_client: aborting slower connection attempt\n");
+        altcp_arg(loser, NULL);
+        altcp_poll(loser, NULL, 0);
+        altcp_sent(loser, NULL);
+        altcp_recv(loser, NULL);
+        altcp_err(loser, NULL);
+        altcp_abort(loser);
+    }
+    race_controlblock = nullptr;
+    if(pcb != tcp_controlblock) {
+        tcp_controlblock = pcb;
+        altcp_poll(tcp_controlblock, poll_callback, POLL_TIME_S * 2);
+        altcp_sent(tcp_controlblock, sent_callback);
+        altcp_recv(tcp_controlblock, recv_callback);
+        altcp_err(tcp_controlblock, err_callback);
+    }
+    connected_ = true;
+    user_connected_callback();
 }
 
 err_t tcp_tls_client::connected_callback(void* arg, altcp_pcb* pcb, err_t err) {
@@ -180,8 +250,28 @@ err_t tcp_tls_client::connected_callback(void* arg, altcp_pcb* pcb, err_t err) {
         error("connect failed with error code %*s\n", err_str.size(), err_str.data());
         return client->close(err);
     }
-    client->connected_ = true;
-    client->user_connected_callback();
+    client->attempt_won(pcb);
+    return ERR_OK;
+}
+
+void tcp_tls_client::race_err_callback(void* arg, err_t err) {
+    tcp_tls_client *client = (tcp_tls_client*)arg;
+    std::string err_str = tcp_perror(err);
+    debug("tcp_tls_client::race_err_callback: %*s\n", err_str.size(), err_str.data());
+    client->race_controlblock = nullptr;
+    client->eyeballs.attempt_failed(1, err);
+}
+
+err_t tcp_tls_client::race_connected_callback(void* arg, altcp_pcb* pcb, err_t err) {
+    tcp_tls_client *client = (tcp_tls_client*)arg;
+    debug1("tcp_tls_client::race_connected_callback\n");
+    if(err != ERR_OK) {
+        client->race_controlblock = nullptr;
+        client->eyeballs.attempt_failed(1, err);
+        return err;
+    }
+    client->remote_addr = client->eyeballs.candidate(1);
+    client->attempt_won(pcb);
     return ERR_OK;
 }
 
@@ -229,7 +319,9 @@ err_t tcp_tls_client::poll_callback(void* arg, altcp_pcb* pcb) {
 }
 
 err_t tcp_tls_client::sent_callback(void* arg, altcp_pcb* pcb, uint16_t len) {
+    tcp_tls_client *client = (tcp_tls_client*)arg;
     debug("Sent %d bytes\n", len);
+    client->user_sent_callback();
     return ERR_OK;
 }
 
@@ -238,5 +330,10 @@ void tcp_tls_client::err_callback(void* arg, err_t err) {
     std::string err_str = tcp_perror(err);
     error("TCP error: code %*s\n", err_str.size(), err_str.data());
     client->clear_pcb();
+    if(!client->connected_ && client->eyeballs.racing()) {
+        // Another candidate address may still connect
+        client->eyeballs.attempt_failed(0, err);
+        return;
+    }
     client->close(err);
 }
\ No newline at end of file
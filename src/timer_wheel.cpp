@@ -0,0 +1,233 @@
+#include "timer_wheel.h"
+
+#include <hardware/sync.h>
+
+#include "logger.h"
+
+wheel_timer::wheel_timer()
+    : m_callback([](){})
+{
+}
+
+wheel_timer::wheel_timer(inplace_function<void()> callback)
+    : m_callback(callback)
+{
+}
+
+wheel_timer::wheel_timer(wheel_timer &&other)
+    : m_callback(other.m_callback)
+{
+    other.cancel();
+}
+
+wheel_timer &wheel_timer::operator=(wheel_timer &&other) {
+    cancel();
+    m_callback = other.m_callback;
+    other.cancel();
+    return *this;
+}
+
+wheel_timer::~wheel_timer() {
+    cancel();
+}
+
+void wheel_timer::start(uint32_t delay_ms) {
+    timer_wheel::shared().start(*this, delay_ms);
+}
+
+void wheel_timer::cancel() {
+    if(armed()) {
+        timer_wheel::shared().cancel(*this);
+    }
+}
+
+timer_wheel::timer_wheel()
+    : m_tick(current_tick())
+{
+}
+
+timer_wheel::~timer_wheel() {
+    if(m_alarm != 0) {
+        cancel_alarm(m_alarm);
+        m_alarm = 0;
+    }
+}
+
+timer_wheel &timer_wheel::shared() {
+    static timer_wheel wheel;
+    return wheel;
+}
+
+void timer_wheel::start(wheel_timer &timer, uint32_t delay_ms) {
+    // Timers are started from thread context and from the alarm alike
+    uint32_t interrupts = save_and_disable_interrupts();
+    if(timer.armed()) {
+        unlink(timer);
+    } else {
+        if(m_pending == 0) {
+            // Nothing is on the wheel, so it can catch up with the clock at once
+            m_tick = current_tick();
+        }
+        m_pending++;
+    }
+    // The first tick that starts at or after the deadline, and never one the wheel has already run
+    const uint64_t tick_us = TIMER_WHEEL_TICK_MS * 1000ull;
+    timer.m_expires = (to_us_since_boot(get_absolute_time()) + delay_ms * 1000ull + tick_us - 1) / tick_us;
+    if((int32_t)(timer.m_expires - m_tick) <= 0) {
+        timer.m_expires = m_tick + 1;
+    }
+    place(timer);
+    if(!m_running) {
+        arm();
+    }
+    restore_interrupts(interrupts);
+}
+
+void timer_wheel::cancel(wheel_timer &timer) {
+    uint32_t interrupts = save_and_disable_interrupts();
+    if(timer.armed()) {
+        unlink(timer);
+        m_pending--;
+    }
+    // The alarm is left as it is, finding nothing due is cheaper than setting it again
+    restore_interrupts(interrupts);
+}
+
+void timer_wheel::place(wheel_timer &timer) {
+    uint32_t delta = timer.m_expires - m_tick, expires = timer.m_expires;
+    uint8_t level = 0;
+    while(level + 1 < levels && delta >> (slot_bits * (level + 1)) != 0) {
+        level++;
+    }
+    if(delta >> (slot_bits * levels) != 0) {
+        // Past the last level, the timer waits in its furthest slot and is placed again from there
+        expires = m_tick + (1u << (slot_bits * levels)) - 1;
+    }
+    uint16_t index = expires >> (slot_bits * level) & (slots - 1);
+    timer.m_slot = level * slots + index;
+    wheel_timer *&head = m_slots[timer.m_slot];
+    timer.m_next = head;
+    if(head) {
+        head->m_pprev = &timer.m_next;
+    }
+    head = &timer;
+    timer.m_pprev = &head;
+    m_occupied[level] |= 1ull << index;
+}
+
+void timer_wheel::unlink(wheel_timer &timer) {
+    *timer.m_pprev = timer.m_next;
+    if(timer.m_next) {
+        timer.m_next->m_pprev = timer.m_pprev;
+    }
+    if(timer.m_slot != detached && m_slots[timer.m_slot] == nullptr) {
+        m_occupied[timer.m_slot / slots] &= ~(1ull << (timer.m_slot % slots));
+    }
+    timer.m_next = nullptr;
+    timer.m_pprev = nullptr;
+}
+
+void timer_wheel::cascade(uint8_t level) {
+    uint16_t index = m_tick >> (slot_bits * level) & (slots - 1);
+    wheel_timer *timer = m_slots[level * slots + index];
+    m_slots[level * slots + index] = nullptr;
+    m_occupied[level] &= ~(1ull << index);
+    while(timer) {
+        wheel_timer *next = timer->m_next;
+        place(*timer);
+        timer = next;
+    }
+}
+
+void timer_wheel::run(uint32_t tick) {
+    m_tick = tick;
+    // A slot of a higher level comes up once every tick below it is zero
+    for(uint8_t level = 1; level < levels && (tick & ((1u << (slot_bits * level)) - 1)) == 0; level++) {
+        cascade(level);
+    }
+    uint16_t index = tick & (slots - 1);
+    wheel_timer *expired = m_slots[index];
+    m_slots[index] = nullptr;
+    m_occupied[0] &= ~(1ull << index);
+    if(expired) {
+        expired->m_pprev = &expired;
+    }
+    for(wheel_timer *timer = expired; timer; timer = timer->m_next) {
+        timer->m_slot = detached;
+    }
+    // A callback may cancel or start any timer, those still in expired included, or destroy its own
+    while(expired) {
+        wheel_timer &timer = *expired;
+        unlink(timer);
+        m_pending--;
+        timer.m_callback();
+    }
+}
+
+bool timer_wheel::next_event(uint32_t &tick) const {
+    bool found = false;
+    for(uint8_t level = 0; level < levels; level++) {
+        if(m_occupied[level] == 0) {
+            continue;
+        }
+        // The next time each slot of this level comes up, starting from the one after the current
+        uint8_t shift = slot_bits * level;
+        uint32_t turn = (m_tick >> shift) + 1;
+        uint8_t first = turn & (slots - 1);
+        uint64_t rotated = m_occupied[level] >> first | (first ? m_occupied[level] << (slots - first) : 0);
+        uint32_t at = (turn + __builtin_ctzll(rotated)) << shift;
+        if(!found || (int32_t)(at - m_tick) < (int32_t)(tick - m_tick)) {
+            tick = at;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void timer_wheel::arm() {
+    uint32_t tick;
+    if(!next_event(tick) || (m_alarm != 0 && (int32_t)(tick - m_alarm_tick) >= 0)) {
+        return;
+    }
+    if(m_alarm != 0) {
+        cancel_alarm(m_alarm);
+    }
+    m_alarm_tick = tick;
+    m_alarm = add_alarm_in_us(delay_us(tick), alarm_callback, this, true);
+    if(m_alarm < 0) {
+        error1("timer_wheel: no hardware alarm left\n");
+        m_alarm = 0;
+    }
+}
+
+uint32_t timer_wheel::current_tick() {
+    return to_us_since_boot(get_absolute_time()) / (TIMER_WHEEL_TICK_MS * 1000ull);
+}
+
+int64_t timer_wheel::delay_us(uint32_t tick) {
+    const uint64_t tick_us = TIMER_WHEEL_TICK_MS * 1000ull;
+    uint64_t now = to_us_since_boot(get_absolute_time());
+    int64_t delay = (int64_t)(int32_t)(tick - (uint32_t)(now / tick_us)) * tick_us - (int64_t)(now % tick_us);
+    return delay > 0 ? delay : 1;
+}
+
+int64_t timer_wheel::alarm_callback(alarm_id_t, void* user_data) {
+    timer_wheel *wheel = (timer_wheel*)user_data;
+    uint32_t now = current_tick(), tick;
+    wheel->m_running = true;
+    while(wheel->next_event(tick) && (int32_t)(now - tick) >= 0) {
+        wheel->run(tick);
+    }
+    // Nothing is due before the next event, so the ticks up to now can be skipped
+    if((int32_t)(now - wheel->m_tick) > 0) {
+        wheel->m_tick = now;
+    }
+    wheel->m_running = false;
+    if(!wheel->next_event(tick)) {
+        wheel->m_alarm = 0;
+        // Do not reschedule the alarm
+        return 0;
+    }
+    wheel->m_alarm_tick = tick;
+    return delay_us(tick);
+}
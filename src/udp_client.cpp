@@ -21,8 +21,12 @@ udp_client::udp_client()
     debug1("Initializing DNS...\n");
     dns_init();
     ip_addr_t dnsserver;
-    ip4addr_aton("1.1.1.1", &dnsserver);
+    ipaddr_aton("1.1.1.1", &dnsserver);
     dns_setserver(0, &dnsserver);
+#if LWIP_IPV6
+    ipaddr_aton("2606:4700:4700::1111", &dnsserver);
+    dns_setserver(1, &dnsserver);
+#endif
     
     debug1("Initializing UDP Client\n");
     initialized_ = init();
@@ -40,7 +44,7 @@ bool udp_client::init() {
         error1("udp_controlblock != null!\n");
         return false;
     }
-    udp_controlblock = udp_new_ip_type(IPADDR_TYPE_V4);
+    udp_controlblock = udp_new_ip_type(IPADDR_TYPE_ANY);
     if(udp_controlblock == nullptr) {
         error1("Failed to create tcp control block");
         return false;
@@ -87,7 +91,7 @@ bool udp_client::connect() {
 }
 
 bool udp_client::connect(ip_addr_t addr, uint16_t port) {
-    debug("udp_client::connect to %s:%d\n", ip4addr_ntoa(&addr), port);
+    debug("udp_client::connect to %s:%d\n", ipaddr_ntoa(&addr), port);
     remote_addr = addr;
     this->port = port;
 
@@ -154,10 +158,10 @@ bool udp_client::connected() const {
     return connected_;
 }
 
-void udp_client::on_receive(std::function<void(const ip_addr_t*, uint16_t)> callback) {
+void udp_client::on_receive(inplace_function<void(const ip_addr_t*, uint16_t)> callback) {
     user_receive_callback = callback;
 }
 
-void udp_client::on_connect(std::function<void()> callback) {
+void udp_client::on_connect(inplace_function<void()> callback) {
     user_connected_callback = callback;
 }
\ No newline at end of file
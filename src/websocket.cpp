@@ -1,72 +1,89 @@
 #include "websocket.h"
 
+#include "tcp_client.h"
+#include "tcp_tls_client.h"
+
 #include "lwip/ip_addr.h"
 
-ws::websocket::websocket(tcp_base *socket)
+template <class Transport>
+ws::basic_websocket<Transport>::basic_websocket(Transport *socket)
     : tcp(socket)
     , user_receive_callback([](){})
     , user_poll_callback([](){})
     , user_close_callback([](){})
     , user_error_callback([](err_t){})
 {
-    tcp->on_receive(std::bind(&websocket::tcp_recv_callback, this));
-    tcp->on_closed(std::bind(&websocket::tcp_close_callback, this));
-    tcp->on_error(std::bind(&websocket::tcp_error_callback, this, std::placeholders::_1));
+    tcp->on_receive(std::bind(&basic_websocket::tcp_recv_callback, this));
+    tcp->on_closed(std::bind(&basic_websocket::tcp_close_callback, this));
+    tcp->on_error(std::bind(&basic_websocket::tcp_error_callback, this, std::placeholders::_1));
 }
 
-ws::websocket::~websocket() {
+template <class Transport>
+ws::basic_websocket<Transport>::~basic_websocket() {
     delete tcp;
 }
 
-bool ws::websocket::write_text(std::span<uint8_t> data) {
+template <class Transport>
+bool ws::basic_websocket<Transport>::write_text(std::span<uint8_t> data) {
     return write_frame(data, opcodes::text);
 }
 
-bool ws::websocket::write_binary(std::span<uint8_t> data) {
+template <class Transport>
+bool ws::basic_websocket<Transport>::write_binary(std::span<uint8_t> data) {
     return write_frame(data, opcodes::binary);
 }
 
-void ws::websocket::close(err_t reason) {
+template <class Transport>
+void ws::basic_websocket<Transport>::close(err_t reason) {
     tcp->close(reason);
 }
 
-bool ws::websocket::connected() {
+template <class Transport>
+bool ws::basic_websocket<Transport>::connected() {
     return tcp->connected();
 }
 
-size_t ws::websocket::read(std::span<uint8_t> data) {
+template <class Transport>
+size_t ws::basic_websocket<Transport>::read(std::span<uint8_t> data) {
     return tcp->read(data);
 }
 
-uint32_t ws::websocket::received_packet_size() {
+template <class Transport>
+uint32_t ws::basic_websocket<Transport>::received_packet_size() {
     return packet_size;
 }
 
-void ws::websocket::on_receive(std::function<void()> callback) {
+template <class Transport>
+void ws::basic_websocket<Transport>::on_receive(inplace_function<void()> callback) {
     user_receive_callback = callback;
 }
 
-void ws::websocket::on_poll(uint8_t interval_seconds, std::function<void()> callback) {
-    tcp->on_poll(interval_seconds, std::bind(&websocket::tcp_poll_callback, this));
+template <class Transport>
+void ws::basic_websocket<Transport>::on_poll(uint8_t interval_seconds, inplace_function<void()> callback) {
+    tcp->on_poll(interval_seconds, std::bind(&basic_websocket::tcp_poll_callback, this));
     user_poll_callback = callback;
 }
 
-void ws::websocket::on_closed(std::function<void()> callback) {
+template <class Transport>
+void ws::basic_websocket<Transport>::on_closed(inplace_function<void()> callback) {
     user_close_callback = callback;
 }
 
-void ws::websocket::on_error(std::function<void(err_t)> callback) {
+template <class Transport>
+void ws::basic_websocket<Transport>::on_error(inplace_function<void(err_t)> callback) {
     user_error_callback = callback;
 }
 
-void ws::websocket::mask(std::span<uint8_t> data, uint32_t masking_key) {
+template <class Transport>
+void ws::basic_websocket<Transport>::mask(std::span<uint8_t> data, uint32_t masking_key) {
     std::span<uint8_t> masking_bytes = {(uint8_t*)&masking_key, sizeof(masking_key)};
     for(uint32_t i = 0; i < data.size(); i++) {
         data[i] ^= masking_bytes[i % 4];
     }
 }
 
-void ws::websocket::tcp_recv_callback() {
+template <class Transport>
+void ws::basic_websocket<Transport>::tcp_recv_callback() {
     if(!tcp->available()) {
         return;
     }
@@ -111,15 +128,18 @@ void ws::websocket::tcp_recv_callback() {
     }
 }
 
-void ws::websocket::tcp_poll_callback() {
+template <class Transport>
+void ws::basic_websocket<Transport>::tcp_poll_callback() {
     user_poll_callback();
 }
 
-void ws::websocket::tcp_close_callback() {
+template <class Transport>
+void ws::basic_websocket<Transport>::tcp_close_callback() {
     user_close_callback();
 }
 
-void ws::websocket::tcp_error_callback(err_t reason) {
+template <class Transport>
+void ws::basic_websocket<Transport>::tcp_error_callback(err_t reason) {
     user_error_callback(reason);
 }
 
@@ -132,7 +152,8 @@ void ws::websocket::tcp_error_callback(err_t reason) {
                    (((x) & (u64_t)0x00ff000000000000ULL) >> 40) | \
                    (((x) & (u64_t)0xff00000000000000ULL) >> 56))
 
-bool ws::websocket::write_frame(std::span<uint8_t> data, opcodes opcode) {
+template <class Transport>
+bool ws::basic_websocket<Transport>::write_frame(std::span<uint8_t> data, opcodes opcode) {
     for(int i = -14; i < 0; i++) {
         if(data[i] != ' ') {
             error1("ws::websocket::write_frame expects 14 extra space bytes before the beginning of the given span!\n");
@@ -179,4 +200,8 @@ bool ws::websocket::write_frame(std::span<uint8_t> data, opcodes opcode) {
     tcp->flush();
     debug("tcp->write result: %d\n", res);
     return res;
-}
\ No newline at end of file
+}
+
+template class ws::basic_websocket<tcp_base>;
+template class ws::basic_websocket<tcp_client>;
+template class ws::basic_websocket<tcp_tls_client>;
@@ -0,0 +1,58 @@
+#include <string_view>
+
+#include "alloc_counter.h"
+#include "http_client.h"
+#include "prepared_request.h"
+
+#include "canned_transport.h"
+#include "test.h"
+
+static const std::string_view response = "HTTP/1.1 200 OK\r\nContent-Length: 11\r\nContent-Type: text/plain\r\n\r\nhello world";
+
+static size_t get_allocations(http_client &client, canned_transport &transport) {
+    alloc_counter::reset();
+    client.get("/status");
+    transport.answer();
+    return alloc_counter::allocations();
+}
+
+static size_t prepared_allocations(http_client &client, canned_transport &transport, prepared_request &request) {
+    alloc_counter::reset();
+    client.send(request);
+    transport.answer();
+    return alloc_counter::allocations();
+}
+
+int main() {
+    // Counting must see C and C++ allocations alike
+    alloc_counter::reset();
+    void *block = malloc(16);
+    block = realloc(block, 32);
+    free(block);
+    delete new int(1);
+    CHECK(alloc_counter::allocations() == 3);
+    CHECK(alloc_counter::deallocations() == 3);
+    CHECK(alloc_counter::bytes_allocated() == 48 + sizeof(int));
+
+    canned_transport *transport = new canned_transport(response);
+    http_client client("http://example.com/", transport);
+    int responses = 0;
+    client.on_response([&](){
+        responses++;
+    });
+    prepared_request request = client.prepare("GET", "/status");
+
+    // The first requests size the buffers; after that a request is steady state
+    for(int i = 0; i < 3; i++) {
+        get_allocations(client, *transport);
+        prepared_allocations(client, *transport, request);
+    }
+    size_t get = get_allocations(client, *transport);
+    size_t prepared = prepared_allocations(client, *transport, request);
+    printf("allocations per request: get %zu, prepared %zu\n", get, prepared);
+    CHECK(responses == 8);
+    CHECK(client.response().get_body() == "hello world");
+    CHECK(get == 0);
+    CHECK(prepared == 0);
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <string>
+
+#include "alloc_counter.h"
+#include "http_response.h"
+
+#include "test.h"
+
+// Built twice, once as is and once with HTTP_STATIC_SIZE
+
+static std::string body_of(size_t size) {
+    std::string body;
+    for(size_t i = 0; i < size; i++) {
+        body += (char)('a' + i % 26);
+    }
+    return body;
+}
+
+// Parses a response with a size byte body, arriving in piece byte segments
+static void feed(http_response &response, size_t size, bool chunked, size_t piece) {
+    std::string body = body_of(size), message = "HTTP/1.1 200 OK\r\n";
+    if(chunked) {
+        message += "Transfer-Encoding: chunked\r\n\r\n";
+        for(size_t i = 0; i < size; i += 700) {
+            size_t length = std::min((size_t)700, size - i);
+            char size_line[16];
+            snprintf(size_line, sizeof(size_line), "%zx\r\n", length);
+            message += size_line + body.substr(i, length) + "\r\n";
+        }
+        message += "0\r\n\r\n";
+    } else {
+        message += "Content-Length: " + std::to_string(size) + "\r\n\r\n" + body;
+    }
+    response.clear();
+    for(size_t i = 0; i < message.size(); i += piece) {
+        std::string segment = message.substr(i, piece);
+        response.parse({(uint8_t*)segment.data(), segment.size()});
+    }
+    std::string visited;
+    response.visit_body([&visited](std::span<const uint8_t> block){
+        visited.append((const char*)block.data(), block.size());
+    });
+    CHECK(visited == body);
+    CHECK(response.body_size() == size);
+    size_t allocations = alloc_counter::allocations();
+    CHECK(response.get_body() == body);
+#ifdef HTTP_STATIC_SIZE
+    // Laid out after the head rather than on the heap
+    CHECK(alloc_counter::allocations() == allocations);
+#else
+    CHECK(alloc_counter::allocations() - allocations <= 1);
+#endif
+}
+
+int main() {
+    http_response response;
+    buffer_pool &pool = buffer_pool::shared();
+    for(int i = 0; i < 50; i++) {
+        feed(response, 3000, i & 1, 97 + i);
+    }
+    feed(response, 0, false, 10);
+    feed(response, HTTP_BUFFER_BLOCK_SIZE, false, 10);
+    feed(response, HTTP_BUFFER_BLOCK_SIZE + 1, true, 3);
+
+    // Steady polling keeps reusing the same few blocks
+    feed(response, 3000, false, 536);
+    response.clear();
+    CHECK(pool.in_use() == 0);
+    size_t steady = pool.idle();
+#ifdef HTTP_STATIC_SIZE
+    CHECK(steady == HTTP_BUFFER_POOL_BLOCKS);
+#else
+    CHECK(steady == (3000 + HTTP_BUFFER_BLOCK_SIZE - 1) / HTTP_BUFFER_BLOCK_SIZE);
+#endif
+    for(int i = 0; i < 20; i++) {
+        feed(response, 3000, false, 536);
+    }
+    response.clear();
+    CHECK(pool.idle() == steady);
+
+    // A one-off large body takes many blocks, which are given back over the following responses
+    feed(response, 40000, false, 1460);
+    CHECK(pool.in_use() >= 40000 / HTTP_BUFFER_BLOCK_SIZE);
+    response.clear();
+    CHECK(pool.in_use() == 0);
+    for(int i = 0; i < 40; i++) {
+        feed(response, 3000, false, 536);
+        response.clear();
+    }
+    CHECK(pool.idle() == steady);
+
+    // A head past HTTP_MAX_HEAD_SIZE is refused rather than outgrowing the header offsets
+    response.clear();
+    std::string head = "HTTP/1.1 200 OK\r\n";
+    while(head.size() < HTTP_MAX_HEAD_SIZE) {
+        head += "X-Padding: " + std::string(100, 'p') + "\r\n";
+    }
+    for(size_t i = 0; i < head.size(); i += 1460) {
+        std::string segment = head.substr(i, 1460);
+        response.parse({(uint8_t*)segment.data(), segment.size()});
+    }
+    // Failed, so the end of the head is not taken any more
+    std::string rest = "\r\n";
+    CHECK(response.parse({(uint8_t*)rest.data(), rest.size()}) == 0);
+    return 0;
+}
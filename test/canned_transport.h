@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include "tcp_base.h"
+
+// Answers every request written to it with the same response, sent as is and
+// followed by body_length generated bytes (see body_byte), segment_size bytes
+// per receive callback. Nothing is allocated, so the only heap traffic in a
+// request is the client's own.
+class canned_transport : public tcp_base {
+public:
+    canned_transport(std::string_view response, size_t body_length = 0, size_t segment_size = BUF_SIZE)
+        : m_response(response)
+        , m_total(response.size() + body_length)
+        , m_segment_size(segment_size)
+    {
+    }
+
+    static uint8_t body_byte(size_t i) {
+        return (uint8_t)(i * 31 + i / 251);
+    }
+
+    bool init() override {
+        return true;
+    }
+    int available() const override {
+        return m_delivered - m_read;
+    }
+    size_t read(std::span<uint8_t> out) override {
+        size_t count = std::min(out.size(), m_delivered - m_read);
+        for(size_t i = 0; i < count; i++, m_read++) {
+            out[i] = m_read < m_response.size() ? m_response[m_read] : body_byte(m_read - m_response.size());
+        }
+        return count;
+    }
+    bool write(std::span<const uint8_t> data) override {
+        for(uint8_t c : data) {
+            m_match = c == "\r\n\r\n"[m_match] ? m_match + 1 : (c == '\r' ? 1 : 0);
+            if(m_match == 4) {
+                m_match = 0;
+                m_requests++;
+            }
+        }
+        return true;
+    }
+    size_t writable() const override {
+        return 8192;
+    }
+    void flush() override {}
+    bool connect(std::string host, uint16_t port) override {
+        m_connected = true;
+        m_connected_callback();
+        return true;
+    }
+    err_t close(err_t reason) override {
+        m_connected = false;
+        return ERR_OK;
+    }
+    bool connected() const override {
+        return m_connected;
+    }
+    bool initialized() const override {
+        return true;
+    }
+    bool secure() const override {
+        return false;
+    }
+    void on_receive(inplace_function<void()> callback) override {
+        m_receive_callback = callback;
+    }
+    void on_connected(inplace_function<void()> callback) override {
+        m_connected_callback = callback;
+    }
+    void on_poll(uint8_t, inplace_function<void()>) override {}
+    void on_closed(inplace_function<void()>) override {}
+    void on_error(inplace_function<void(err_t)>) override {}
+    void on_sent(inplace_function<void()>) override {}
+
+    // Delivers one whole response per request written since the last call
+    void answer() {
+        while(m_requests > 0) {
+            m_requests--;
+            m_delivered = m_read = 0;
+            while(m_delivered < m_total) {
+                m_delivered = std::min(m_delivered + m_segment_size, m_total);
+                m_receive_callback();
+            }
+        }
+    }
+
+private:
+    std::string_view m_response;
+    size_t m_total, m_segment_size;
+    size_t m_delivered = 0, m_read = 0, m_match = 0, m_requests = 0;
+    bool m_connected = false;
+    inplace_function<void()> m_receive_callback, m_connected_callback;
+};
@@ -0,0 +1,78 @@
+#include <string>
+
+#include "http_client.h"
+#include "loopback_server.h"
+
+#include "test.h"
+
+static const std::string head = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+static const std::string chunked =
+    "5;name=value\r\nhello\r\n"
+    "1\r\n \r\n"
+    "1A\r\nabcdefghijklmnopqrstuvwxyz\r\n"
+    "0\r\nX-Checksum: 1234\r\nX-Other: 5\r\n\r\n";
+static const std::string decoded = "hello abcdefghijklmnopqrstuvwxyz";
+
+struct outcome {
+    int responses = 0, errors = 0;
+    err_t error = ERR_OK;
+    std::string body, streamed;
+};
+
+// Fetches one response whose body follows the head piece_size bytes at a
+// time, into the buffer or through on_body_chunk
+static outcome fetch(std::string body, size_t piece_size, bool stream) {
+    static outcome result;
+    result = {};
+    loopback_transport *transport = new loopback_transport();
+    loopback_server server(*transport, 2);
+    server.respond = [](const std::string &){
+        return head;
+    };
+    http_client client("http://example.com/", transport);
+    client.on_response([&client](){
+        result.responses++;
+        result.body = client.response().get_body();
+    });
+    client.on_error([](err_t err){
+        result.errors++;
+        result.error = err;
+    });
+    if(stream) {
+        client.on_body_chunk([](std::span<const uint8_t> chunk){
+            result.streamed.append((const char*)chunk.data(), chunk.size());
+        });
+    }
+    client.get("/");
+    server.advance(10);
+    CHECK(server.requests.size() == 1);
+    for(size_t at = 0; at < body.size(); at += piece_size) {
+        std::string piece = body.substr(at, piece_size);
+        server.end().write({(const uint8_t*)piece.data(), piece.size()});
+        server.advance(1);
+    }
+    server.advance(10);
+    return result;
+}
+
+int main() {
+    // Extensions are ignored and the trailer skipped, wherever the segments split the framing
+    for(size_t piece_size : {1, 2, 3, 7, 1460}) {
+        outcome buffered = fetch(chunked, piece_size, false);
+        CHECK(buffered.responses == 1 && buffered.errors == 0);
+        CHECK(buffered.body == decoded);
+
+        outcome streamed = fetch(chunked, piece_size, true);
+        CHECK(streamed.responses == 1 && streamed.errors == 0);
+        CHECK(streamed.streamed == decoded);
+        CHECK(streamed.body.empty());
+    }
+
+    // Malformed framing drops the connection rather than waiting for more
+    for(std::string bad : {"zz\r\nhello\r\n0\r\n\r\n", "5\r\nhelloXX0\r\n\r\n"}) {
+        outcome result = fetch(bad, 1460, false);
+        CHECK(result.responses == 0);
+        CHECK(result.errors == 1 && result.error == ERR_VAL);
+    }
+    return 0;
+}
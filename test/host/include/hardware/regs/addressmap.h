@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Memory mapped flash is an array the test owns
+extern uint8_t host_flash[];
+#define XIP_BASE ((uintptr_t)host_flash)
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+// Alarms run from host_advance_ms() on the calling thread, so there is nothing to mask
+inline uint32_t save_and_disable_interrupts() {
+    return 0;
+}
+
+inline void restore_interrupts(uint32_t) {}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "lwip/tcp.h"
+
+struct altcp_pcb;
+
+typedef err_t (*altcp_connected_fn)(void *arg, altcp_pcb *pcb, err_t err);
+typedef err_t (*altcp_recv_fn)(void *arg, altcp_pcb *pcb, pbuf *p, err_t err);
+typedef err_t (*altcp_sent_fn)(void *arg, altcp_pcb *pcb, u16_t len);
+typedef err_t (*altcp_poll_fn)(void *arg, altcp_pcb *pcb);
+typedef void (*altcp_err_fn)(void *arg, err_t err);
+
+void altcp_arg(altcp_pcb *pcb, void *arg);
+void altcp_recv(altcp_pcb *pcb, altcp_recv_fn recv);
+void altcp_sent(altcp_pcb *pcb, altcp_sent_fn sent);
+void altcp_poll(altcp_pcb *pcb, altcp_poll_fn poll, u8_t interval);
+void altcp_err(altcp_pcb *pcb, altcp_err_fn err);
+err_t altcp_connect(altcp_pcb *pcb, const ip_addr_t *addr, u16_t port, altcp_connected_fn connected);
+err_t altcp_write(altcp_pcb *pcb, const void *data, u16_t len, u8_t flags);
+err_t altcp_output(altcp_pcb *pcb);
+void altcp_recved(altcp_pcb *pcb, u16_t len);
+err_t altcp_close(altcp_pcb *pcb);
+void altcp_abort(altcp_pcb *pcb);
+u16_t altcp_sndbuf(altcp_pcb *pcb);
+u16_t altcp_sndqueuelen(altcp_pcb *pcb);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "lwip/altcp.h"
+
+struct altcp_tls_config;
+struct mbedtls_ssl_context;
+
+altcp_tls_config *altcp_tls_create_config_client(const u8_t *cert, size_t cert_len);
+altcp_pcb *altcp_tls_new(altcp_tls_config *config, u8_t type);
+void *altcp_tls_context(altcp_pcb *pcb);
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context *ssl, const char *hostname);
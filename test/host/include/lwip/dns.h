@@ -0,0 +1,14 @@
+#pragma once
+
+#include "lwip/ip_addr.h"
+
+#define LWIP_DNS_ADDRTYPE_IPV4 0
+#define LWIP_DNS_ADDRTYPE_IPV6 1
+#define LWIP_DNS_ADDRTYPE_IPV4_IPV6 2
+#define LWIP_DNS_ADDRTYPE_IPV6_IPV4 3
+
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *addr, void *arg);
+
+void dns_init();
+void dns_setserver(u8_t index, const ip_addr_t *server);
+err_t dns_gethostbyname_addrtype(const char *name, ip_addr_t *addr, dns_found_callback found, void *arg, u8_t type);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "lwip/err.h"
+
+#define LWIP_IPV4 1
+#ifndef LWIP_IPV6
+#define LWIP_IPV6 1
+#endif
+
+typedef struct {
+    u32_t addr;
+} ip4_addr_t;
+
+typedef struct {
+    u32_t addr[4];
+    u8_t zone;
+} ip6_addr_t;
+
+typedef struct ip_addr {
+    union {
+        ip6_addr_t ip6;
+        ip4_addr_t ip4;
+    } u_addr;
+    u8_t type;
+} ip_addr_t;
+
+enum lwip_ip_addr_type {
+    IPADDR_TYPE_V4 = 0,
+    IPADDR_TYPE_V6 = 6,
+    IPADDR_TYPE_ANY = 46
+};
+
+#define IP_IS_V4(a) ((a)->type == IPADDR_TYPE_V4)
+#define IP_IS_V6(a) ((a)->type == IPADDR_TYPE_V6)
+#define IP_GET_TYPE(a) ((a)->type)
+
+char *ipaddr_ntoa(const ip_addr_t *addr);
+int ipaddr_aton(const char *text, ip_addr_t *addr);
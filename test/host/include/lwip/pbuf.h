@@ -0,0 +1,12 @@
+#pragma once
+
+#include "lwip/err.h"
+
+struct pbuf {
+    pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+};
+
+u8_t pbuf_free(pbuf *p);
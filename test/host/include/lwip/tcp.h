@@ -0,0 +1,35 @@
+#pragma once
+
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+
+#define TCP_WRITE_FLAG_COPY 0x01
+#define TCP_WRITE_FLAG_MORE 0x02
+
+#define TCP_MSS 1460
+#define TCP_WND (4 * TCP_MSS)
+#define TCP_SND_BUF (8 * TCP_MSS)
+#define TCP_SND_QUEUELEN ((4 * (TCP_SND_BUF) + (TCP_MSS - 1)) / (TCP_MSS))
+
+struct tcp_pcb;
+
+typedef err_t (*tcp_connected_fn)(void *arg, tcp_pcb *pcb, err_t err);
+typedef err_t (*tcp_recv_fn)(void *arg, tcp_pcb *pcb, pbuf *p, err_t err);
+typedef err_t (*tcp_sent_fn)(void *arg, tcp_pcb *pcb, u16_t len);
+typedef err_t (*tcp_poll_fn)(void *arg, tcp_pcb *pcb);
+typedef void (*tcp_err_fn)(void *arg, err_t err);
+
+tcp_pcb *tcp_new_ip_type(u8_t type);
+void tcp_arg(tcp_pcb *pcb, void *arg);
+void tcp_recv(tcp_pcb *pcb, tcp_recv_fn recv);
+void tcp_sent(tcp_pcb *pcb, tcp_sent_fn sent);
+void tcp_poll(tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval);
+void tcp_err(tcp_pcb *pcb, tcp_err_fn err);
+err_t tcp_connect(tcp_pcb *pcb, const ip_addr_t *addr, u16_t port, tcp_connected_fn connected);
+err_t tcp_write(tcp_pcb *pcb, const void *data, u16_t len, u8_t flags);
+err_t tcp_output(tcp_pcb *pcb);
+void tcp_recved(tcp_pcb *pcb, u16_t len);
+err_t tcp_close(tcp_pcb *pcb);
+void tcp_abort(tcp_pcb *pcb);
+u16_t tcp_sndbuf(tcp_pcb *pcb);
+u16_t tcp_sndqueuelen(tcp_pcb *pcb);
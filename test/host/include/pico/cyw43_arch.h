@@ -0,0 +1,6 @@
+#pragma once
+
+#include "pico/time.h"
+
+inline void cyw43_arch_lwip_begin() {}
+inline void cyw43_arch_lwip_end() {}
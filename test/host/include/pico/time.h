@@ -0,0 +1,32 @@
+#pragma once
+
+// Host stand-in for the pico-sdk time API. The clock is simulated and only
+// moves through host_advance_ms(), which also runs the alarms that come due.
+
+#include <cstdint>
+// logger.h gets printf through the pico-sdk headers
+#include <cstdio>
+
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+extern const absolute_time_t nil_time;
+
+absolute_time_t get_absolute_time();
+uint32_t to_ms_since_boot(absolute_time_t t);
+uint64_t to_us_since_boot(absolute_time_t t);
+absolute_time_t make_timeout_time_ms(uint32_t ms);
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to);
+bool is_nil_time(absolute_time_t t);
+bool time_reached(absolute_time_t t);
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past);
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past);
+bool cancel_alarm(alarm_id_t id);
+
+void sleep_ms(uint32_t ms);
+[[noreturn]] void panic(const char *format, ...);
+
+// Moves the simulated clock forward, firing due alarms in order
+void host_advance_ms(uint32_t ms);
@@ -0,0 +1,112 @@
+#include "lwip/altcp_tls.h"
+#include "lwip/dns.h"
+
+// There is no network on the host: tcp_client and tcp_tls_client fail to set up
+// a connection, so tests run http_client over loopback_transport instead.
+
+u8_t pbuf_free(pbuf *) {
+    return 0;
+}
+
+char *ipaddr_ntoa(const ip_addr_t *) {
+    static char text[] = "0.0.0.0";
+    return text;
+}
+
+int ipaddr_aton(const char *, ip_addr_t *) {
+    return 0;
+}
+
+void dns_init() {}
+
+void dns_setserver(u8_t, const ip_addr_t *) {}
+
+err_t dns_gethostbyname_addrtype(const char *, ip_addr_t *, dns_found_callback, void *, u8_t) {
+    return ERR_VAL;
+}
+
+tcp_pcb *tcp_new_ip_type(u8_t) {
+    return nullptr;
+}
+
+void tcp_arg(tcp_pcb *, void *) {}
+void tcp_recv(tcp_pcb *, tcp_recv_fn) {}
+void tcp_sent(tcp_pcb *, tcp_sent_fn) {}
+void tcp_poll(tcp_pcb *, tcp_poll_fn, u8_t) {}
+void tcp_err(tcp_pcb *, tcp_err_fn) {}
+void tcp_recved(tcp_pcb *, u16_t) {}
+
+err_t tcp_connect(tcp_pcb *, const ip_addr_t *, u16_t, tcp_connected_fn) {
+    return ERR_CONN;
+}
+
+err_t tcp_write(tcp_pcb *, const void *, u16_t, u8_t) {
+    return ERR_CONN;
+}
+
+err_t tcp_output(tcp_pcb *) {
+    return ERR_CONN;
+}
+
+err_t tcp_close(tcp_pcb *) {
+    return ERR_OK;
+}
+
+void tcp_abort(tcp_pcb *) {}
+
+u16_t tcp_sndbuf(tcp_pcb *) {
+    return 0;
+}
+
+u16_t tcp_sndqueuelen(tcp_pcb *) {
+    return 0;
+}
+
+altcp_tls_config *altcp_tls_create_config_client(const u8_t *, size_t) {
+    return nullptr;
+}
+
+altcp_pcb *altcp_tls_new(altcp_tls_config *, u8_t) {
+    return nullptr;
+}
+
+void *altcp_tls_context(altcp_pcb *) {
+    return nullptr;
+}
+
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context *, const char *) {
+    return 0;
+}
+
+void altcp_arg(altcp_pcb *, void *) {}
+void altcp_recv(altcp_pcb *, altcp_recv_fn) {}
+void altcp_sent(altcp_pcb *, altcp_sent_fn) {}
+void altcp_poll(altcp_pcb *, altcp_poll_fn, u8_t) {}
+void altcp_err(altcp_pcb *, altcp_err_fn) {}
+void altcp_recved(altcp_pcb *, u16_t) {}
+
+err_t altcp_connect(altcp_pcb *, const ip_addr_t *, u16_t, altcp_connected_fn) {
+    return ERR_CONN;
+}
+
+err_t altcp_write(altcp_pcb *, const void *, u16_t, u8_t) {
+    return ERR_CONN;
+}
+
+err_t altcp_output(altcp_pcb *) {
+    return ERR_CONN;
+}
+
+err_t altcp_close(altcp_pcb *) {
+    return ERR_OK;
+}
+
+void altcp_abort(altcp_pcb *) {}
+
+u16_t altcp_sndbuf(altcp_pcb *) {
+    return 0;
+}
+
+u16_t altcp_sndqueuelen(altcp_pcb *) {
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <pico/time.h>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+// Simulated time since boot, in microseconds
+static uint64_t now_us = 0;
+
+struct alarm {
+    uint64_t at;
+    alarm_callback_t callback;
+    void *user_data;
+};
+
+static std::map<alarm_id_t, alarm> alarms;
+static alarm_id_t next_alarm_id = 1;
+
+const absolute_time_t nil_time = 0;
+
+absolute_time_t get_absolute_time() {
+    return now_us;
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t) {
+    return t / 1000;
+}
+
+uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return now_us + ms * 1000ull;
+}
+
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+
+bool is_nil_time(absolute_time_t t) {
+    return t == nil_time;
+}
+
+bool time_reached(absolute_time_t t) {
+    return now_us >= t;
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool) {
+    alarms[next_alarm_id] = {now_us + us, callback, user_data};
+    return next_alarm_id++;
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    return add_alarm_in_us(ms * 1000ull, callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t id) {
+    return alarms.erase(id) != 0;
+}
+
+void host_advance_ms(uint32_t ms) {
+    uint64_t end = now_us + ms * 1000ull;
+    while(true) {
+        // Earliest due alarm, the first one set among those due at once
+        auto due = alarms.end();
+        for(auto it = alarms.begin(); it != alarms.end(); it++) {
+            if(it->second.at <= end && (due == alarms.end() || it->second.at < due->second.at)) {
+                due = it;
+            }
+        }
+        if(due == alarms.end()) {
+            break;
+        }
+        alarm_id_t id = due->first;
+        alarm fired = due->second;
+        alarms.erase(due);
+        now_us = fired.at;
+        // Like the pico-sdk, a non-zero return sets the alarm again that many microseconds on
+        int64_t again = fired.callback(id, fired.user_data);
+        if(again != 0) {
+            alarms[id] = {now_us + (again > 0 ? again : -again), fired.callback, fired.user_data};
+        }
+    }
+    now_us = end;
+}
+
+void sleep_ms(uint32_t ms) {
+    host_advance_ms(ms);
+}
+
+void panic(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    abort();
+}
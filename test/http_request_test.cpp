@@ -0,0 +1,58 @@
+#include <string>
+#include <vector>
+
+#include "http_request.h"
+
+#include "test.h"
+
+// Passes the head through a staging buffer of staging_size bytes and joins the writes
+static std::string staged(const http_request &request, size_t staging_size, size_t &writes) {
+    static std::string out;
+    static size_t count;
+    out.clear();
+    count = 0;
+    std::vector<uint8_t> staging(staging_size);
+    size_t size = request.write_head(staging, [](std::span<const uint8_t> piece){
+        out.append((const char*)piece.data(), piece.size());
+        count++;
+    });
+    CHECK(size == out.size());
+    writes = count;
+    return out;
+}
+
+int main() {
+    http_request request("POST", "/api/v1/items", "{\"name\":\"x\"}");
+    request.identify("example.com", "pico");
+    request.add_header("Content-Type", "application/json");
+    request.add_header("Host", "ignored.example");
+    const std::string expected =
+        "POST /api/v1/items HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "User-Agent: pico\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 12\r\n"
+        "\r\n";
+
+    CHECK(request.head_size() == expected.size());
+    std::string whole(request.head_size(), '\0');
+    CHECK(request.serialize_head({(uint8_t*)whole.data(), whole.size()}) == expected.size());
+    CHECK(whole == expected);
+    CHECK(request.serialize() == expected + "{\"name\":\"x\"}");
+    CHECK(request.serialize_head({(uint8_t*)whole.data(), whole.size() - 1}) == 0);
+
+    // A staging buffer of any size gives the same bytes, in as many writes as it takes
+    for(size_t staging_size = 1; staging_size <= expected.size() + 1; staging_size++) {
+        size_t writes;
+        CHECK(staged(request, staging_size, writes) == expected);
+        CHECK(writes == (expected.size() + staging_size - 1) / staging_size);
+    }
+
+    // Without identify() a Host header goes out as an ordinary one
+    http_request plain("GET", "/");
+    plain.add_header("Host", "other.example");
+    std::string head(plain.head_size(), '\0');
+    plain.serialize_head({(uint8_t*)head.data(), head.size()});
+    CHECK(head == "GET / HTTP/1.1\r\nHost: other.example\r\n\r\n");
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "http_request.h"
+#include "http_response.h"
+
+// Host throughput of http_response::parse, for comparing parser changes
+// against each other rather than as a figure for the RP2040
+
+static std::string typical_response(size_t body_length) {
+    std::string message =
+        "HTTP/1.1 200 OK\r\n"
+        "Date: Sun, 18 Oct 2026 12:00:00 GMT\r\n"
+        "Server: nginx/1.25.3\r\n"
+        "Content-Type: application/json; charset=utf-8\r\n"
+        "Cache-Control: max-age=60\r\n"
+        "ETag: \"5f3c2a1b9e\"\r\n"
+        "Vary: Accept-Encoding\r\n"
+        "X-Request-Id: 0d4f1c6e-8a7b-4c2d-9e3f-1a2b3c4d5e6f\r\n"
+        "Connection: keep-alive\r\n"
+        "Content-Length: " + std::to_string(body_length) + "\r\n"
+        "\r\n";
+    return message + std::string(body_length, 'x');
+}
+
+static std::string chunked_response(size_t chunks, size_t chunk_size) {
+    std::string message = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\n\r\n";
+    char size_line[16];
+    snprintf(size_line, sizeof(size_line), "%zx\r\n", chunk_size);
+    for(size_t i = 0; i < chunks; i++) {
+        message += size_line + std::string(chunk_size, 'y') + "\r\n";
+    }
+    return message + "0\r\n\r\n";
+}
+
+// Parses message iterations times in segment byte pieces, sinking the body
+static void run(const char *name, std::string message, size_t segment, int iterations) {
+    http_request request;
+    http_response response(&request);
+    size_t sunk = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++) {
+        response.clear();
+        response.on_body_chunk([&sunk](std::span<const uint8_t> chunk){
+            sunk += chunk.size();
+        });
+        for(size_t offset = 0; offset < message.size(); offset += segment) {
+            size_t length = std::min(segment, message.size() - offset);
+            response.parse({(uint8_t*)message.data() + offset, length});
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-28s %7zu byte segments  %8.1f MB/s  %8.0f ns/response\n", name, segment,
+        message.size() * (double)iterations / seconds / 1e6, seconds * 1e9 / iterations);
+    if(sunk == 0) {
+        printf("nothing parsed\n");
+    }
+}
+
+int main() {
+    std::string small = typical_response(64), large = typical_response(16384), chunked = chunked_response(64, 256);
+    for(size_t segment : {(size_t)1460, (size_t)536, (size_t)64}) {
+        run("head + 64 byte body", small, segment, 200000);
+        run("head + 16 KB body", large, segment, 20000);
+        run("chunked, 64 x 256 bytes", chunked, segment, 20000);
+    }
+    return 0;
+}
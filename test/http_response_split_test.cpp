@@ -0,0 +1,91 @@
+#include <string>
+#include <vector>
+
+#include "http_request.h"
+#include "http_response.h"
+
+#include "test.h"
+
+// Everything a caller can see of a parsed response
+struct parsed {
+    uint16_t status;
+    std::string protocol, status_text, headers, body;
+    bool complete;
+
+    bool operator==(const parsed&) const = default;
+};
+
+// Feeds message to a fresh response in the pieces cuts marks, then closes the connection
+static parsed parse(const std::string &message, const std::vector<size_t> &cuts, bool stream) {
+    http_request request;
+    http_response response(&request);
+    std::string streamed;
+    if(stream) {
+        response.on_body_chunk([&streamed](std::span<const uint8_t> chunk){
+            streamed.append((const char*)chunk.data(), chunk.size());
+        });
+    }
+    size_t start = 0;
+    for(size_t i = 0; i <= cuts.size(); i++) {
+        size_t end = i < cuts.size() ? cuts[i] : message.size();
+        std::string piece = message.substr(start, end - start);
+        size_t consumed = response.parse({(uint8_t*)piece.data(), piece.size()});
+        CHECK(consumed <= piece.size());
+        start = end;
+    }
+    parsed result;
+    result.complete = response.complete_at_close();
+    result.status = response.status();
+    result.protocol = response.get_protocol();
+    result.status_text = response.get_status_text();
+    for(size_t i = 0; i < response.header_count(); i++) {
+        result.headers += std::string(response.header_name(i)) + ": " + std::string(response.header_value(i)) + "\n";
+        CHECK(response.header(response.header_name(i)).data() != nullptr);
+    }
+    result.headers += "type=" + std::string(response.header(http_response::known_header::content_type));
+    result.body = stream ? streamed : std::string(response.get_body());
+    return result;
+}
+
+static std::string large_head() {
+    std::string message = "HTTP/1.1 200 OK\r\nContent-Type: text/big\r\n";
+    for(int i = 0; i < 12; i++) {
+        message += "X-Big-" + std::to_string(i) + ": " + std::string(300, 'a' + i) + "\r\n";
+    }
+    return message + "Content-Length: 3\r\n\r\nabc";
+}
+
+int main() {
+    const std::vector<std::string> messages = {
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 11\r\n\r\nhello world",
+        "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "5\r\nhello\r\n6;name=value\r\n world\r\n0\r\nTrailer: yes\r\n\r\n",
+        "HTTP/1.0 200 OK\r\nContent-Type: text/html\r\n\r\nread until the connection closes",
+        "HTTP/1.1 204\nContent-Type:text/x\n\n",
+        "HTTP/1.1 404 Not Found\r\nNo-Colon-Here\r\nContent-Length: 0\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nbodyHTTP/1.1 200 OK\r\n",
+        large_head(),
+        "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 103 Early Hints\r\nLink: </app.css>; rel=preload\r\n\r\n"
+            "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok",
+    };
+    for(const std::string &message : messages) {
+        for(bool stream : {false, true}) {
+            parsed whole = parse(message, {}, stream);
+            CHECK(whole.status != 0);
+            // Every single split, and every pair of splits while that stays cheap
+            for(size_t i = 1; i < message.size(); i++) {
+                CHECK(parse(message, {i}, stream) == whole);
+                for(size_t j = i + 1; j < message.size() && message.size() <= 256; j++) {
+                    CHECK(parse(message, {i, j}, stream) == whole);
+                }
+            }
+            // And a byte at a time
+            std::vector<size_t> bytes;
+            for(size_t i = 1; i < message.size(); i++) {
+                bytes.push_back(i);
+            }
+            CHECK(parse(message, bytes, stream) == whole);
+        }
+    }
+    return 0;
+}
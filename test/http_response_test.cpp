@@ -0,0 +1,97 @@
+#include <string>
+
+// http_client.h brings http_request.h and http_response.h, which have no include guards
+#include "http_client.h"
+
+#include "loopback_server.h"
+#include "test.h"
+
+static size_t feed(http_response &response, std::string piece) {
+    return response.parse({(uint8_t*)piece.data(), piece.size()});
+}
+
+// Names built to share a hash with content-length and transfer-encoding are
+// ordinary headers, they do not frame the body
+static void hash_collisions() {
+    static_assert(header_hash("X-7dhlaaf8") == header_hash("content-length"));
+    static_assert(header_hash("x-vqtrafv4") == header_hash("Transfer-Encoding"));
+    http_request request;
+    http_response response(&request);
+    std::string message = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nX-7dhlaaf8: 1\r\nX-vqtrafv4: chunked\r\n\r\nhello";
+    CHECK(feed(response, message) == message.size());
+    CHECK(response.get_body() == "hello");
+    CHECK(response.header(http_response::known_header::content_length) == "5");
+    CHECK(response.header(http_response::known_header::transfer_encoding).empty());
+    CHECK(response.header("x-7dhlaaf8") == "1");
+    CHECK(response.header("X-VQTRAFV4") == "chunked");
+}
+
+// A response moved part way through carries on parsing where it was
+static void move_assignment() {
+    http_request request;
+    std::string head = "HTTP/1.1 201 Created\r\nContent-Type: application/json\r\nX-Trace: abc\r\n"
+        "Transfer-Encoding: chunked\r\n\r\n";
+    std::string body = "4\r\n{\"a\"\r\n3\r\n:1}\r\n0\r\n\r\n";
+    for(size_t cut : {10ul, head.size() - 3, head.size() + 2, head.size() + 9}) {
+        std::string message = head + body;
+        http_response from(&request), to(&request);
+        feed(from, message.substr(0, cut));
+        to = std::move(from);
+        CHECK(from.header_count() == 0);
+        CHECK(from.header(http_response::known_header::content_type).empty());
+        feed(to, message.substr(cut));
+        CHECK(to.status() == 201);
+        CHECK(to.get_status_text() == "Created");
+        CHECK(to.get_protocol() == "HTTP/1.1");
+        CHECK(to.header_count() == 3);
+        CHECK(to.header("x-trace") == "abc");
+        CHECK(to.header(http_response::known_header::content_type) == "application/json");
+        CHECK(to.get_body() == "{\"a\":1}");
+    }
+}
+
+// 1xx heads are dropped, only the final response is reported
+static void interim_responses() {
+    http_request request;
+    http_response response(&request);
+    std::string message = "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 103 Early Hints\r\nLink: </app.css>; rel=preload\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\nok";
+    CHECK(feed(response, message) == message.size());
+    CHECK(response.status() == 200);
+    CHECK(response.get_status_text() == "OK");
+    CHECK(response.header_count() == 2);
+    CHECK(response.header("link").empty());
+    CHECK(response.get_body() == "ok");
+
+    // 101 is the last HTTP on the connection, it is not waited past
+    http_response upgrade(&request);
+    message = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n\r\n";
+    CHECK(feed(upgrade, message) == message.size());
+    CHECK(upgrade.status() == 101);
+    CHECK(feed(upgrade, "more") == 0);
+
+    loopback_transport *transport = new loopback_transport(16);
+    loopback_server server(*transport, 2, 16);
+    server.respond = [](const std::string &){
+        return "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nfinal";
+    };
+    http_client client("http://example.com/", transport);
+    int responses = 0;
+    uint16_t status = 0;
+    client.on_response([&](){
+        responses++;
+        status = client.response().status();
+    });
+    client.post("/upload", "data");
+    server.advance(100);
+    CHECK(responses == 1);
+    CHECK(status == 200);
+    CHECK(client.response().get_body() == "final");
+}
+
+int main() {
+    hash_collisions();
+    interim_responses();
+    move_assignment();
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include <zlib.h>
+
+#include "inflater.h"
+
+// Host decode throughput of inflater over payloads compressed by zlib, fed
+// in TCP sized pieces the way http_response hands them over
+
+static std::string compress(const std::string &plain, int level, int window_bits) {
+    z_stream stream = {};
+    deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, plain.size()), '\0');
+    stream.next_in = (Bytef*)plain.data();
+    stream.avail_in = plain.size();
+    stream.next_out = (Bytef*)out.data();
+    stream.avail_out = out.size();
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+static std::string telemetry_json(size_t size) {
+    std::string json = "[";
+    for(int i = 0; json.size() < size; i++) {
+        json += "{\"sensor\":\"greenhouse-" + std::to_string(i % 17) + "\",\"temperature\":" + std::to_string(18 + i % 9) +
+            "." + std::to_string(i % 10) + ",\"humidity\":" + std::to_string(40 + i % 31) + ",\"ok\":true},";
+    }
+    json.back() = ']';
+    return json;
+}
+
+static std::string noise(size_t size) {
+    std::string text(size, '\0');
+    uint32_t state = 1;
+    for(char &c : text) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        // Few distinct bytes, so Huffman coding still wins a little
+        c = 'a' + state % 20;
+    }
+    return text;
+}
+
+static void run(const char *name, const std::string &plain, int level, int window_bits, inflater::format format) {
+    std::string compressed = compress(plain, level, window_bits);
+    static size_t produced;
+    inplace_function<void(std::span<const uint8_t>)> sink = [](std::span<const uint8_t> out){
+        produced += out.size();
+    };
+    inflater decoder;
+    int iterations = std::max<int>(1, (64 << 20) / plain.size());
+    produced = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++) {
+        decoder.reset(format);
+        for(size_t offset = 0; offset < compressed.size(); offset += 1460) {
+            decoder.feed({(const uint8_t*)compressed.data() + offset, std::min<size_t>(1460, compressed.size() - offset)}, sink);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-22s level %d  %7zu -> %7zu bytes (%4.1fx)  %7.1f MB/s out\n", name, level, plain.size(), compressed.size(),
+        (double)plain.size() / compressed.size(), produced / seconds / 1e6);
+    if(produced != plain.size() * iterations) {
+        printf("  decoded %zu bytes, expected %zu\n", produced, plain.size() * iterations);
+    }
+}
+
+int main() {
+    std::string json = telemetry_json(256 << 10), text = noise(256 << 10);
+    for(int level : {1, 6, 9}) {
+        run("telemetry JSON, gzip", json, level, 15 + 16, inflater::format::gzip);
+        run("telemetry JSON, zlib", json, level, 15, inflater::format::zlib);
+        run("low redundancy, gzip", text, level, 15 + 16, inflater::format::gzip);
+    }
+    return 0;
+}
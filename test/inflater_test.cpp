@@ -0,0 +1,74 @@
+#include <cstdlib>
+#include <string>
+
+#include <zlib.h>
+
+#include "inflater.h"
+
+#include "test.h"
+
+static std::string compress(const std::string &plain, int level, int window_bits) {
+    z_stream stream = {};
+    deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, plain.size()), '\0');
+    stream.next_in = (Bytef*)plain.data();
+    stream.avail_in = plain.size();
+    stream.next_out = (Bytef*)out.data();
+    stream.avail_out = out.size();
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+static std::string decoded;
+
+// Decodes compressed fed in pieces of 1 to max_piece bytes
+static inflater::status inflate(inflater &decoder, inflater::format format, const std::string &compressed, size_t max_piece) {
+    inplace_function<void(std::span<const uint8_t>)> sink = [](std::span<const uint8_t> out){
+        decoded.append((const char*)out.data(), out.size());
+    };
+    decoded.clear();
+    CHECK(decoder.reset(format));
+    inflater::status status = inflater::status::more;
+    for(size_t offset = 0; offset < compressed.size() && status == inflater::status::more;) {
+        size_t piece = std::min<size_t>(1 + rand() % max_piece, compressed.size() - offset);
+        status = decoder.feed({(const uint8_t*)compressed.data() + offset, piece}, sink);
+        offset += piece;
+    }
+    return status;
+}
+
+int main() {
+    std::string plain;
+    for(int i = 0; plain.size() < 100000; i++) {
+        plain += "{\"id\":" + std::to_string(i) + ",\"name\":\"item " + std::to_string(i % 97) + "\"},";
+        plain += (char)(rand() % 256);
+    }
+    inflater decoder;
+    srand(1);
+    // Stored, fixed and dynamic Huffman blocks, in every framing, split anywhere
+    for(int level : {0, 1, 6, 9}) {
+        struct {
+            int window_bits;
+            inflater::format format;
+        } framings[] = {{15 + 16, inflater::format::gzip}, {15, inflater::format::zlib}, {-15, inflater::format::raw}, {-15, inflater::format::zlib}};
+        for(auto framing : framings) {
+            std::string compressed = compress(plain, level, framing.window_bits);
+            for(size_t max_piece : {(size_t)1, (size_t)7, (size_t)1460, compressed.size()}) {
+                CHECK(inflate(decoder, framing.format, compressed, max_piece) == inflater::status::done);
+                CHECK(decoded == plain);
+                CHECK(decoder.total_out() == plain.size());
+            }
+        }
+    }
+    std::string short_text = "hello hello hello hello";
+    CHECK(inflate(decoder, inflater::format::gzip, compress(short_text, 9, 15 + 16), 3) == inflater::status::done);
+    CHECK(decoded == short_text);
+
+    // A corrupted stream is an error rather than wrong output
+    std::string corrupt = compress(plain, 6, 15 + 16);
+    corrupt[corrupt.size() - 6] ^= 0x55;
+    CHECK(inflate(decoder, inflater::format::gzip, corrupt, 1460) == inflater::status::error);
+    return 0;
+}
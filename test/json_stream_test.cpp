@@ -0,0 +1,63 @@
+#include <string>
+
+#include "alloc_counter.h"
+#include "json_stream.h"
+
+#include "test.h"
+
+static std::string reported;
+
+static void report(const char *name, const nlohmann::json &value) {
+    reported += std::string(name) + "=" + value.dump() + ";";
+}
+
+// Watched values come out the same however the document is cut up, and the
+// unwatched 20 KB string is skipped rather than held
+static void pieces() {
+    std::string document = R"( {"meta":{"count":3,"next":null},"items":[{"id":1,"name":"a\"b","tags":["x","y"]},)"
+        R"({"id":2.5e1,"name":"é😀"},{"id":-3,"name":"c","deep":{"k~/":[true,false]}}],"kéy":"v", "big":")"
+        + std::string(20000, 'z') + R"("} )";
+    for(size_t piece : {1, 2, 3, 7, 64, 100000}) {
+        json_stream stream;
+        reported.clear();
+        CHECK(stream.watch("/meta/count", [](const nlohmann::json &value){ report("count", value); }));
+        CHECK(stream.watch("/items/*/id", [](const nlohmann::json &value){ report("id", value); }));
+        CHECK(stream.watch("/items/1", [](const nlohmann::json &value){ report("item1", value); }));
+        CHECK(stream.watch("/items/2/deep/k~0~1/1", [](const nlohmann::json &value){ report("escaped", value); }));
+        CHECK(stream.watch("/k\xc3\xa9y", [](const nlohmann::json &value){ report("unicode", value); }));
+        CHECK(stream.watch("/meta", [](const nlohmann::json &value){ report("meta", value); }));
+        size_t bytes = alloc_counter::bytes_allocated();
+        for(size_t i = 0; i < document.size(); i += piece) {
+            CHECK(stream.feed({(const uint8_t*)document.data() + i, std::min(piece, document.size() - i)}));
+        }
+        CHECK(stream.finish());
+        // The watched values and their json objects, nowhere near the 20 KB string
+        CHECK(alloc_counter::bytes_allocated() - bytes < 8192);
+        // /meta/count and the id of item 1 are inside values already being captured
+        CHECK(reported == "meta={\"count\":3,\"next\":null};id=1;item1={\"id\":25.0,\"name\":\"é😀\"};id=-3;escaped=false;unicode=\"v\";");
+    }
+}
+
+static void documents() {
+    for(const char *malformed : {"[1,2", "{\"a\":1,}", "[1 2]", "{\"a\" 1}", "tru", "[[[]]]x"}) {
+        json_stream stream;
+        std::string text = malformed;
+        stream.feed({(const uint8_t*)text.data(), text.size()});
+        CHECK(!stream.finish());
+    }
+    for(const char *whole : {"42", "[]", "{}", "[[[]]]"}) {
+        json_stream stream;
+        reported.clear();
+        CHECK(stream.watch("", [](const nlohmann::json &value){ report("root", value); }));
+        std::string text = whole;
+        CHECK(stream.feed({(const uint8_t*)text.data(), text.size()}));
+        CHECK(stream.finish());
+        CHECK(reported == "root=" + text + ";");
+    }
+}
+
+int main() {
+    pieces();
+    documents();
+    return 0;
+}
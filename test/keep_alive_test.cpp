@@ -0,0 +1,80 @@
+#include <string>
+
+#include "http_client.h"
+#include "loopback_server.h"
+
+#include "test.h"
+
+static loopback_server *server;
+static std::string headers;
+static int connects;
+static bool drop_next;
+
+static std::string respond(const std::string &head) {
+    if(drop_next) {
+        // The server timed the connection out just as the request went out
+        drop_next = false;
+        server->close_after_response = true;
+        return "";
+    }
+    return "HTTP/1.1 200 OK\r\n" + headers + "Content-Length: 2\r\n\r\nok";
+}
+
+// Leaves the connection idle for idle_ms, then sends a request and waits for its response
+static void poll(http_client &client, int &responses, uint32_t idle_ms) {
+    server->advance(idle_ms);
+    int before = responses;
+    client.get("/poll");
+    for(int ms = 0; ms < 1000 && responses == before; ms++) {
+        server->advance();
+    }
+    CHECK(responses == before + 1);
+    CHECK(client.response().get_body() == "ok");
+}
+
+int main() {
+    loopback_transport *transport = new loopback_transport(536, 2);
+    server = new loopback_server(*transport, 2);
+    server->respond = respond;
+    server->end().on_connected([](){
+        connects++;
+    });
+    http_client client("http://example.com/", transport);
+    int responses = 0;
+    client.on_response([&responses](){
+        responses++;
+    });
+
+    headers = "Keep-Alive: timeout=5, max=100\r\n";
+    poll(client, responses, 0);
+    CHECK(connects == 1);
+    // Well within the server's timeout, the connection is reused
+    poll(client, responses, 2000);
+    CHECK(connects == 1);
+    // Within HTTP_KEEPALIVE_MARGIN_MS of it, a new connection is safer
+    poll(client, responses, 4500);
+    CHECK(connects == 2);
+
+    // A response without Keep-Alive drops the timeout the one before it gave
+    headers = "Keep-Alive: timeout=3\r\n";
+    poll(client, responses, 0);
+    headers = "";
+    poll(client, responses, 0);
+    CHECK(connects == 2);
+    poll(client, responses, 2500);
+    CHECK(connects == 2);
+
+    // A connection that turns out to be closed is retried on a fresh one
+    drop_next = true;
+    poll(client, responses, 100);
+    CHECK(connects == 3);
+
+    headers = "Connection: close\r\n";
+    poll(client, responses, 100);
+    CHECK(connects == 3);
+    headers = "";
+    poll(client, responses, 100);
+    CHECK(connects == 4);
+    delete server;
+    return 0;
+}
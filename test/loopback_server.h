@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "loopback_transport.h"
+
+// Server end of a loopback_transport pair. Each request head it reads is
+// recorded and answered with whatever respond returns, so a test only writes
+// the responses. Responses go out as fast as LOOPBACK_SEND_BUFFER lets them,
+// like a TCP sender waiting for acknowledgements. Request bodies are not read.
+class loopback_server {
+public:
+    loopback_server(loopback_transport &client_end, uint32_t latency_ms = 0, size_t segment_size = LOOPBACK_SEGMENT_SIZE)
+        : m_client_end(client_end)
+        , m_end(segment_size, latency_ms)
+    {
+        loopback_transport::pair(m_client_end, m_end);
+        m_end.on_receive([this](){
+            receive();
+        });
+        m_end.on_sent([this](){
+            send();
+        });
+    }
+
+    std::function<std::string(const std::string &head)> respond;
+    std::vector<std::string> requests;
+    // Closes the connection once the next response is written, ending a body
+    // that has no length or cutting one short
+    bool close_after_response = false;
+
+    loopback_transport &end() {
+        return m_end;
+    }
+
+    // Moves both ends and the simulated clock on by ms, a millisecond at a time
+    void advance(uint32_t ms = 1) {
+        for(uint32_t i = 0; i < ms; i++) {
+            m_client_end.advance();
+            m_end.advance();
+            host_advance_ms(1);
+        }
+    }
+
+private:
+    loopback_transport &m_client_end;
+    loopback_transport m_end;
+    std::string m_received, m_unsent;
+    bool m_closing = false;
+
+    void receive() {
+        uint8_t buffer[BUF_SIZE];
+        size_t count = m_end.read({buffer, (size_t)m_end.available()});
+        m_received.append((const char*)buffer, count);
+        size_t end;
+        while((end = m_received.find("\r\n\r\n")) != std::string::npos) {
+            requests.push_back(m_received.substr(0, end + 4));
+            m_received.erase(0, end + 4);
+            m_unsent += respond(requests.back());
+            if(close_after_response) {
+                close_after_response = false;
+                m_closing = true;
+                m_received.clear();
+                break;
+            }
+        }
+        send();
+    }
+
+    void send() {
+        size_t count = std::min(m_unsent.size(), m_end.writable());
+        if(count > 0) {
+            m_end.write({(const uint8_t*)m_unsent.data(), count});
+            m_unsent.erase(0, count);
+        }
+        if(m_closing && m_unsent.empty()) {
+            m_closing = false;
+            m_end.close(ERR_CLSD);
+        }
+    }
+};
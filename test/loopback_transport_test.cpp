@@ -0,0 +1,86 @@
+#include <string>
+
+#include "http_client.h"
+#include "loopback_transport.h"
+
+#include "loopback_server.h"
+#include "test.h"
+
+// Bytes arrive in order, no sooner than the latency, and the close after them
+static void stream() {
+    loopback_transport a(100, 5, 10), b;
+    loopback_transport::pair(a, b);
+    std::string sent(5000, 0), received;
+    for(size_t i = 0; i < sent.size(); i++) {
+        sent[i] = (char)(i * 7);
+    }
+    bool closed = false;
+    b.on_receive([&](){
+        uint8_t buffer[BUF_SIZE];
+        size_t count = b.read({buffer, (size_t)b.available()});
+        received.append((const char*)buffer, count);
+    });
+    b.on_closed([&](){
+        closed = true;
+        CHECK(received.size() == sent.size());
+    });
+    a.on_connected([&](){
+        a.write({(const uint8_t*)sent.data(), sent.size()});
+        a.close(ERR_CLSD);
+    });
+    CHECK(a.connect("peer", 80));
+    for(int ms = 1; ms <= 200; ms++) {
+        a.advance();
+        b.advance();
+        if(ms < 5) {
+            CHECK(received.empty());
+        }
+    }
+    CHECK(received == sent);
+    CHECK(closed);
+}
+
+// The writer is held to LOOPBACK_SEND_BUFFER until the reader drains its buffer
+static void backpressure() {
+    loopback_transport a, b;
+    loopback_transport::pair(a, b);
+    a.connect("peer", 80);
+    a.advance();
+    b.advance();
+    CHECK(a.connected());
+    std::string chunk(LOOPBACK_SEND_BUFFER, 'x');
+    CHECK(a.writable() == LOOPBACK_SEND_BUFFER);
+    a.write({(const uint8_t*)chunk.data(), chunk.size()});
+    CHECK(a.writable() == 0);
+    b.advance();
+    CHECK(b.available() > 0);
+    CHECK(a.writable() > 0);
+    CHECK(a.writable() == LOOPBACK_SEND_BUFFER - b.in_flight());
+}
+
+static void http_get() {
+    loopback_transport *transport = new loopback_transport(536);
+    loopback_server server(*transport, 3);
+    server.respond = [](const std::string &head) -> std::string {
+        return "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+    };
+    http_client client("http://example.com/", transport);
+    int responses = 0;
+    client.on_response([&](){
+        responses++;
+    });
+    client.get("/greeting");
+    server.advance(50);
+    CHECK(responses == 1);
+    CHECK(server.requests.size() == 1);
+    CHECK(server.requests[0].starts_with("GET /greeting HTTP/1.1\r\n"));
+    CHECK(client.response().status() == 200);
+    CHECK(client.response().get_body() == "hello");
+}
+
+int main() {
+    stream();
+    backpressure();
+    http_get();
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <string>
+#include <vector>
+
+#include "http_client.h"
+#include "loopback_server.h"
+
+#include "test.h"
+
+static loopback_server *server;
+static std::vector<std::string> bodies;
+static std::vector<uint16_t> statuses;
+static int connects;
+// Target of the request the server closes the connection after
+static std::string close_after;
+// Responses are held back until this many requests are in, then written together
+static size_t coalesce;
+static std::string held;
+
+static std::string respond(const std::string &head) {
+    std::string target = head.substr(head.find(' ') + 1);
+    target = target.substr(0, target.find(' '));
+    if(target == close_after) {
+        close_after.clear();
+        server->close_after_response = true;
+    }
+    if(target == "/chunked") {
+        return "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\none\r\n5\r\n, two\r\n0\r\n\r\n";
+    }
+    if(head.starts_with("HEAD ")) {
+        // The length of the body a GET would get, none follows
+        return "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n";
+    }
+    std::string body = "body of " + target;
+    held += "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    if(server->requests.size() < coalesce) {
+        return "";
+    }
+    std::string response;
+    response.swap(held);
+    return response;
+}
+
+static http_client *connect() {
+    bodies.clear();
+    statuses.clear();
+    connects = 0;
+    loopback_transport *transport = new loopback_transport(1460, 5);
+    server = new loopback_server(*transport, 5);
+    server->respond = respond;
+    server->end().on_connected([](){
+        connects++;
+    });
+    http_client *client = new http_client("http://example.com/", transport);
+    client->pipelining(true);
+    client->on_response([client](){
+        bodies.emplace_back(client->response().get_body());
+        statuses.push_back(client->response().status());
+    });
+    return client;
+}
+
+static void finish(http_client *client) {
+    delete client;
+    delete server;
+    server = nullptr;
+}
+
+// Requests go out back to back and the responses come back in order, all of
+// them in one segment
+static void in_order() {
+    http_client *client = connect();
+    coalesce = 3;
+    client->get("/a");
+    client->get("/b");
+    client->get("/c");
+    CHECK(client->in_flight() == 3);
+    // One latency in, the server has every request and the client no response yet
+    server->advance(7);
+    CHECK(server->requests.size() == 3);
+    CHECK(bodies.empty());
+    server->advance(10);
+    CHECK((bodies == std::vector<std::string>{"body of /a", "body of /b", "body of /c"}));
+    CHECK(client->in_flight() == 0);
+    CHECK(connects == 1);
+    coalesce = 0;
+    finish(client);
+}
+
+// Framing by chunks and by HEAD ends each response where the next one starts
+static void chunked_and_head() {
+    http_client *client = connect();
+    client->get("/chunked");
+    client->head("/h");
+    client->get("/after");
+    server->advance(30);
+    CHECK(server->requests.size() == 3);
+    CHECK(server->requests[1].starts_with("HEAD /h "));
+    CHECK((bodies == std::vector<std::string>{"one, two", "", "body of /after"}));
+    CHECK((statuses == std::vector<uint16_t>{200, 200, 200}));
+    CHECK(client->in_flight() == 0);
+    finish(client);
+}
+
+// A close with requests unanswered reconnects and sends those again, one at a time
+static void server_closes() {
+    http_client *client = connect();
+    close_after = "/1";
+    client->get("/1");
+    client->get("/2");
+    client->get("/3");
+    server->advance(100);
+    CHECK((bodies == std::vector<std::string>{"body of /1", "body of /2", "body of /3"}));
+    CHECK(connects == 2);
+    // The first /2 and /3 were still on their way when the server closed
+    CHECK(server->requests.size() == 3);
+    CHECK(server->requests[1].starts_with("GET /2 "));
+    CHECK(server->requests[2].starts_with("GET /3 "));
+    CHECK(client->in_flight() == 0);
+    // Having been cut off once, the client no longer pipelines
+    client->get("/4");
+    client->get("/5");
+    server->advance(7);
+    CHECK(server->requests.size() == 4);
+    server->advance(30);
+    CHECK(server->requests.size() == 5);
+    CHECK(bodies.size() == 5);
+    finish(client);
+}
+
+int main() {
+    in_order();
+    chunked_and_head();
+    server_closes();
+    return 0;
+}
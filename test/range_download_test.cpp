@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <string>
+
+#include "range_download.h"
+#include "loopback_server.h"
+
+#include "test.h"
+
+static loopback_server *server;
+static std::string resource, etag, received;
+static bool ranges;
+// The next response is cut off halfway and the connection closed, or left hanging open
+static bool drop_next, stall_next;
+
+static std::string respond(const std::string &head) {
+    size_t first = 0, range = head.find("Range: bytes=");
+    if(ranges && range != std::string::npos) {
+        first = std::stoul(head.substr(range + 13));
+    }
+    std::string validators = etag.empty() ? "" : "ETag: \"" + etag + "\"\r\n";
+    std::string response;
+    if(first >= resource.size() && first > 0) {
+        response = "HTTP/1.1 416 Range Not Satisfiable\r\n" + validators + "Content-Range: bytes */"
+            + std::to_string(resource.size()) + "\r\nContent-Length: 0\r\n\r\n";
+    } else if(ranges && range != std::string::npos) {
+        response = "HTTP/1.1 206 Partial Content\r\n" + validators + "Content-Range: bytes " + std::to_string(first) + "-"
+            + std::to_string(resource.size() - 1) + "/" + std::to_string(resource.size()) + "\r\nContent-Length: "
+            + std::to_string(resource.size() - first) + "\r\n\r\n" + resource.substr(first);
+    } else {
+        response = "HTTP/1.1 200 OK\r\n" + validators + "Content-Length: " + std::to_string(resource.size()) + "\r\n\r\n" + resource;
+    }
+    if(drop_next || stall_next) {
+        server->close_after_response = drop_next;
+        drop_next = false;
+        stall_next = false;
+        return response.substr(0, response.size() / 2);
+    }
+    return response;
+}
+
+struct outcome {
+    int completions = 0, errors = 0;
+    err_t error = ERR_OK;
+    uint32_t ms = 0;
+};
+
+// Runs a download over a fresh connection until it ends
+static outcome run(uint32_t offset = 0, std::string known_etag = "", uint32_t timeout_ms = 0) {
+    loopback_transport *transport = new loopback_transport(1460, 5);
+    server = new loopback_server(*transport, 5);
+    server->respond = respond;
+    received.clear();
+    outcome result;
+    {
+        range_download download("http://example.com/firmware.bin", transport);
+        download.set_timeout(timeout_ms);
+        download.on_data([](uint32_t at, std::span<const uint8_t> data){
+            CHECK(at == received.size());
+            received.append((const char*)data.data(), data.size());
+        });
+        download.on_complete([&result](){
+            result.completions++;
+        });
+        download.on_error([&result](err_t err){
+            result.errors++;
+            result.error = err;
+        });
+        received = resource.substr(0, offset);
+        download.start(offset, known_etag);
+        for(; result.ms < 30000 && download.active(); result.ms++) {
+            server->advance();
+        }
+        CHECK(!download.active());
+        if(result.completions == 1) {
+            CHECK(download.total() == (int64_t)resource.size());
+            CHECK(download.committed() == resource.size());
+        }
+    }
+    return result;
+}
+
+static void reset(bool with_ranges) {
+    delete server;
+    server = nullptr;
+    resource.clear();
+    for(int i = 0; i < 20000; i++) {
+        resource += (char)('a' + i * 7 % 26);
+    }
+    etag = "v1";
+    ranges = with_ranges;
+}
+
+int main() {
+    // A drop mid-body picks up from the last byte delivered
+    reset(true);
+    drop_next = true;
+    outcome result = run();
+    CHECK(result.completions == 1 && result.errors == 0);
+    CHECK(received == resource);
+    CHECK(server->requests.size() == 2);
+    CHECK(server->requests[0].find("Range: bytes=0-\r\n") != std::string::npos);
+    CHECK(server->requests[1].find("Range: bytes=0-\r\n") == std::string::npos);
+
+    // A server that ignores Range sends it all again, what was delivered is skipped
+    reset(false);
+    drop_next = true;
+    result = run();
+    CHECK(result.completions == 1 && result.errors == 0);
+    CHECK(received == resource);
+    CHECK(server->requests.size() == 2);
+
+    // A new ETag after the resume stops the download rather than mixing versions
+    reset(true);
+    drop_next = true;
+    {
+        loopback_transport *transport = new loopback_transport(1460, 5);
+        server = new loopback_server(*transport, 5);
+        server->respond = [](const std::string &head){
+            // The first response goes out as v1, the retry as v2
+            std::string response = respond(head);
+            etag = "v2";
+            return response;
+        };
+        received.clear();
+        int errors = 0;
+        range_download download("http://example.com/firmware.bin", transport);
+        download.on_data([](uint32_t, std::span<const uint8_t> data){
+            received.append((const char*)data.data(), data.size());
+        });
+        download.on_error([&errors](err_t err){
+            CHECK(err == ERR_VAL);
+            errors++;
+        });
+        download.start();
+        for(int ms = 0; ms < 30000 && download.active(); ms++) {
+            server->advance();
+        }
+        CHECK(errors == 1);
+        CHECK(download.changed());
+        CHECK(received.size() < resource.size());
+        CHECK(received == resource.substr(0, received.size()));
+    }
+
+    // So does a different total, when there are no validators to go by
+    reset(true);
+    etag.clear();
+    drop_next = true;
+    {
+        loopback_transport *transport = new loopback_transport(1460, 5);
+        server = new loopback_server(*transport, 5);
+        server->respond = [](const std::string &head){
+            std::string response = respond(head);
+            resource += "appended";
+            return response;
+        };
+        int errors = 0;
+        range_download download("http://example.com/firmware.bin", transport);
+        download.on_error([&errors](err_t err){
+            CHECK(err == ERR_VAL);
+            errors++;
+        });
+        download.start();
+        for(int ms = 0; ms < 30000 && download.active(); ms++) {
+            server->advance();
+        }
+        CHECK(errors == 1);
+        CHECK(download.changed());
+    }
+
+    // Starting at the end finds nothing left, which is a complete download
+    reset(true);
+    result = run(resource.size(), "\"v1\"");
+    CHECK(result.completions == 1 && result.errors == 0);
+    CHECK(received == resource);
+    CHECK(server->requests.size() == 1);
+
+    // A response that stops without closing is dropped by the watchdog and resumed
+    reset(true);
+    stall_next = true;
+    result = run(0, "", 300);
+    CHECK(result.completions == 1 && result.errors == 0);
+    CHECK(received == resource);
+    CHECK(server->requests.size() == 2);
+    CHECK(server->requests[1].find("Range: bytes=0-\r\n") == std::string::npos);
+    // Not before the watchdog had seen a whole period without data
+    CHECK(result.ms >= 300);
+    delete server;
+    return 0;
+}
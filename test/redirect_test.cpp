@@ -0,0 +1,98 @@
+#include <string>
+
+#include "http_client.h"
+#include "loopback_server.h"
+
+#include "test.h"
+
+static std::string redirect(int status, const std::string &location) {
+    return "HTTP/1.1 " + std::to_string(status) + " Redirect\r\nLocation: " + location + "\r\nContent-Length: 5\r\n\r\nREDIR";
+}
+
+static std::string respond(const std::string &head) {
+    size_t start = head.find(' ') + 1;
+    std::string path = head.substr(start, head.find(' ', start) - start);
+    if(path == "/a") {
+        return redirect(302, "b?x=1");
+    }
+    if(path == "/post303") {
+        return redirect(303, "/done");
+    }
+    if(path == "/post307") {
+        return redirect(307, "/done");
+    }
+    if(path == "/cross") {
+        return redirect(301, "http://cdn.example.net:8080/file");
+    }
+    if(path.starts_with("/loop")) {
+        return redirect(302, "/loop" + std::to_string(path.size()));
+    }
+    return "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+}
+
+// Request line of the request at index, the start of a request body is no part of it
+static std::string request_line(const loopback_server &server, size_t index) {
+    const std::string &head = server.requests[index];
+    size_t method = head.find_first_of("GP");
+    return head.substr(method, head.find("\r\n") - method);
+}
+
+int main() {
+    loopback_transport *transport = new loopback_transport(536, 2);
+    loopback_server server(*transport, 2);
+    server.respond = respond;
+    http_client client("http://example.com/", transport);
+    int responses = 0;
+    client.on_response([&responses](){
+        responses++;
+    });
+    auto wait = [&server, &responses](int before){
+        for(int ms = 0; ms < 1000 && responses == before; ms++) {
+            server.advance();
+        }
+        CHECK(responses == before + 1);
+    };
+
+    // Redirects are left to the caller unless asked for
+    client.get("/a");
+    wait(0);
+    CHECK(client.response().status() == 302);
+    CHECK(server.requests.size() == 1);
+
+    client.follow_redirects(HTTP_MAX_REDIRECTS);
+    client.get("/a");
+    wait(1);
+    CHECK(client.response().status() == 200);
+    CHECK(client.response().get_body() == "ok");
+    CHECK(client.redirects() == 1);
+    CHECK(request_line(server, 2) == "GET /b?x=1 HTTP/1.1");
+
+    client.post("/post303", "data");
+    wait(2);
+    CHECK(client.response().status() == 200);
+    CHECK(request_line(server, 4) == "GET /done HTTP/1.1");
+
+    client.post("/post307", "data");
+    wait(3);
+    CHECK(client.response().status() == 200);
+    CHECK(request_line(server, 6) == "POST /done HTTP/1.1");
+
+    // Past the limit the last redirect is handed on
+    client.get("/loop");
+    wait(4);
+    CHECK(client.response().status() == 302);
+    CHECK(client.redirects() == HTTP_MAX_REDIRECTS);
+
+    // Credentials stay with the origin they were meant for
+    size_t sent = server.requests.size();
+    client.header("Authorization", "secret");
+    client.get("/cross");
+    wait(5);
+    CHECK(client.response().status() == 200);
+    CHECK(server.requests.size() == sent + 2);
+    CHECK(request_line(server, sent + 1) == "GET /file HTTP/1.1");
+    CHECK(server.requests[sent].find("Authorization: secret\r\n") != std::string::npos);
+    CHECK(server.requests[sent + 1].find("Host: cdn.example.net") != std::string::npos);
+    CHECK(server.requests[sent + 1].find("Authorization") == std::string::npos);
+    return 0;
+}
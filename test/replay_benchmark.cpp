@@ -0,0 +1,113 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "http_client.h"
+#include "recording_transport.h"
+#include "replay_transport.h"
+
+#include "loopback_server.h"
+
+// Host cost of taking a recorded HTTP session through http_client, played back
+// as fast as the client consumes it. Given a file, the trace in it is played
+// instead of the built-in one, so traffic captured once from a real backend
+// with recording_transport can be measured repeatably. Each response is
+// answered with the next GET, the way the session was recorded.
+
+static std::vector<uint8_t> trace;
+
+// Polling traffic: small JSON bodies, a chunked listing now and then, one larger file
+static std::string respond(const std::string &head) {
+    static int count = 0;
+    count++;
+    if(head.starts_with("GET /file ")) {
+        return "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: 16384\r\n\r\n" + std::string(16384, 'f');
+    }
+    if(count % 5 == 0) {
+        std::string message = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n";
+        for(int i = 0; i < 8; i++) {
+            message += "100\r\n" + std::string(256, '[') + "\r\n";
+        }
+        return message + "0\r\n\r\n";
+    }
+    std::string body = "{\"temperature\":21.5,\"humidity\":40,\"sequence\":" + std::to_string(count) + "}";
+    return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nCache-Control: no-cache\r\nContent-Length: "
+        + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// Records a session of requests over a loopback link with some latency
+static void record(int requests) {
+    loopback_transport *inner = new loopback_transport(1460, 5);
+    loopback_server server(*inner, 5);
+    server.respond = respond;
+    recording_transport *recording = new recording_transport(inner, [](std::span<const uint8_t> data){
+        trace.insert(trace.end(), data.begin(), data.end());
+    });
+    http_client client("http://example.com/", recording);
+    int responses = 0;
+    client.on_response([&responses](){
+        responses++;
+    });
+    for(int i = 0; i < requests; i++) {
+        client.get(i == requests / 2 ? "/file" : "/status");
+        for(int ms = 0; ms < 1000 && responses == i; ms++) {
+            server.advance();
+        }
+    }
+    if(responses != requests) {
+        printf("recording stopped after %d of %d responses\n", responses, requests);
+    }
+}
+
+// Plays the trace once, returning the responses the client got
+static int play() {
+    replay_transport *transport = new replay_transport(trace);
+    http_client client("http://example.com/", transport);
+    int responses = 0, sent = 1;
+    client.on_response([&responses](){
+        responses++;
+    });
+    client.get("/status");
+    while(!transport->finished() && transport->valid()) {
+        int before = responses;
+        transport->advance();
+        if(responses == sent) {
+            client.get("/status");
+            sent++;
+        } else if(responses == before) {
+            // Waiting on nothing the client will do
+            break;
+        }
+    }
+    return responses;
+}
+
+int main(int argc, char **argv) {
+    if(argc > 1) {
+        std::ifstream file(argv[1], std::ios::binary);
+        trace.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    } else {
+        record(50);
+    }
+    int responses = play();
+    if(responses == 0) {
+        printf("no responses in the trace\n");
+        return 1;
+    }
+    const int iterations = 500;
+    alloc_counter::reset();
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++) {
+        play();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%zu byte trace, %d responses\n", trace.size(), responses);
+    printf("%8.3f us/session  %8.3f us/response  %6.2f allocations/response\n",
+        seconds * 1e6 / iterations, seconds * 1e6 / iterations / responses,
+        (double)alloc_counter::allocations() / iterations / responses);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "alloc_counter.h"
+#include "http_client.h"
+#include "prepared_request.h"
+
+#include "canned_transport.h"
+
+// Host cost of building and sending a request, in time and heap allocations.
+// The times compare paths against each other; the allocation counts hold on
+// the device as well.
+
+static const std::string_view response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+
+template <class Body>
+static void measure(const char *name, int iterations, Body body) {
+    // One untimed round sizes whatever buffers the path keeps
+    body();
+    alloc_counter::reset();
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++) {
+        body();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-44s %8.3f us/request  %6.2f allocations/request\n", name,
+        seconds * 1e6 / iterations, (double)alloc_counter::allocations() / iterations);
+}
+
+int main() {
+    const int iterations = 200000;
+    http_request request("POST", "/api/v1/telemetry", "{\"temperature\":21.5}");
+    request.identify("sensors.example.com", "pico");
+    request.add_header("Content-Type", "application/json");
+    request.add_header("Authorization", "Bearer 0123456789abcdef");
+
+    size_t sink = 0;
+    measure("http_request::serialize (std::string)", iterations, [&](){
+        sink += request.serialize().size();
+    });
+    uint8_t staging[HTTP_BUFFER_BLOCK_SIZE];
+    measure("http_request::write_head (pooled block)", iterations, [&](){
+        sink += request.write_head(staging, [](std::span<const uint8_t>){});
+    });
+
+    canned_transport *transport = new canned_transport(response);
+    http_client client("http://sensors.example.com/", transport);
+    measure("http_client::get, round trip", iterations, [&](){
+        client.get("/api/v1/status");
+        transport->answer();
+    });
+    measure("http_client::post with a header, round trip", iterations, [&](){
+        client.header("Content-Type", "application/json");
+        client.post("/api/v1/telemetry", "{\"temperature\":21.5}");
+        transport->answer();
+    });
+    prepared_request prepared = client.prepare("POST", "/api/v1/telemetry");
+    prepared.header("Content-Type", "application/json");
+    measure("http_client::send (prepared), round trip", iterations, [&](){
+        prepared.body("{\"temperature\":21.5}");
+        client.send(prepared);
+        transport->answer();
+    });
+    if(sink == 0) {
+        printf("nothing serialized\n");
+    }
+    return 0;
+}
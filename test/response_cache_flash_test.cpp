@@ -0,0 +1,77 @@
+#include <cstring>
+#include <string>
+
+#include "http_request.h"
+#include "http_response.h"
+#include "response_cache.h"
+
+#include "test.h"
+
+// Flash the cache lives in, and what has been done to it
+uint8_t host_flash[HTTP_CACHE_FLASH_OFFSET + HTTP_CACHE_ENTRIES * HTTP_CACHE_FLASH_SLOT_SIZE];
+static int erases, programs;
+
+void flash_range_erase(uint32_t offset, size_t count) {
+    CHECK(offset % FLASH_SECTOR_SIZE == 0 && count % FLASH_SECTOR_SIZE == 0);
+    CHECK(offset + count <= sizeof(host_flash));
+    memset(host_flash + offset, 0xFF, count);
+    erases++;
+}
+
+void flash_range_program(uint32_t offset, const uint8_t *data, size_t count) {
+    CHECK(offset % FLASH_PAGE_SIZE == 0 && count % FLASH_PAGE_SIZE == 0);
+    CHECK(offset + count <= sizeof(host_flash));
+    memcpy(host_flash + offset, data, count);
+    programs++;
+}
+
+static void store(response_cache &cache, const std::string &message) {
+    http_request request;
+    http_response response(&request);
+    CHECK(response.parse({(uint8_t*)message.data(), message.size()}) == message.size());
+    cache.store("http://example.com:80/config", response);
+}
+
+static std::string body(const response_cache::entry *cached) {
+    CHECK(cached != nullptr);
+    return {(const char*)cached->body().data(), cached->body().size()};
+}
+
+int main() {
+    memset(host_flash, 0xFF, sizeof(host_flash));
+    std::string v1 = "HTTP/1.1 200 OK\r\nETag: \"v1\"\r\nContent-Length: 12\r\n\r\n{\"cfg\":true}";
+    std::string v2 = "HTTP/1.1 200 OK\r\nETag: \"v2\"\r\nContent-Length: 13\r\n\r\n{\"cfg\":false}";
+    {
+        response_cache cache;
+        // Storing happens in lwIP's receive callback, so flash waits for flush()
+        store(cache, v1);
+        CHECK(erases == 0 && programs == 0);
+        CHECK(body(cache.find("http://example.com:80/config")) == "{\"cfg\":true}");
+        cache.flush();
+        CHECK(erases == 1 && programs > 0);
+        const uint8_t *data = cache.find("http://example.com:80/config")->body().data();
+        CHECK(data >= host_flash && data < host_flash + sizeof(host_flash));
+
+        // The same response again leaves flash alone
+        store(cache, v1);
+        cache.flush();
+        CHECK(erases == 1);
+
+        store(cache, v2);
+        CHECK(body(cache.find("http://example.com:80/config")) == "{\"cfg\":false}");
+        cache.flush();
+        CHECK(erases == 2);
+    }
+    {
+        // Written entries survive a reset, removed ones are wiped by the next flush()
+        response_cache cache;
+        CHECK(body(cache.find("http://example.com:80/config")) == "{\"cfg\":false}");
+        cache.remove("http://example.com:80/config");
+        CHECK(erases == 2);
+        cache.flush();
+        CHECK(erases == 3);
+    }
+    response_cache cache;
+    CHECK(cache.size() == 0);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <string>
+
+#include "http_client.h"
+#include "loopback_server.h"
+
+#include "test.h"
+
+static const char *validated = "HTTP/1.1 304 Not Modified\r\nETag: \"v1\"\r\n\r\n";
+static const char *fresh = "HTTP/1.1 200 OK\r\nETag: \"v1\"\r\nContent-Length: 12\r\n\r\n{\"cfg\":true}";
+
+static response_cache *evicting;
+
+// A 304 is served from the cache, which is keyed on scheme, host, port and target
+static void revalidate() {
+    loopback_transport *transport = new loopback_transport(536);
+    loopback_server server(*transport, 1);
+    server.respond = [](const std::string &head) -> std::string {
+        return head.find("If-None-Match: \"v1\"") != std::string::npos ? validated : fresh;
+    };
+    http_client client("http://example.com/", transport);
+    response_cache cache;
+    client.cache(&cache);
+    client.get("/config");
+    server.advance(20);
+    CHECK(client.response().status() == 200);
+    CHECK(cache.find("http://example.com:80/config") != nullptr);
+    CHECK(cache.find("example.com:80/config") == nullptr);
+    client.get("/config");
+    server.advance(20);
+    CHECK(server.requests.size() == 2);
+    CHECK(server.requests[1].find("If-None-Match: \"v1\"\r\n") != std::string::npos);
+    CHECK(client.response().from_cache());
+    CHECK(client.response().status() == 200);
+    CHECK(client.response().get_body() == "{\"cfg\":true}");
+}
+
+// The entry goes while the conditional request is out, so the 304 has nothing to
+// stand for and the request goes out again without validators
+static void evicted() {
+    loopback_transport *transport = new loopback_transport(536);
+    loopback_server server(*transport, 1);
+    server.respond = [](const std::string &head) -> std::string {
+        if(head.find("If-None-Match") == std::string::npos) {
+            return fresh;
+        }
+        evicting->clear();
+        return validated;
+    };
+    http_client client("http://example.com/", transport);
+    response_cache cache;
+    evicting = &cache;
+    client.cache(&cache);
+    int responses = 0;
+    client.on_response([&responses](){
+        responses++;
+    });
+    client.get("/config");
+    server.advance(20);
+    client.get("/config");
+    server.advance(20);
+    CHECK(server.requests.size() == 3);
+    CHECK(server.requests[2].find("If-None-Match") == std::string::npos);
+    CHECK(responses == 2);
+    CHECK(!client.response().from_cache());
+    CHECK(client.response().status() == 200);
+    CHECK(client.response().get_body() == "{\"cfg\":true}");
+    CHECK(cache.size() == 1);
+}
+
+int main() {
+    revalidate();
+    evicted();
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <cstdio>
+#include <string>
+
+#include "segmented_download.h"
+#include "loopback_server.h"
+
+// Simulated time to download a resource over loopback links with a round trip
+// delay and LOOPBACK_SEND_BUFFER bytes in flight per connection, once split over
+// HTTP_SEGMENT_CONNECTIONS connections and once from a server without Range
+// support, which leaves a single connection
+
+static loopback_transport *clients[HTTP_SEGMENT_CONNECTIONS];
+static loopback_server *servers[HTTP_SEGMENT_CONNECTIONS];
+static std::string resource;
+static uint32_t latency_ms;
+static bool ranges;
+
+static std::string respond(const std::string &head) {
+    size_t range = head.find("Range: bytes=");
+    if(!ranges || range == std::string::npos) {
+        return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(resource.size()) + "\r\n\r\n" + resource;
+    }
+    size_t first = std::stoul(head.substr(range + 13));
+    size_t last = std::min(resource.size() - 1, (size_t)std::stoul(head.substr(head.find('-', range) + 1)));
+    return "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/"
+        + std::to_string(resource.size()) + "\r\nContent-Length: " + std::to_string(last - first + 1) + "\r\n\r\n"
+        + resource.substr(first, last - first + 1);
+}
+
+static tcp_base *open(uint8_t index) {
+    clients[index] = new loopback_transport(1460, latency_ms / 2);
+    servers[index] = new loopback_server(*clients[index], latency_ms / 2);
+    servers[index]->respond = respond;
+    return clients[index];
+}
+
+// Simulated milliseconds until the download completes
+static uint32_t run() {
+    segmented_download download("http://example.com/big.bin", open);
+    download.start();
+    uint32_t ms = 0;
+    for(; ms < 600000 && download.active(); ms++) {
+        for(uint8_t i = 0; i < HTTP_SEGMENT_CONNECTIONS; i++) {
+            if(servers[i]) {
+                clients[i]->advance();
+                servers[i]->end().advance();
+            }
+        }
+        host_advance_ms(1);
+    }
+    if(download.delivered() != resource.size()) {
+        printf("download did not complete\n");
+    }
+    for(loopback_server *&server : servers) {
+        delete server;
+        server = nullptr;
+    }
+    return ms;
+}
+
+int main() {
+    resource.assign(256 * 1024, 'x');
+    printf("%zu bytes, %d connections of %d byte segments\n", resource.size(), HTTP_SEGMENT_CONNECTIONS, HTTP_SEGMENT_SIZE);
+    for(uint32_t rtt : {10, 40, 100, 200}) {
+        latency_ms = rtt;
+        ranges = false;
+        uint32_t single = run();
+        ranges = true;
+        uint32_t segmented = run();
+        printf("%4u ms round trip  single %7u ms  %7.1f KB/s  segmented %7u ms  %7.1f KB/s  %.2fx\n", rtt,
+            single, resource.size() / 1.024 / single, segmented, resource.size() / 1.024 / segmented, (double)single / segmented);
+    }
+    return 0;
+}
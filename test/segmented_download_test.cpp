@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <string>
+
+#include "segmented_download.h"
+#include "loopback_server.h"
+
+#include "test.h"
+
+// One loopback server per connection, created as the download opens them
+static loopback_transport *clients[HTTP_SEGMENT_CONNECTIONS];
+static loopback_server *servers[HTTP_SEGMENT_CONNECTIONS];
+static std::string resource, received;
+static bool ranges, content_length;
+static int drop_on = -1;
+
+static std::string respond(uint8_t index, const std::string &head) {
+    size_t first = 0, last = resource.size() - 1, range = head.find("Range: bytes=");
+    if(!ranges || range == std::string::npos) {
+        std::string length = content_length ? "Content-Length: " + std::to_string(resource.size()) + "\r\n" : "";
+        servers[index]->close_after_response = !content_length;
+        return "HTTP/1.1 200 OK\r\n" + length + "\r\n" + resource;
+    }
+    first = std::stoul(head.substr(range + 13));
+    last = std::min(last, (size_t)std::stoul(head.substr(head.find('-', range) + 1)));
+    std::string body = resource.substr(first, last - first + 1);
+    std::string response = "HTTP/1.1 206 Partial Content\r\nETag: \"r1\"\r\nContent-Range: bytes " + std::to_string(first) + "-"
+        + std::to_string(last) + "/" + std::to_string(resource.size()) + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    if(index == drop_on) {
+        // Cut off halfway, the segment has to be picked up where it stopped
+        drop_on = -1;
+        servers[index]->close_after_response = true;
+        return response.substr(0, response.size() / 2);
+    }
+    return response;
+}
+
+static tcp_base *open(uint8_t index) {
+    clients[index] = new loopback_transport(1460, 10);
+    servers[index] = new loopback_server(*clients[index], 10);
+    servers[index]->respond = [index](const std::string &head){
+        return respond(index, head);
+    };
+    return clients[index];
+}
+
+// Runs a download of resource to the end, returning the most it held back at once
+static size_t run(segmented_download &download) {
+    int errors = 0, completions = 0;
+    size_t most_buffered = 0;
+    received.clear();
+    download.on_data([](uint32_t offset, std::span<const uint8_t> data){
+        CHECK(offset == received.size());
+        received.append((const char*)data.data(), data.size());
+    });
+    download.on_complete([&completions](){
+        completions++;
+    });
+    download.on_error([&errors](err_t){
+        errors++;
+    });
+    download.start();
+    for(int ms = 0; ms < 60000 && download.active(); ms++) {
+        for(uint8_t i = 0; i < HTTP_SEGMENT_CONNECTIONS; i++) {
+            if(servers[i]) {
+                clients[i]->advance();
+                servers[i]->end().advance();
+            }
+        }
+        host_advance_ms(1);
+        most_buffered = std::max(most_buffered, download.buffered());
+    }
+    CHECK(!download.active());
+    CHECK(errors == 0);
+    CHECK(completions == 1);
+    CHECK(received == resource);
+    CHECK(download.total() == (int64_t)resource.size());
+    for(loopback_server *&server : servers) {
+        delete server;
+        server = nullptr;
+    }
+    return most_buffered;
+}
+
+int main() {
+    for(size_t i = 0; i < 200000; i++) {
+        resource += (char)('A' + i * 7 % 53);
+    }
+
+    // Segments in parallel, one of them cut off once, never holding back more than the other connections' segments
+    ranges = true;
+    drop_on = 1;
+    {
+        segmented_download download("http://example.com/big.bin", open);
+        size_t most_buffered = run(download);
+        CHECK(most_buffered > 0);
+        CHECK(most_buffered <= (HTTP_SEGMENT_CONNECTIONS - 1) * HTTP_SEGMENT_SIZE);
+    }
+
+    // Without Range support the whole body comes down one connection
+    ranges = false;
+    content_length = true;
+    {
+        segmented_download download("http://example.com/big.bin", open);
+        CHECK(run(download) == 0);
+    }
+
+    // Nor does it need a Content-Length, the close ends the body
+    content_length = false;
+    {
+        segmented_download download("http://example.com/big.bin", open);
+        CHECK(run(download) == 0);
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <string>
+
+#include "http_scheduler.h"
+#include "loopback_server.h"
+
+#include "test.h"
+
+// One loopback server per connection, created as the scheduler opens them
+static loopback_transport *clients[HTTP_SCHEDULER_MAX_CONNECTIONS];
+static loopback_server *servers[HTTP_SCHEDULER_MAX_CONNECTIONS];
+static std::string received;
+static int errors;
+
+static std::string respond(const std::string &head) {
+    std::string target = head.substr(head.find(' ') + 1);
+    std::string body = "body of " + target.substr(0, target.find(' '));
+    return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+static tcp_base *open(uint8_t index) {
+    clients[index] = new loopback_transport(1460, 10);
+    servers[index] = new loopback_server(*clients[index], 10);
+    servers[index]->respond = respond;
+    return clients[index];
+}
+
+// Requests the servers saw for target
+static int requests_for(const std::string &target) {
+    int count = 0;
+    for(loopback_server *server : servers) {
+        for(const std::string &head : server ? server->requests : std::vector<std::string>{}) {
+            count += head.starts_with("GET " + target + " ");
+        }
+    }
+    return count;
+}
+
+static void run(http_scheduler &scheduler) {
+    for(int ms = 0; ms < 5000 && (scheduler.queued() > 0 || scheduler.in_flight() > 0); ms++) {
+        for(uint8_t i = 0; i < HTTP_SCHEDULER_MAX_CONNECTIONS; i++) {
+            if(servers[i]) {
+                clients[i]->advance();
+                servers[i]->end().advance();
+            }
+        }
+        host_advance_ms(1);
+    }
+    CHECK(scheduler.queued() == 0);
+    CHECK(scheduler.in_flight() == 0);
+}
+
+// Submits the same resource under differently cased origins, next to another one
+static void submit(http_scheduler &scheduler) {
+    auto append = [](const http_response &response){
+        received += "[" + std::string(response.get_body()) + "]";
+    };
+    auto fail = [](err_t){
+        errors++;
+    };
+    CHECK(scheduler.submit("http://example.com/config", append, fail));
+    CHECK(scheduler.submit("HTTP://Example.COM/config", append, fail));
+    CHECK(scheduler.submit("http://example.com/other", append, fail));
+    CHECK(scheduler.submit("http://EXAMPLE.com/config", append, fail));
+}
+
+static void reset() {
+    for(loopback_server *&server : servers) {
+        delete server;
+        server = nullptr;
+    }
+    received.clear();
+    errors = 0;
+}
+
+int main() {
+    // Off, every request goes out on its own
+    {
+        http_scheduler scheduler(open);
+        submit(scheduler);
+        run(scheduler);
+        CHECK(errors == 0);
+        CHECK(requests_for("/config") == 3);
+        CHECK(requests_for("/other") == 1);
+        reset();
+    }
+
+    // On, the copies join the first whatever case their scheme and host are in
+    {
+        http_scheduler scheduler(open);
+        scheduler.single_flight(true);
+        submit(scheduler);
+        run(scheduler);
+        CHECK(errors == 0);
+        CHECK(requests_for("/config") == 1);
+        CHECK(requests_for("/other") == 1);
+        // Every caller gets the response, the one that was sent
+        CHECK(received.find("[body of /other]") != std::string::npos);
+        size_t copies = 0;
+        for(size_t at = received.find("[body of /config]"); at != std::string::npos; at = received.find("[body of /config]", at + 1)) {
+            copies++;
+        }
+        CHECK(copies == 3);
+
+        // Once it is done, the next one goes out again
+        CHECK(scheduler.submit("http://example.com/config", [](const http_response &){}));
+        run(scheduler);
+        CHECK(requests_for("/config") == 2);
+        reset();
+    }
+
+    // A POST never joins a GET
+    {
+        http_scheduler scheduler(open);
+        scheduler.single_flight(true);
+        CHECK(scheduler.submit("http://example.com/config", [](const http_response &){}));
+        CHECK(scheduler.submit("http://example.com/config", [](const http_response &){}, {}, "POST", "x"));
+        run(scheduler);
+        CHECK(requests_for("/config") == 1);
+        int posts = 0;
+        for(loopback_server *server : servers) {
+            for(const std::string &head : server ? server->requests : std::vector<std::string>{}) {
+                posts += head.starts_with("POST /config ");
+            }
+        }
+        CHECK(posts == 1);
+        reset();
+    }
+    return 0;
+}
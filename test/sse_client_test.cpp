@@ -0,0 +1,136 @@
+#include <string>
+#include <vector>
+
+#include "sse_client.h"
+#include "loopback_server.h"
+
+#include "test.h"
+
+static loopback_server *server;
+// Each request gets the next of these after the head, the connection closes after all but the last
+static std::vector<std::string> streams;
+static std::vector<uint32_t> request_ms;
+
+struct event {
+    std::string type, data, id;
+    bool operator==(const event&) const = default;
+};
+static std::vector<event> events;
+
+static std::string respond(const std::string &) {
+    request_ms.push_back(to_ms_since_boot(get_absolute_time()));
+    size_t index = server->requests.size() - 1;
+    server->close_after_response = index + 1 < streams.size();
+    return "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n\r\n"
+        + (index < streams.size() ? streams[index] : "");
+}
+
+// Serves streams to an sse_client, the server writing segment_size bytes at a time
+static sse_client *open(size_t segment_size, std::string last_event_id = "") {
+    events.clear();
+    request_ms.clear();
+    loopback_transport *transport = new loopback_transport(1460, 5);
+    server = new loopback_server(*transport, 5, segment_size);
+    server->respond = respond;
+    sse_client *client = new sse_client("http://example.com/events", transport);
+    client->on_event([](std::string_view type, std::string_view data, std::string_view id){
+        events.push_back({std::string(type), std::string(data), std::string(id)});
+    });
+    client->start(last_event_id);
+    return client;
+}
+
+static void finish(sse_client *client) {
+    client->stop();
+    server->advance(10);
+    delete client;
+    delete server;
+    server = nullptr;
+}
+
+// Line endings of every kind, a BOM, comments and multi-line data, split at
+// every byte and then at sizes that land on other boundaries
+static void parsing() {
+    streams = {
+        "\xEF\xBB\xBF" "data: first\r\n\r\n"
+        ": keep-alive\n"
+        "data: x\r\ndata: y\r\n\r\n"
+        "event: update\rid: 7\rdata:no space\r\r"
+        "data: line one\ndata:  two\ndata\n\n"
+        "id: 8\r\nevent: ignored\r\n\r\n"
+        "data: \xEF\xBB\xBF" "kept\n\n"
+    };
+    std::vector<event> expected = {
+        {"message", "first", ""},
+        {"message", "x\ny", ""},
+        {"update", "no space", "7"},
+        {"message", "line one\n two\n", "7"},
+        {"message", "\xEF\xBB\xBF" "kept", "8"},
+    };
+    for(size_t segment_size : {1, 2, 3, 5, 1460}) {
+        sse_client *client = open(segment_size);
+        server->advance(300);
+        CHECK(client->open());
+        CHECK(events == expected);
+        CHECK(client->last_event_id() == "8");
+        CHECK(server->requests.size() == 1);
+        finish(client);
+    }
+}
+
+// Events over SSE_MAX_EVENT_SIZE are dropped, by their data or by any one line, and the stream carries on
+static void oversized() {
+    std::string big(SSE_MAX_EVENT_SIZE - 100, 'b');
+    std::string part(SSE_MAX_EVENT_SIZE / 2, 'p');
+    streams = {
+        "data: " + big + "\n\n"
+        "data: " + part + "\ndata: " + part + "\ndata: " + part + "\n\n"
+        "event: " + std::string(SSE_MAX_EVENT_SIZE + 10, 'l') + "\ndata: small\n\n"
+        "data: after\n\n"
+    };
+    sse_client *client = open(1460);
+    server->advance(100);
+    CHECK(events.size() == 2);
+    CHECK(events[0].data == big);
+    CHECK(events[1].data == "after");
+    finish(client);
+}
+
+// A stream that ends reconnects after the server's retry:, sending the last id it saw
+static void reconnect() {
+    streams = {
+        "retry: 500\nid: 41\ndata: one\n\nid: 42\ndata: two\n\n",
+        "data: three\n\n",
+    };
+    sse_client *client = open(1460);
+    server->advance(400);
+    CHECK(events.size() == 2);
+    CHECK(server->requests.size() == 1);
+    CHECK(server->requests[0].find("Last-Event-ID") == std::string::npos);
+    CHECK(server->requests[0].find("Accept: text/event-stream\r\n") != std::string::npos);
+    CHECK(client->retry_ms() == 500);
+    server->advance(600);
+    CHECK(server->requests.size() == 2);
+    CHECK(server->requests[1].find("Last-Event-ID: 42\r\n") != std::string::npos);
+    // The close takes a latency to arrive and the new request another, well short of SSE_RETRY_MS
+    uint32_t gap = request_ms[1] - request_ms[0];
+    CHECK(gap >= 500 && gap <= 560);
+    CHECK(events.size() == 3);
+    CHECK((events.back() == event{"message", "three", "42"}));
+    finish(client);
+
+    // An id handed to start() goes out with the very first request
+    streams = {"data: resumed\n\n"};
+    client = open(1460, "99");
+    server->advance(100);
+    CHECK(server->requests[0].find("Last-Event-ID: 99\r\n") != std::string::npos);
+    CHECK((events == std::vector<event>{{"message", "resumed", "99"}}));
+    finish(client);
+}
+
+int main() {
+    parsing();
+    oversized();
+    reconnect();
+    return 0;
+}
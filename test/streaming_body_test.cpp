@@ -0,0 +1,58 @@
+#include <string_view>
+
+#include "alloc_counter.h"
+#include "http_client.h"
+
+#include "canned_transport.h"
+#include "test.h"
+
+static_assert(HTTP_DEFAULT_CAPACITY <= 2560, "the head buffer is all the response keeps resident");
+
+static constexpr size_t body_length = 1 << 20;
+
+static const std::string_view head =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 1048576\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "\r\n";
+
+struct stream_state {
+    size_t received = 0;
+    bool corrupt = false;
+    // Heap use between the first body byte and on_response
+    size_t allocations = 0, bytes = 0;
+    bool done = false;
+};
+
+// A 1 MB body goes through on_body_chunk with nothing but the head buffer
+// resident: no byte is buffered and the heap is not touched while it streams
+int main() {
+    static stream_state state;
+    canned_transport *transport = new canned_transport(head, body_length, 1460);
+    http_client client("http://example.com/", transport);
+    client.on_body_chunk([](std::span<const uint8_t> chunk){
+        if(state.received == 0) {
+            alloc_counter::reset();
+        }
+        for(size_t i = 0; i < chunk.size(); i++) {
+            state.corrupt |= chunk[i] != canned_transport::body_byte(state.received + i);
+        }
+        state.received += chunk.size();
+    });
+    client.on_response([&client](){
+        state.allocations = alloc_counter::allocations();
+        state.bytes = alloc_counter::bytes_allocated();
+        state.done = true;
+        CHECK(client.response().body_size() == 0);
+        CHECK(client.response().get_body().empty());
+    });
+    client.get("/firmware.bin");
+    transport->answer();
+
+    CHECK(state.done);
+    CHECK(state.received == body_length);
+    CHECK(!state.corrupt);
+    CHECK(state.allocations == 0);
+    CHECK(state.bytes == 0);
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include <cstdint>
+#include <iterator>
+
+#include "timer_wheel.h"
+
+#include "test.h"
+
+static const uint64_t tick_us = TIMER_WHEEL_TICK_MS * 1000ull;
+
+static uint64_t now_us() {
+    return to_us_since_boot(get_absolute_time());
+}
+
+// When each timer was due and how many times it fired
+struct expectation {
+    uint64_t due_us = 0;
+    int fired = 0;
+};
+
+// Fires no earlier than asked and at most a tick later
+static void check_on_time(expectation &expected) {
+    uint64_t now = now_us();
+    CHECK(now >= expected.due_us);
+    CHECK(now - expected.due_us <= tick_us);
+    expected.fired++;
+}
+
+// Deadlines on every level and past the last one wait out their time in a
+// higher slot and come down level by level
+static void cascading() {
+    static const uint32_t delays_ms[] = {
+        1, 9, 10, 11, 630, 645, 1000, 40950, 50000, 2621430, 3000000, 200000000,
+    };
+    static expectation expected[std::size(delays_ms)];
+    static wheel_timer timers[std::size(delays_ms)];
+    // Not on a tick boundary, the tick under way is partly over
+    host_advance_ms(3);
+    for(size_t i = 0; i < std::size(delays_ms); i++) {
+        expected[i] = {now_us() + delays_ms[i] * 1000ull, 0};
+        timers[i].on_expire([i](){
+            check_on_time(expected[i]);
+        });
+        timers[i].start(delays_ms[i]);
+    }
+    CHECK(timer_wheel::shared().pending() == std::size(delays_ms));
+    uint64_t start = now_us();
+    for(size_t i = 0; i < std::size(delays_ms); i++) {
+        // Nothing a millisecond before, once by a tick after the deadline
+        if(expected[i].due_us > now_us() + 1000) {
+            host_advance_ms((expected[i].due_us - now_us()) / 1000 - 1);
+            CHECK(expected[i].fired == 0);
+            CHECK(timers[i].armed());
+        }
+        host_advance_ms((expected[i].due_us + tick_us - now_us()) / 1000);
+        CHECK(expected[i].fired == 1);
+        CHECK(!timers[i].armed());
+    }
+    CHECK(now_us() - start >= 200000000ull * 1000);
+    CHECK(timer_wheel::shared().pending() == 0);
+}
+
+// Timers started, moved and cancelled at random never fire early, late, or once cancelled
+static void random_deadlines() {
+    const int count = 200;
+    static expectation expected[count];
+    static wheel_timer timers[count];
+    static bool cancelled[count];
+    uint32_t state = 12345;
+    auto random = [&state](uint32_t bound){
+        state = state * 1103515245 + 12345;
+        return (state >> 8) % bound;
+    };
+    auto arm = [&](int i){
+        uint32_t scale = random(10);
+        uint32_t delay = scale < 6 ? random(700) : scale < 9 ? random(60000) : random(5000000);
+        expected[i].due_us = now_us() + delay * 1000ull;
+        cancelled[i] = false;
+        timers[i].start(delay);
+    };
+    for(int i = 0; i < count; i++) {
+        timers[i].on_expire([i](){
+            CHECK(!cancelled[i]);
+            check_on_time(expected[i]);
+        });
+        arm(i);
+    }
+    int fired = 0, cancels = 0;
+    for(int step = 0; step < 20000; step++) {
+        host_advance_ms(1 + random(97));
+        int i = random(count);
+        uint32_t action = random(10);
+        if(action == 0 && timers[i].armed()) {
+            timers[i].cancel();
+            cancelled[i] = true;
+            cancels++;
+        } else if(action < 3) {
+            arm(i);
+        }
+    }
+    host_advance_ms(5000000 + TIMER_WHEEL_TICK_MS);
+    size_t armed = 0;
+    for(int i = 0; i < count; i++) {
+        fired += expected[i].fired;
+        armed += timers[i].armed();
+    }
+    CHECK(fired > count && cancels > 0);
+    CHECK(armed == 0);
+    CHECK(timer_wheel::shared().pending() == 0);
+}
+
+// A callback may re-arm itself, or cancel, move and start the others due in the same tick
+static void from_callbacks() {
+    static wheel_timer self, victim, moved, started;
+    static int self_fired, victim_fired, moved_fired, started_fired;
+    static uint64_t self_at, moved_at;
+    self.on_expire([](){
+        self_fired++;
+        self_at = now_us();
+        if(self_fired < 5) {
+            self.start(100);
+        }
+        victim.cancel();
+        moved.start(250);
+        started.start(0);
+    });
+    victim.on_expire([](){
+        victim_fired++;
+    });
+    moved.on_expire([](){
+        moved_fired++;
+        moved_at = now_us();
+    });
+    started.on_expire([](){
+        started_fired++;
+    });
+    // Both due in the same tick as self, and behind it in the slot
+    victim.start(50);
+    moved.start(50);
+    self.start(50);
+    host_advance_ms(60);
+    CHECK(self_fired == 1);
+    CHECK(victim_fired == 0 && !victim.armed());
+    CHECK(moved_fired == 0 && moved.armed());
+    // A timer started from a callback for no time at all runs on the next tick, not 64 ticks on
+    host_advance_ms(TIMER_WHEEL_TICK_MS);
+    CHECK(started_fired == 1);
+    host_advance_ms(1000);
+    CHECK(self_fired == 5 && !self.armed());
+    CHECK(victim_fired == 0);
+    // Moved on by every run of self and fired 250 ms after the last
+    CHECK(moved_fired == 1);
+    CHECK(started_fired == 5);
+    CHECK(moved_at >= self_at + 250000 && moved_at - self_at - 250000 <= tick_us);
+    CHECK(timer_wheel::shared().pending() == 0);
+
+    // A timer that destroys itself from its own callback
+    static wheel_timer *owned = new wheel_timer();
+    static int owned_fired;
+    owned->on_expire([](){
+        owned_fired++;
+        delete owned;
+        owned = nullptr;
+    });
+    owned->start(20);
+    host_advance_ms(50);
+    CHECK(owned_fired == 1 && owned == nullptr);
+    CHECK(timer_wheel::shared().pending() == 0);
+}
+
+// Cancelling a timer that is not armed, never was or has fired, changes nothing
+static void cancel_unarmed() {
+    static int fired;
+    wheel_timer never, done([](){
+        fired++;
+    }), other([](){
+        fired++;
+    });
+    other.start(100);
+    never.cancel();
+    never.cancel();
+    CHECK(!never.armed());
+    CHECK(timer_wheel::shared().pending() == 1);
+    done.start(10);
+    host_advance_ms(30);
+    CHECK(fired == 1);
+    done.cancel();
+    CHECK(!done.armed());
+    CHECK(other.armed());
+    CHECK(timer_wheel::shared().pending() == 1);
+    host_advance_ms(100);
+    CHECK(fired == 2);
+    CHECK(timer_wheel::shared().pending() == 0);
+}
+
+int main() {
+    cascading();
+    random_deadlines();
+    from_callbacks();
+    cancel_unarmed();
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <string>
+#include <vector>
+
+#include "http_client.h"
+#include "recording_transport.h"
+#include "replay_transport.h"
+
+#include "loopback_server.h"
+#include "test.h"
+
+static std::vector<uint8_t> trace;
+
+static void append(std::span<const uint8_t> data) {
+    trace.insert(trace.end(), data.begin(), data.end());
+}
+
+// A reader that only reads when it gets round to it still gets every byte,
+// including what did not fit in the recording's buffer when it arrived
+static void drain() {
+    trace.clear();
+    loopback_transport *inner = new loopback_transport, peer;
+    loopback_transport::pair(*inner, peer);
+    recording_transport recording(inner, append);
+    std::string sent(3 * BUF_SIZE, 0), received;
+    for(size_t i = 0; i < sent.size(); i++) {
+        sent[i] = (char)(i * 13);
+    }
+    peer.on_connected([&](){
+        peer.write({(const uint8_t*)sent.data(), sent.size()});
+    });
+    CHECK(recording.connect("peer", 80));
+    for(int ms = 0; ms < 100 && received.size() < sent.size(); ms++) {
+        inner->advance();
+        peer.advance();
+        // What inner still holds counts as available too, so this can be more than BUF_SIZE
+        std::vector<uint8_t> buffer(recording.available());
+        size_t count = recording.read(buffer);
+        received.append((const char*)buffer.data(), count);
+    }
+    CHECK(received == sent);
+    CHECK(recording.available() == 0);
+}
+
+// Plays trace back into a fresh client, returning the body chunks it saw
+static std::vector<std::string> replay(bool paced, uint32_t &elapsed_ms) {
+    replay_transport *transport = new replay_transport(trace, paced);
+    http_client client("http://example.com/", transport);
+    std::vector<std::string> chunks;
+    int responses = 0;
+    client.on_body_chunk([&chunks](std::span<const uint8_t> data){
+        chunks.emplace_back((const char*)data.data(), data.size());
+    });
+    client.on_response([&responses](){
+        responses++;
+    });
+    client.get("/file");
+    for(elapsed_ms = 0; elapsed_ms < 1000 && responses == 0; elapsed_ms++) {
+        transport->advance(1);
+    }
+    CHECK(transport->valid());
+    CHECK(responses == 1);
+    CHECK(client.response().status() == 200);
+    return chunks;
+}
+
+// A recorded exchange plays back with the same chunk boundaries, paced or not
+static void round_trip() {
+    trace.clear();
+    std::string body(5000, 0);
+    for(size_t i = 0; i < body.size(); i++) {
+        body[i] = 'a' + i % 26;
+    }
+    loopback_transport *inner = new loopback_transport(536, 20);
+    loopback_server server(*inner, 20, 536);
+    server.respond = [&body](const std::string &){
+        return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    };
+    recording_transport *recording = new recording_transport(inner, append);
+    std::vector<std::string> recorded;
+    uint32_t recorded_ms = 0;
+    {
+        http_client client("http://example.com/", recording);
+        int responses = 0;
+        client.on_body_chunk([&recorded](std::span<const uint8_t> data){
+            recorded.emplace_back((const char*)data.data(), data.size());
+        });
+        client.on_response([&responses](){
+            responses++;
+        });
+        client.get("/file");
+        for(; recorded_ms < 1000 && responses == 0; recorded_ms++) {
+            server.advance();
+        }
+        CHECK(responses == 1);
+        CHECK(server.requests.size() == 1);
+    }
+    std::string joined;
+    for(const std::string &chunk : recorded) {
+        joined += chunk;
+    }
+    CHECK(joined == body);
+    CHECK(recorded.size() > 1);
+    CHECK(std::string((const char*)trace.data(), 4) == TRANSPORT_TRACE_MAGIC);
+
+    uint32_t elapsed_ms;
+    CHECK(replay(false, elapsed_ms) == recorded);
+    CHECK(elapsed_ms <= 2);
+    // Paced, the response takes as long as it did on the wire
+    CHECK(replay(true, elapsed_ms) == recorded);
+    CHECK(elapsed_ms + 2 >= recorded_ms);
+}
+
+// Plays bytes back until the transport gives up on them
+static bool plays(std::vector<uint8_t> bytes) {
+    replay_transport transport(bytes);
+    transport.connect("example.com", 80);
+    transport.advance(10);
+    return transport.valid();
+}
+
+static void malformed() {
+    std::vector<uint8_t> header = {'P', 'W', 'C', 'T', TRANSPORT_TRACE_VERSION}, bytes;
+    bytes = header;
+    bytes.insert(bytes.end(), {(uint8_t)capture::record_type::connected, 0});
+    CHECK(plays(bytes));
+    // Another version or no header at all
+    bytes[4] = TRANSPORT_TRACE_VERSION + 1;
+    CHECK(!plays(bytes));
+    CHECK(!plays({}));
+    // A type no version wrote
+    bytes = header;
+    bytes.insert(bytes.end(), {0, 0});
+    CHECK(!plays(bytes));
+    bytes = header;
+    bytes.insert(bytes.end(), {(uint8_t)capture::record_type::error + 1, 0});
+    CHECK(!plays(bytes));
+    // Cut short in the delta, the length, the payload and the error code
+    bytes = header;
+    bytes.insert(bytes.end(), {(uint8_t)capture::record_type::closed, 0x80});
+    CHECK(!plays(bytes));
+    bytes = header;
+    bytes.insert(bytes.end(), {(uint8_t)capture::record_type::received, 0});
+    CHECK(!plays(bytes));
+    bytes = header;
+    bytes.insert(bytes.end(), {(uint8_t)capture::record_type::received, 0, 4, 'a', 'b'});
+    CHECK(!plays(bytes));
+    bytes = header;
+    bytes.insert(bytes.end(), {(uint8_t)capture::record_type::error, 0});
+    CHECK(!plays(bytes));
+}
+
+int main() {
+    drain();
+    round_trip();
+    malformed();
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <string>
+
+#include "http_client.h"
+#include "loopback_transport.h"
+
+#include "test.h"
+
+// Server end that keeps the whole request, body included, and answers once
+// the body is complete by its Content-Length or its last chunk
+static loopback_transport *server;
+static std::string received, body;
+static bool answered, server_closed;
+
+static bool request_complete() {
+    size_t head_end = received.find("\r\n\r\n");
+    if(head_end == std::string::npos) {
+        return false;
+    }
+    std::string head = received.substr(0, head_end + 4);
+    std::string rest = received.substr(head_end + 4);
+    size_t length = head.find("Content-Length: ");
+    if(length != std::string::npos) {
+        size_t expected = std::stoul(head.substr(length + 16));
+        if(rest.size() < expected) {
+            return false;
+        }
+        body = rest.substr(0, expected);
+        return true;
+    }
+    CHECK(head.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+    body.clear();
+    size_t at = 0;
+    while(true) {
+        size_t line_end = rest.find("\r\n", at);
+        if(line_end == std::string::npos) {
+            return false;
+        }
+        size_t size = std::stoul(rest.substr(at, line_end - at), nullptr, 16);
+        if(rest.size() < line_end + 2 + size + 2) {
+            return false;
+        }
+        CHECK(rest.substr(line_end + 2 + size, 2) == "\r\n");
+        if(size == 0) {
+            return true;
+        }
+        body += rest.substr(line_end + 2, size);
+        at = line_end + 2 + size + 2;
+    }
+}
+
+static void receive() {
+    uint8_t buffer[BUF_SIZE];
+    size_t count = server->read({buffer, (size_t)server->available()});
+    received.append((const char*)buffer, count);
+    if(!answered && request_complete()) {
+        answered = true;
+        std::string response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+        server->write({(const uint8_t*)response.data(), response.size()});
+    }
+}
+
+static std::string pattern(size_t size) {
+    std::string text(size, 0);
+    for(size_t i = 0; i < size; i++) {
+        text[i] = (char)(i * 31 + i / 251);
+    }
+    return text;
+}
+
+static std::string source;
+static size_t provided, stop_at;
+static int calls;
+
+static size_t provide(std::span<uint8_t> out) {
+    calls++;
+    size_t count = std::min({out.size(), source.size() - provided, stop_at - provided});
+    memcpy(out.data(), source.data() + provided, count);
+    provided += count;
+    return count;
+}
+
+struct outcome {
+    int responses = 0, errors = 0;
+    err_t error = ERR_OK;
+};
+
+// Uploads source over a link with some latency, checking at every step that
+// no more than LOOPBACK_SEND_BUFFER of the body is out unacknowledged
+static outcome upload(int64_t length) {
+    loopback_transport *transport = new loopback_transport(1460, 5);
+    server = new loopback_transport(1460, 5);
+    loopback_transport::pair(*transport, *server);
+    server->on_receive(receive);
+    server->on_closed([](){
+        server_closed = true;
+    });
+    server->on_error([](err_t){
+        server_closed = true;
+    });
+    received.clear();
+    body.clear();
+    answered = false;
+    server_closed = false;
+    provided = 0;
+    calls = 0;
+    outcome result;
+    {
+        http_client client("http://example.com/", transport);
+        client.on_response([&result](){
+            result.responses++;
+        });
+        client.on_error([&result](err_t err){
+            result.errors++;
+            result.error = err;
+        });
+        client.upload("PUT", "/blob", provide, length);
+        size_t most_ahead = 0;
+        for(int ms = 0; ms < 5000 && result.responses + result.errors == 0; ms++) {
+            transport->advance();
+            server->advance();
+            host_advance_ms(1);
+            size_t delivered = received.size() - std::min(received.size(), received.find("\r\n\r\n") + 4);
+            most_ahead = std::max(most_ahead, provided - std::min(provided, delivered));
+        }
+        // Lets a close reach the server
+        for(int ms = 0; ms < 20; ms++) {
+            transport->advance();
+            server->advance();
+        }
+        // Chunk framing is on top of the body bytes, so it only ever leaves less of the body in flight
+        CHECK(most_ahead <= LOOPBACK_SEND_BUFFER);
+    }
+    delete server;
+    return result;
+}
+
+int main() {
+    // Several times the send buffer, with a length and chunked
+    source = pattern(5 * LOOPBACK_SEND_BUFFER + 123);
+    stop_at = SIZE_MAX;
+    outcome result = upload(source.size());
+    CHECK(result.responses == 1 && result.errors == 0);
+    CHECK(received.starts_with("PUT /blob HTTP/1.1\r\n"));
+    CHECK(received.find("Content-Length: " + std::to_string(source.size()) + "\r\n") != std::string::npos);
+    CHECK(body == source);
+    // Pulled in pieces as the link took them, not all at once
+    CHECK(calls > (int)(source.size() / HTTP_UPLOAD_CHUNK));
+
+    result = upload(-1);
+    CHECK(result.responses == 1 && result.errors == 0);
+    CHECK(received.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+    CHECK(received.find("Content-Length") == std::string::npos);
+    CHECK(body == source);
+    CHECK(received.ends_with("\r\n0\r\n\r\n"));
+
+    // A provider that runs dry before the Content-Length is up drops the connection
+    stop_at = 3000;
+    result = upload(source.size());
+    CHECK(result.responses == 0);
+    CHECK(result.errors == 1);
+    CHECK(result.error == ERR_VAL);
+    CHECK(server_closed);
+    CHECK(!answered);
+    CHECK(provided == 3000);
+    return 0;
+}